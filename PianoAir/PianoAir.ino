@@ -4,7 +4,10 @@
  * Features:
  * - Free play mode: Play any notes freely
  * - Recording: Record your performances to 4 slots
- * - Multi-track playback: Play back recordings individually or merged
+ * - Scales: major, minor, pentatonic, chromatic or two octaves, in any key
+ * - Multi-track playback: Play back recordings individually, merged or
+ *   polyphonically through a 4-voice wavetable synth
+ * - Looper: record a new track while the others play in a loop
  *
  * Hardware:
  * - Ultrasonic sensor (HC-SR04)
@@ -13,12 +16,32 @@
  */
 
 #include "config.h"
+#include "profile.h"
+#include "memory.h"
 #include "note_mapping.h"
 #include "utils.h"
+#include "synth.h"
+#include "sensor_filter.h"
+#include "note_tracker.h"
 #include "recording.h"
+#include "storage.h"
 #include "playback.h"
+#include "looper.h"
+#include "midi.h"
+#include "protocol.h"
+#include "output.h"
 #include "ui.h"
 
+// ============================================
+// FUNCTION PROTOTYPES
+// ============================================
+
+// The Arduino IDE generates these automatically; the host build needs them
+void handleTrackerEvent(TrackerEvent event, int note_index);
+void handleFreePlayNote(int note_index);
+void handleRecordingNote(int note_index);
+void handleLooperNote(int note_index);
+
 // ============================================
 // GLOBAL STATE
 // ============================================
@@ -32,31 +55,46 @@ int current_recording_slot = -1;
 // Overlap strategy for multi-track playback
 OverlapStrategy overlap_strategy = DEFAULT_OVERLAP_STRATEGY;
 
-// Last detected note for debouncing
-int last_detected_note = -1;
-unsigned long last_detected_note_time = 0;
-
 // ============================================
 // SETUP
 // ============================================
 
 void setup() {
+  // Before anything else uses the stack
+  paintFreeMemory();
+
   // Initialize serial communication
   Serial.begin(115200);
 
   // Initialize hardware (pins, interrupts)
   initializeHardware();
 
+  // Distance zones of the default scale
+  setScale(DEFAULT_SCALE, DEFAULT_KEY);
+
   // Initialize recording system
   initializeRecordingSystem();
 
+  #if ENABLE_EEPROM
+  // Restore saved recordings
+  int restored_slots = initializeStorage();
+  #endif
+
   // Print welcome message and menu
-  Serial.println(F("\n\n"));
-  Serial.println(F("*****************************************"));
-  Serial.println(F("*                                       *"));
-  Serial.println(F("*         WELCOME TO PIANO AIR!         *"));
-  Serial.println(F("*                                       *"));
-  Serial.println(F("*****************************************"));
+  text_out.println(F("\n\n"));
+  text_out.println(F("*****************************************"));
+  text_out.println(F("*                                       *"));
+  text_out.println(F("*         WELCOME TO PIANO AIR!         *"));
+  text_out.println(F("*                                       *"));
+  text_out.println(F("*****************************************"));
+
+  #if ENABLE_EEPROM
+  if (restored_slots > 0) {
+    text_out.print(F("\nRestored "));
+    text_out.print(restored_slots);
+    text_out.println(F(" recording(s) from EEPROM."));
+  }
+  #endif
 
   printMainMenu();
 }
@@ -66,67 +104,154 @@ void setup() {
 // ============================================
 
 void loop() {
-  unsigned long current_time = millis();
+  PROFILE_LOOP_BEGIN();
 
   // ---- HANDLE SERIAL INPUT ----
   SystemMode new_mode = processSerialInput();
   if (new_mode != current_mode) {
     current_mode = new_mode;
+
+    #if ENABLE_MIDI
+    // Don't leave a note hanging on the synth
+    sendMidiLiveNoteOff();
+    #endif
   }
+  PROFILE_STAGE(PROFILE_SERIAL);
+
+  #if ENABLE_PROTOCOL
+  // ---- STREAM PROTOCOL DUMPS ----
+  updateProtocol();
+  PROFILE_STAGE(PROFILE_PROTOCOL);
+  #endif
 
   // ---- UPDATE ULTRASONIC SENSOR ----
   updateUltrasonicSensor();
+  PROFILE_STAGE(PROFILE_SENSOR);
+
+  #if ENABLE_EEPROM
+  // ---- SAVE CHANGED RECORDINGS ----
+  updateStorage();
+  PROFILE_STAGE(PROFILE_STORAGE);
+  #endif
+
+  // ---- UPDATE LOOPER ----
+  // Before the echoes, so a note played after a pass boundary goes to the
+  // new pass
+  if (current_mode == MODE_LOOPER) {
+    int recorded_slot = updateLooper();
+    if (recorded_slot >= 0) {
+      status_out.print(F("\nSlot "));
+      status_out.print(recorded_slot + 1);
+      status_out.print(F(" recorded ("));
+      status_out.print(getSlotNoteCount(recorded_slot));
+      status_out.println(F(" notes), looping on.\n"));
+    }
+    PROFILE_STAGE(PROFILE_PLAYBACK);
+  }
 
   // ---- UPDATE PLAYBACK ----
   if (current_mode == MODE_PLAYBACK) {
     if (!updatePlayback()) {
       // Playback finished
       current_mode = MODE_FREE_PLAY;
-      Serial.println(F("\nPlayback finished.\n"));
+      status_out.println(F("\nPlayback finished.\n"));
     }
+    PROFILE_STAGE(PROFILE_PLAYBACK);
+    updateNoteEngine();
+    PROFILE_STAGE(PROFILE_NOTES);
+
+    // Drop echoes that arrive meanwhile: handled after playback they would
+    // be up to seconds stale
+    EchoSample stale;
+    while (popEchoSample(&stale)) {
+    }
+
+    updateOutput();
+    PROFILE_STAGE(PROFILE_OUTPUT);
+    PROFILE_LOOP_END();
     return;  // Skip sensor processing during playback
   }
 
+  // ---- RELEASE FINISHED NOTES ----
+  updateNoteEngine();
+  PROFILE_STAGE(PROFILE_NOTES);
+
   // ---- PROCESS SENSOR INPUT ----
-  if (isNewDistanceAvailable()) {
-    clearDistanceFlag();
-
-    float distance = getDistance();
-    int note_index = getNoteFromDistance(distance);
-
-    // Valid note detected
-    if (note_index != -1) {
-      // Debounce: ignore if same note detected too quickly
-      bool is_new_note = (note_index != last_detected_note) ||
-                         (current_time - last_detected_note_time > NOTE_DEBOUNCE_MS);
-
-      if (is_new_note) {
-        last_detected_note = note_index;
-        last_detected_note_time = current_time;
-
-        // Handle note based on current mode
-        switch (current_mode) {
-          case MODE_FREE_PLAY:
-            handleFreePlayNote(note_index);
-            break;
-
-          case MODE_RECORDING:
-            handleRecordingNote(note_index);
-            break;
-
-          default:
-            break;
-        }
-      }
+  // Drain every echo sample that arrived since the last iteration
+  EchoSample sample;
+  while (popEchoSample(&sample)) {
+    int note_index;
+    TrackerEvent event = updateNoteTracker(filterEchoWidth(sample.width_us), &note_index);
+
+    if (event != TRACKER_NONE) {
+      handleTrackerEvent(event, note_index);
     }
+    PROFILE_ECHO_HANDLED(sample.timestamp_us);
   }
+  PROFILE_STAGE(PROFILE_ECHOES);
 
+  // ---- SEND QUEUED TEXT ----
+  // Last, so serial output only uses time left over by the sensor
+  updateOutput();
+  PROFILE_STAGE(PROFILE_OUTPUT);
+  PROFILE_LOOP_END();
 }
 
 // ============================================
 // NOTE HANDLING FUNCTIONS
 // ============================================
 
+/**
+ * Dispatch a note tracker event according to the current mode
+ */
+void handleTrackerEvent(TrackerEvent event, int note_index) {
+  if (current_mode != MODE_FREE_PLAY && current_mode != MODE_RECORDING &&
+      current_mode != MODE_LOOPER) {
+    return;
+  }
+
+  switch (event) {
+    case TRACKER_NOTE_ON:
+      #if ENABLE_MIDI
+      // First, so the synth hears the note as early as possible
+      sendMidiLiveNoteOn(note_index);
+      #endif
+
+      if (current_mode == MODE_FREE_PLAY) {
+        handleFreePlayNote(note_index);
+      } else if (current_mode == MODE_LOOPER) {
+        handleLooperNote(note_index);
+      } else {
+        handleRecordingNote(note_index);
+      }
+      break;
+
+    case TRACKER_NOTE_HOLD:
+      // Keep the note sounding while the hand stays in its zone (the
+      // looper's live voice holds it until note-off)
+      if (current_mode != MODE_LOOPER) {
+        playNoteWithDuration(note_index, NOTE_DURATION_MS);
+      }
+      break;
+
+    case TRACKER_NOTE_OFF:
+      #if ENABLE_MIDI
+      sendMidiLiveNoteOff();
+      #endif
+
+      if (current_mode == MODE_LOOPER) {
+        releaseLooperNote();
+      } else {
+        releaseNote();
+        releaseNoteInRecording();
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
 /**
  * Handle note in free play mode
  */
@@ -134,8 +259,8 @@ void handleFreePlayNote(int note_index) {
   playNoteWithDuration(note_index, NOTE_DURATION_MS);
 
   #if ENABLE_DEBUG
-  Serial.print(F("Note: "));
-  Serial.println(getNoteName(note_index, true));
+  text_out.print(F("Note: "));
+  text_out.println(getNoteName(note_index, true));
   #endif
 }
 
@@ -150,18 +275,30 @@ void handleRecordingNote(int note_index) {
 
     #if ENABLE_DEBUG
     int slot = getActiveRecordingSlot();
-    Serial.print(F("Recorded: "));
-    Serial.print(getNoteName(note_index, true));
-    Serial.print(F(" ["));
-    Serial.print(getSlotNoteCount(slot));
-    Serial.print(F("/"));
-    Serial.print(MAX_NOTES_PER_SLOT);
-    Serial.println(F("]"));
+    text_out.print(F("Recorded: "));
+    text_out.print(getNoteName(note_index, true));
+    text_out.print(F(" ["));
+    text_out.print(getSlotNoteCount(slot));
+    text_out.print(F(" notes, "));
+    text_out.print(getSlotBytesUsed(slot));
+    text_out.print(F(" bytes, "));
+    text_out.print(getPoolFreeBytes(NULL));
+    text_out.println(F(" free]"));
     #endif
   } else {
-    // Recording failed (buffer full)
-    Serial.println(F("\n*** Recording buffer full! Recording stopped. ***\n"));
+    // Recording failed (pool full)
+    status_out.println(F("\n*** Recording buffer full! Recording stopped. ***\n"));
     stopRecording();
     current_mode = MODE_FREE_PLAY;
   }
 }
+
+/**
+ * Handle note in looper mode
+ */
+void handleLooperNote(int note_index) {
+  if (!playLooperNote(note_index)) {
+    // Take ended (pool full); the loop keeps playing
+    status_out.println(F("\n*** Recording buffer full! Take stopped, still looping. ***\n"));
+  }
+}
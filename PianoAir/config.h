@@ -26,14 +26,75 @@
 // TIMING CONSTANTS
 // ============================================
 
-// Ultrasonic sensor trigger interval (ms)
-#define ULTRASONIC_TRIGGER_DELAY 100
+// Farthest hand distance the sensor has to measure (cm)
+#define ULTRASONIC_MAX_RANGE_CM 80
+
+// Time from the trigger pulse until the HC-SR04 raises ECHO (us)
+#define ULTRASONIC_ECHO_SETUP_US 600
+
+// Give up on an echo after the longest in-range round trip (us)
+// 80 cm: 600 + 80 * 58 = 5240 us
+#define ULTRASONIC_ECHO_TIMEOUT_US (ULTRASONIC_ECHO_SETUP_US + ULTRASONIC_MAX_RANGE_CM * 58)
+
+// Minimum gap between an echo (or timeout) and the next trigger, so late
+// reflections of the previous ping are not taken for the next echo (us)
+// Gives roughly 35-45 samples/s depending on hand distance
+#define ULTRASONIC_REARM_GAP_US 20000
+
+// Echo samples buffered between the echo ISR and loop() (power of two)
+#define ECHO_RING_SIZE 8
 
 // Note duration for free play mode (ms)
 #define NOTE_DURATION_MS 500
 
-// Debounce time for note detection (ms)
-#define NOTE_DEBOUNCE_MS 50
+// Hysteresis band on each side of every note boundary (cm)
+// The hand has to cross a boundary by this much to change note
+#define NOTE_HYSTERESIS_CM 2
+
+// Consecutive out-of-range samples before a note is released (hand removed)
+#define NOTE_RELEASE_SAMPLES 3
+
+// ============================================
+// SCALES AND DISTANCE ZONES
+// ============================================
+
+// Scale and key at startup (N and K commands; see note_mapping.h)
+#define DEFAULT_SCALE SCALE_MAJOR
+#define DEFAULT_KEY 0               // Semitones above C
+
+// Playable range (cm): the nearest zone ends at NOTE_ZONE_FIRST_CM, the
+// others share the rest of the range equally
+#define NOTE_ZONE_MIN_CM 2
+#define NOTE_ZONE_FIRST_CM 10
+#define NOTE_ZONE_MAX_CM ULTRASONIC_MAX_RANGE_CM
+
+// ============================================
+// SENSOR FILTER CONFIGURATION
+// ============================================
+
+// Echo widths pass through a running median and then an optional
+// exponential moving average before note mapping (integer math only).
+// Added sample-to-decision latency, at ~40 samples/s (25 ms per sample),
+// for a jump to the middle of the next note zone:
+//
+//   SENSOR_MEDIAN_WINDOW  1: +0 samples   3: +1 (~25 ms)   5: +2 (~50 ms)
+//   SENSOR_EMA_SHIFT      0: +0 samples   1: +1 (~25 ms)   2: +2 (~50 ms)
+//                         3: +5 (~125 ms)
+//
+// The delays of both stages add up. Larger jumps take longer through the
+// EMA, which also passes through the notes in between (see README).
+// A median of N rejects up to (N - 1) / 2 consecutive spurious echoes;
+// the EMA smooths jitter near zone edges. Both can be set with -D.
+
+// Running median window in samples (1 = off, 3 or 5)
+#ifndef SENSOR_MEDIAN_WINDOW
+#define SENSOR_MEDIAN_WINDOW 3
+#endif
+
+// EMA weight of a new sample is 1 / 2^SENSOR_EMA_SHIFT (0 = off)
+#ifndef SENSOR_EMA_SHIFT
+#define SENSOR_EMA_SHIFT 0
+#endif
 
 // ============================================
 // RECORDING CONFIGURATION
@@ -42,10 +103,29 @@
 // Number of recording slots available
 #define NUM_RECORDING_SLOTS 4
 
-// Maximum notes per recording slot
-// Note: Each note takes ~2 bytes (note_index + duration)
-// 30 notes × 2 bytes × 4 slots = 240 bytes
-#define MAX_NOTES_PER_SLOT 30
+// Shared recording pool
+// Notes are bit-packed (see recording.h): 1 byte for notes up to 1.5 s,
+// 2 bytes for longer ones, and 1 byte for a run of up to 64 repeats.
+// All slots allocate their bytes from one pool of fixed-size blocks, so
+// a single long take can use the whole budget. Each block costs one
+// extra byte for its chain link; 30 x 8 = 240 data bytes (~240 notes).
+#define POOL_BLOCK_BYTES 8
+#define POOL_NUM_BLOCKS 30   // At most 254 (block indexes are uint8_t)
+#define RECORDING_POOL_BYTES (POOL_BLOCK_BYTES * POOL_NUM_BLOCKS)
+
+// EEPROM region used by the recording log (see storage.h)
+// Must hold two maximum-size records plus the whole pool: >= 762 bytes
+// with the default pool.
+#define EEPROM_LOG_START 0
+#define EEPROM_LOG_SIZE 1024
+
+// EEPROM bytes compared per loop() while saving (at most one is written)
+#define STORAGE_BYTES_PER_UPDATE 16
+
+// Maximum events in the merged playback timeline (7 bytes each on AVR)
+#ifndef MAX_TIMELINE_EVENTS
+#define MAX_TIMELINE_EVENTS 40
+#endif
 
 // Duration unit for recording (ms)
 // Durations stored as multiples of this value
@@ -63,7 +143,8 @@ enum OverlapStrategy {
   OVERLAP_PRIORITY_HIGH = 0,  // Play highest note when overlap
   OVERLAP_PRIORITY_LOW = 1,   // Play lowest note when overlap
   OVERLAP_ALTERNATE = 2,      // Rapidly alternate between notes
-  OVERLAP_DROP = 3            // First note takes priority, drop others
+  OVERLAP_DROP = 3,           // First note takes priority, drop others
+  OVERLAP_POLYPHONIC = 4      // Sound every slot at once (synth.h)
 };
 
 // Default overlap strategy
@@ -72,6 +153,66 @@ enum OverlapStrategy {
 // Alternate mode switching interval (ms)
 #define ALTERNATE_SWITCH_INTERVAL_MS 50
 
+// Playback speed limits (V command), percent of the recorded tempo
+#define PLAYBACK_SPEED_MIN_PERCENT 50
+#define PLAYBACK_SPEED_MAX_PERCENT 200
+
+// Transpose limit (+ / - commands), semitones either way
+#define PLAYBACK_TRANSPOSE_MAX 12
+
+// ============================================
+// SYNTHESIZER (POLYPHONIC PLAYBACK)
+// ============================================
+
+// Voices mixed by the Timer1 interrupt (one per merged slot)
+#define SYNTH_VOICES 4
+
+// Interrupt / output sample rate (Hz)
+// 16 MHz / 20 kHz = 800 cycles per sample. The tick takes an estimated
+// ~225 cycles with 4 voices (~28% CPU, see synth.h); `D` shows the measured
+// maximum.
+#define SYNTH_SAMPLE_RATE 20000
+
+// ============================================
+// LOOPER
+// ============================================
+
+// Voice the hand plays on while the looper runs; the voices below it play
+// the looping slots (see looper.h)
+#define LOOPER_LIVE_VOICE (SYNTH_VOICES - 1)
+
+// ============================================
+// SERIAL OUTPUT
+// ============================================
+
+// Queued print items (see output.h); a full queue blocks like
+// Serial.print() until an item has been sent
+#define OUTPUT_STATUS_ITEMS 8     // Command replies and errors
+#define OUTPUT_TEXT_ITEMS 24      // Menu, listings, diagnostics
+
+// Most items one section of a listing queues (L, D, T and F are written a
+// section at a time; OUTPUT_TEXT_ITEMS holds two)
+#define OUTPUT_SECTION_ITEMS 12
+
+// Queued bytes moved into the serial TX buffer per loop()
+#define OUTPUT_BYTES_PER_UPDATE 16
+
+// ============================================
+// SRAM MONITOR
+// ============================================
+
+// Merged playback (PA, PS) is refused once the stack has come closer than
+// this to the heap (bytes, see memory.h)
+#define MEMORY_MIN_HEADROOM 128
+
+// ============================================
+// MIDI OUTPUT
+// ============================================
+
+// Channel (1-16) and velocity of exported and live notes (see midi.h)
+#define MIDI_CHANNEL 1
+#define MIDI_VELOCITY 100
+
 // ============================================
 // SYSTEM MODES
 // ============================================
@@ -80,15 +221,28 @@ enum SystemMode {
   MODE_MENU = 0,        // Main menu / idle
   MODE_FREE_PLAY = 1,   // Playing notes freely
   MODE_RECORDING = 2,   // Recording in progress
-  MODE_PLAYBACK = 3     // Playing back recording(s)
+  MODE_PLAYBACK = 3,    // Playing back recording(s)
+  MODE_LOOPER = 4       // Looping slots while recording over them
 };
 
 // ============================================
 // FEATURE FLAGS
 // ============================================
 
-// Enable EEPROM storage (future feature)
-#define ENABLE_EEPROM false
+// Save recordings to EEPROM and restore them at startup (see storage.h)
+#define ENABLE_EEPROM true
+
+// Binary serial protocol next to the text menu (see protocol.h)
+#define ENABLE_PROTOCOL true
+
+// Live MIDI note output (I command, see midi.h)
+#define ENABLE_MIDI true
+
+// Loop stage timers, echo latency and playback lateness (T command,
+// see profile.h); costs ~150 bytes of SRAM and ~10 micros() calls per loop
+#ifndef ENABLE_PROFILING
+#define ENABLE_PROFILING false
+#endif
 
 // Enable debug output
 #define ENABLE_DEBUG false
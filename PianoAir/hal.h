@@ -0,0 +1,217 @@
+#ifndef HAL_H
+#define HAL_H
+
+// ============================================
+// HARDWARE ABSTRACTION LAYER
+// ============================================
+
+// All clock, pin, tone, interrupt and serial access in the sketch goes
+// through the Arduino API. On the board that API comes from the Arduino
+// core; in the host build (PIANOAIR_HOST, see host/ and CMakeLists.txt)
+// it comes from a simulated runtime with a virtual clock, pins and serial
+// port, so the same sketch logic can be compiled and measured on Linux.
+
+#ifdef PIANOAIR_HOST
+#include "arduino_host.h"
+#else
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#endif
+
+// Compiler barrier: keeps memory accesses on their side of this point.
+// Used to publish data shared between an ISR and the main loop.
+#define HAL_MEMORY_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+// ============================================
+// FAST OUTPUT PIN
+// ============================================
+
+// For outputs toggled from an ISR: the port register and bit are looked up
+// once, so each write is a single read-modify-write of the port instead of
+// a full digitalWrite() (~50 cycles)
+
+#ifdef PIANOAIR_HOST
+struct HalFastPin {
+  uint8_t pin;
+};
+
+inline void halFastPinInit(HalFastPin* fast_pin, uint8_t pin) {
+  fast_pin->pin = pin;
+}
+
+inline void halFastPinWrite(const HalFastPin* fast_pin, uint8_t level) {
+  digitalWrite(fast_pin->pin, level);
+}
+#else
+struct HalFastPin {
+  volatile uint8_t* port;
+  uint8_t mask;
+};
+
+inline void halFastPinInit(HalFastPin* fast_pin, uint8_t pin) {
+  fast_pin->port = portOutputRegister(digitalPinToPort(pin));
+  fast_pin->mask = digitalPinToBitMask(pin);
+}
+
+// Call with interrupts masked (ISRs are): the port update is not atomic
+inline void halFastPinWrite(const HalFastPin* fast_pin, uint8_t level) {
+  if (level) {
+    *fast_pin->port |= fast_pin->mask;
+  } else {
+    *fast_pin->port &= ~fast_pin->mask;
+  }
+}
+#endif
+
+// ============================================
+// PORT B / D OUTPUTS
+// ============================================
+
+// On the ATmega328P (Uno, Nano) digital pins 0-7 are PORTD bits 0-7 and
+// pins 8-13 are PORTB bits 0-5. A group of outputs on those pins can be
+// updated with one store per port instead of one digitalWrite() per pin.
+// The bit of a pin resolves at compile time (0 if it is not on the port).
+#define HAL_PORTB_BIT(pin) (((pin) >= 8 && (pin) <= 13) ? (1 << ((pin) - 8)) : 0)
+#define HAL_PORTD_BIT(pin) (((pin) >= 0 && (pin) <= 7) ? (1 << (pin)) : 0)
+
+#if !defined(PIANOAIR_HOST) && (defined(__AVR_ATmega328P__) || defined(__AVR_ATmega168__))
+#define HAL_HAS_PORTS_BD 1
+
+/**
+ * Replace some bits of PORTB and PORTD
+ * Interrupts are masked for the update so it cannot undo a pin change
+ * made by an ISR on the same port (the synth writes the buzzer pin).
+ * @param b_mask PORTB bits to change
+ * @param b_bits New values of those bits
+ * @param d_mask PORTD bits to change
+ * @param d_bits New values of those bits
+ */
+inline void halWritePortsBD(uint8_t b_mask, uint8_t b_bits, uint8_t d_mask, uint8_t d_bits) {
+  uint8_t sreg = SREG;
+  cli();
+  PORTB = (PORTB & ~b_mask) | b_bits;
+  PORTD = (PORTD & ~d_mask) | d_bits;
+  SREG = sreg;
+}
+#else
+#define HAL_HAS_PORTS_BD 0
+#endif
+
+// ============================================
+// SAMPLE TIMER
+// ============================================
+
+// Timer1 in CTC mode, no prescaler, calls halSampleTimerTick() (defined by
+// the sketch) at a fixed rate. tone() uses Timer2, so both can coexist.
+void halSampleTimerTick();
+
+#ifdef PIANOAIR_HOST
+inline void halStartSampleTimer(uint16_t rate_hz) {
+  hostStartTimer(1000000UL / rate_hz, halSampleTimerTick);
+}
+
+inline void halStopSampleTimer() {
+  hostStopTimer();
+}
+
+// Not measurable on the host (see host/bench.cpp for the host cost)
+inline uint16_t halSampleTimerCount() {
+  return 0;
+}
+#else
+inline void halStartSampleTimer(uint16_t rate_hz) {
+  noInterrupts();
+  TCCR1A = 0;
+  TCCR1B = _BV(WGM12) | _BV(CS10);   // CTC on OCR1A, clk/1
+  OCR1A = F_CPU / rate_hz - 1;
+  TCNT1 = 0;
+  TIFR1 = _BV(OCF1A);
+  TIMSK1 |= _BV(OCIE1A);
+  interrupts();
+}
+
+inline void halStopSampleTimer() {
+  TIMSK1 &= ~_BV(OCIE1A);
+  TCCR1B = 0;
+}
+
+// CPU cycles since the last compare match (Timer1 runs at clk/1), so read
+// at the end of the tick it gives the cycles the interrupt has taken
+inline uint16_t halSampleTimerCount() {
+  return TCNT1;
+}
+
+ISR(TIMER1_COMPA_vect) {
+  halSampleTimerTick();
+}
+#endif
+
+// ============================================
+// SRAM LAYOUT
+// ============================================
+
+// .data and .bss sit at the bottom of SRAM, the heap (unused by the
+// sketch) above them and the stack grows down from RAMEND. The gap between
+// the heap end and the stack pointer is free. The host stack is not laid
+// out like this, so the stack monitor is board-only.
+
+#if !defined(PIANOAIR_HOST) && defined(__AVR__)
+#define HAL_HAS_STACK_MONITOR 1
+
+extern char __heap_start;
+extern char* __brkval;
+
+/**
+ * First byte above .data, .bss and the heap
+ */
+inline uint8_t* halHeapEnd() {
+  return (uint8_t*)(__brkval != 0 ? __brkval : &__heap_start);
+}
+
+/**
+ * Current stack pointer (next free byte of the stack)
+ */
+inline uint8_t* halStackPointer() {
+  return (uint8_t*)SP;
+}
+
+// First SRAM address and SRAM size
+#define HAL_RAM_START ((uint8_t*)RAMSTART)
+#define HAL_RAM_SIZE (RAMEND - RAMSTART + 1)
+#else
+#define HAL_HAS_STACK_MONITOR 0
+#endif
+
+// ============================================
+// EEPROM
+// ============================================
+
+// Size of the on-chip EEPROM in bytes
+#define HAL_EEPROM_SIZE (E2END + 1)
+
+// A write takes ~3.3 ms and any EEPROM access started before it finishes
+// busy-waits. Callers that must not block check halEepromReady() first and
+// issue at most one write per check.
+
+/**
+ * Check whether the EEPROM can be accessed without waiting
+ */
+inline bool halEepromReady() {
+  return eeprom_is_ready();
+}
+
+/**
+ * Read one EEPROM byte
+ */
+inline uint8_t halEepromRead(uint16_t address) {
+  return eeprom_read_byte((const uint8_t*)(uintptr_t)address);
+}
+
+/**
+ * Start writing one EEPROM byte (returns while the write completes)
+ */
+inline void halEepromWrite(uint16_t address, uint8_t value) {
+  eeprom_write_byte((uint8_t*)(uintptr_t)address, value);
+}
+
+#endif // HAL_H
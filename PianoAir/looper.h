@@ -0,0 +1,258 @@
+#ifndef LOOPER_H
+#define LOOPER_H
+
+#include "hal.h"
+#include "config.h"
+#include "recording.h"
+#include "playback.h"
+#include "synth.h"
+
+// ============================================
+// LIVE LOOPER
+// ============================================
+
+// O<n> loops the other recorded slots and records the hand into slot n at
+// the same time. The loop is as long as the longest of those slots. The
+// looping slots stream through the synth, one voice each, and the hand
+// plays on LOOPER_LIVE_VOICE, so both can be heard. Slots beyond
+// LOOPER_LIVE_VOICE are not played.
+//
+// Playback and recording share one clock, looper_pass_start. The looping
+// slots are read relative to it, and the take is a timed take
+// (recording.h) that starts at it. Each pass starts exactly one loop
+// length after the previous one, however late loop() notices, so neither
+// side drifts from pass to pass. A take covers one pass and is padded with
+// rest to the loop length. From the next pass it loops with the others.
+// O<m> while looping records slot m from the next pass.
+
+// ============================================
+// LOOPER STATE
+// ============================================
+
+bool looper_active = false;
+unsigned long looper_pass_start = 0;     // Start of the current pass (millis)
+unsigned long looper_length_ms = 0;      // Length of one pass
+int looper_take_slot = -1;               // Slot recorded this pass, -1 if none
+int looper_armed_slot = -1;              // Slot to record from the next pass
+
+// ============================================
+// PASS FUNCTIONS
+// ============================================
+
+/**
+ * Collect the slots a pass plays: every recorded slot except one
+ * @param exclude Slot left out (recorded this pass), or -1
+ * @param out_slots Output: array of at least NUM_RECORDING_SLOTS entries
+ * @return Number of slots (at most LOOPER_LIVE_VOICE)
+ */
+int getLooperSlots(int exclude, int* out_slots) {
+  int count = 0;
+  for (int i = 0; i < NUM_RECORDING_SLOTS && count < LOOPER_LIVE_VOICE; i++) {
+    if (i != exclude && isSlotActive(i)) {
+      out_slots[count++] = i;
+    }
+  }
+  return count;
+}
+
+/**
+ * Start a pass at looper_pass_start: open the armed take and rewind the
+ * looping slots
+ */
+void beginLooperPass() {
+  if (looper_armed_slot != -1) {
+    if (startTimedRecording(looper_armed_slot, looper_pass_start)) {
+      looper_take_slot = looper_armed_slot;
+    }
+    looper_armed_slot = -1;
+  }
+
+  int slots[NUM_RECORDING_SLOTS];
+  int num_slots = getLooperSlots(looper_take_slot, slots);
+  beginStreamingMerge(slots, num_slots, OVERLAP_POLYPHONIC);
+
+  for (int v = 0; v < LOOPER_LIVE_VOICE; v++) {
+    synthSetVoice(v, v < stream_cursor_count ? getCursorNote(&stream_cursors[v]) : -1);
+  }
+  showSynthVoiceLEDs();
+
+  startPlaybackClock(looper_pass_start);
+  setPlaybackSlots(slots, num_slots);
+}
+
+/**
+ * Check whether this pass is recording
+ */
+bool isLooperTakeOpen() {
+  return looper_take_slot != -1 && isRecording() && getActiveRecordingSlot() == looper_take_slot;
+}
+
+/**
+ * End the take of this pass; the rest of the pass is recorded as silence
+ * @return Slot recorded, or -1 if no take was open
+ */
+int endLooperTake() {
+  int slot = looper_take_slot;
+  looper_take_slot = -1;
+
+  if (slot == -1) {
+    return -1;
+  }
+  if (!stopTimedRecording(looper_pass_start + looper_length_ms) && !isSlotActive(slot)) {
+    return -1;  // Take already ended (pool full) with nothing in it
+  }
+  return slot;
+}
+
+// ============================================
+// PUBLIC FUNCTIONS
+// ============================================
+
+/**
+ * Start looping the recorded slots and record a take into one of them
+ * @param slot_num Slot to record (0 to NUM_RECORDING_SLOTS-1)
+ * @return false if busy or there is nothing else to loop
+ */
+bool startLooper(int slot_num) {
+  if (slot_num < 0 || slot_num >= NUM_RECORDING_SLOTS) {
+    return false;
+  }
+  if (looper_active || isPlaying() || isRecording() || getLoadingSlot() != -1) {
+    return false;
+  }
+
+  int slots[NUM_RECORDING_SLOTS];
+  int num_slots = getLooperSlots(slot_num, slots);
+  unsigned long length_ms = 0;
+  for (int s = 0; s < num_slots; s++) {
+    unsigned long duration_ms = getRecordingDuration(slots[s]);
+    if (duration_ms > length_ms) {
+      length_ms = duration_ms;
+    }
+  }
+  if (length_ms == 0) {
+    return false;  // Nothing to loop over
+  }
+
+  releaseNote();
+  startSynth();
+
+  // The take is recorded in real time against the loop, so the loop plays
+  // at the recorded speed and pitch (V, + and - apply after the looper)
+  playback_as_recorded = true;
+
+  looper_active = true;
+  looper_length_ms = length_ms;
+  looper_pass_start = millis();
+  looper_take_slot = -1;
+  looper_armed_slot = slot_num;
+  beginLooperPass();
+
+  // Shows as polyphonic playback: X and the isPlaying() checks apply
+  is_playing = true;
+  playback_streaming = true;
+  playback_polyphonic = true;
+  has_pending_event = false;
+
+  return true;
+}
+
+/**
+ * Record a slot from the next pass
+ * @param slot_num Slot to record (0 to NUM_RECORDING_SLOTS-1)
+ * @return false if the looper is not running
+ */
+bool armLooperSlot(int slot_num) {
+  if (!looper_active || slot_num < 0 || slot_num >= NUM_RECORDING_SLOTS) {
+    return false;
+  }
+  looper_armed_slot = slot_num;
+  return true;
+}
+
+/**
+ * Stop the looper, keeping a take in progress (padded to its pass)
+ */
+void stopLooper() {
+  if (!looper_active) {
+    return;
+  }
+  endLooperTake();
+  looper_armed_slot = -1;
+  looper_active = false;
+  stopPlayback();
+}
+
+/**
+ * Advance the looping slots and start the next pass on time (call in
+ * main loop, before the sensor input is handled)
+ * @return Slot whose take ended with the pass, or -1
+ */
+int updateLooper() {
+  if (!looper_active) {
+    return -1;
+  }
+
+  int finished_slot = -1;
+  if (millis() - looper_pass_start >= looper_length_ms) {
+    finished_slot = endLooperTake();
+    looper_pass_start += looper_length_ms;
+    beginLooperPass();
+  }
+
+  updatePolyphonicPlayback();  // Silent until the pass ends once all slots are done
+  return finished_slot;
+}
+
+/**
+ * Play the hand's note on the live voice and record it in an open take
+ * @param note_index Note (0 to NUM_NOTES - 1)
+ * @return false if the take just ended because the pool is full
+ */
+bool playLooperNote(int note_index) {
+  synthSetVoice(LOOPER_LIVE_VOICE, note_index);
+  showSynthVoiceLEDs();
+
+  if (isLooperTakeOpen() && !addNoteToRecording(note_index)) {
+    looper_take_slot = -1;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Silence the live voice (hand lifted); the take's note ends here
+ */
+void releaseLooperNote() {
+  synthSetVoice(LOOPER_LIVE_VOICE, -1);
+  showSynthVoiceLEDs();
+
+  if (isLooperTakeOpen()) {
+    releaseNoteInRecording();
+  }
+}
+
+/**
+ * Check if the looper is running
+ */
+bool isLooperActive() {
+  return looper_active;
+}
+
+/**
+ * Get the slot recorded this pass
+ * @return Slot number, or -1 if none
+ */
+int getLooperTakeSlot() {
+  return looper_take_slot;
+}
+
+/**
+ * Get the length of one pass
+ * @return Milliseconds, 0 if the looper is not running
+ */
+unsigned long getLooperLength() {
+  return looper_active ? looper_length_ms : 0;
+}
+
+#endif // LOOPER_H
@@ -0,0 +1,117 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include "hal.h"
+#include "config.h"
+
+// ============================================
+// SRAM MONITOR
+// ============================================
+
+// At startup the free gap between the heap end and the stack is painted
+// with MEMORY_PAINT. Stack frames and interrupts that reach into the gap
+// overwrite the pattern, so the painted bytes still intact at the bottom
+// are the least free memory since painting (the stack high-water mark).
+// F prints it; merged playback, whose timeline building and resolving run
+// deepest, is refused once it drops below MEMORY_MIN_HEADROOM. Both paint
+// the gap again afterwards, so the mark covers the time since the last
+// report or refusal rather than since reset.
+//
+// Board only (HAL_HAS_STACK_MONITOR): on the host the values read -1 and
+// nothing is refused.
+
+#define MEMORY_PAINT 0xA5
+
+// Bytes below the stack pointer left alone while painting (the painting
+// function's own calls)
+#define MEMORY_PAINT_GUARD 16
+
+// ============================================
+// MONITOR STATE
+// ============================================
+
+#if HAL_HAS_STACK_MONITOR
+uint8_t* memory_paint_bottom = NULL;
+uint8_t* memory_paint_top = NULL;
+#endif
+
+// Operations refused for lack of headroom
+unsigned long memory_refusals = 0;
+
+// ============================================
+// PUBLIC FUNCTIONS
+// ============================================
+
+/**
+ * Paint the free gap, restarting the high-water mark
+ * Called first thing in setup(), then after each report or refusal. Only
+ * the gap below the caller's stack frame is painted.
+ */
+void paintFreeMemory() {
+  #if HAL_HAS_STACK_MONITOR
+  memory_paint_bottom = halHeapEnd();
+  memory_paint_top = halStackPointer() - MEMORY_PAINT_GUARD;
+  for (uint8_t* p = memory_paint_bottom; p < memory_paint_top; p++) {
+    *p = MEMORY_PAINT;
+  }
+  #endif
+}
+
+/**
+ * Get the size of .data, .bss and the heap
+ * @return Bytes, or -1 if not measured
+ */
+int getStaticMemory() {
+  #if HAL_HAS_STACK_MONITOR
+  return halHeapEnd() - HAL_RAM_START;
+  #else
+  return -1;
+  #endif
+}
+
+/**
+ * Get the free gap between the heap and the stack right now
+ * @return Bytes, or -1 if not measured
+ */
+int getFreeMemory() {
+  #if HAL_HAS_STACK_MONITOR
+  return halStackPointer() - halHeapEnd();
+  #else
+  return -1;
+  #endif
+}
+
+/**
+ * Get the smallest free gap since the last paint (stack high-water mark)
+ * Scans the painted bytes from the bottom: a few hundred bytes, ~0.1 ms.
+ * @return Bytes, or -1 if not measured
+ */
+int getMinFreeMemory() {
+  #if HAL_HAS_STACK_MONITOR
+  uint8_t* p = memory_paint_bottom;
+  while (p < memory_paint_top && *p == MEMORY_PAINT) {
+    p++;
+  }
+  return p - memory_paint_bottom;
+  #else
+  return -1;
+  #endif
+}
+
+/**
+ * Check that the stack has not come closer than MEMORY_MIN_HEADROOM bytes
+ * to the heap since the last paint; counts a refusal and paints again when
+ * it has
+ * @return true if a deep operation (merged playback) may run
+ */
+bool checkMemoryHeadroom() {
+  int min_free = getMinFreeMemory();
+  if (min_free >= 0 && min_free < MEMORY_MIN_HEADROOM) {
+    memory_refusals++;
+    paintFreeMemory();
+    return false;
+  }
+  return true;
+}
+
+#endif // MEMORY_H
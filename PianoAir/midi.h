@@ -0,0 +1,483 @@
+#ifndef MIDI_H
+#define MIDI_H
+
+#include "hal.h"
+#include "config.h"
+#include "note_mapping.h"
+#include "recording.h"
+#include "playback.h"
+
+// ============================================
+// MIDI OUTPUT
+// ============================================
+
+// Two ways to get notes to a real synth:
+// - Standard MIDI File export: a slot, or all slots merged with the current
+//   overlap strategy, is generated a few bytes at a time while it is sent
+//   (see PROTO_CMD_MIDI_EXPORT in protocol.h). Nothing is built in RAM: a
+//   counting pass over the same events gives each track's length first.
+//   Merged exports use the streaming merge (no timeline); Polyphonic mode
+//   exports one track per slot instead.
+// - Live MIDI: note-on/off messages are written to the serial port as the
+//   note tracker reports them, for a serial-to-MIDI bridge on the PC
+//   (e.g. Hairless MIDI, ttymidi) at the sketch's baud rate. Text output is
+//   paused meanwhile so the port carries MIDI only.
+//
+// Timing: tempo 120 BPM with MIDI_TICKS_PER_QUARTER ticks per quarter note
+// gives exactly one tick per millisecond.
+
+#define MIDI_NOTE_ON 0x90
+#define MIDI_TICKS_PER_QUARTER 500
+#define MIDI_TEMPO_US 500000UL     // Microseconds per quarter note (120 BPM)
+
+// Largest chunk produced at once: one note's on + off with 4- and 3-byte
+// delta times, or the file header
+#define MIDI_CHUNK_BYTES 14
+
+// Export stages
+enum MidiExportPhase {
+  MIDI_PHASE_FILE_HEADER = 0,
+  MIDI_PHASE_TRACK_HEADER = 1,   // "MTrk" and length
+  MIDI_PHASE_TEMPO = 2,          // Tempo meta event (first track only)
+  MIDI_PHASE_NOTES = 3,
+  MIDI_PHASE_TRACK_END = 4,
+  MIDI_PHASE_DONE = 5
+};
+
+// ============================================
+// MIDI STATE
+// ============================================
+
+// File export
+bool midi_export_active = false;
+bool midi_export_merged = false;            // One track from the streaming merge
+uint8_t midi_export_slots = 0;              // Bitmask of slots exported
+uint8_t midi_export_tracks_left = 0;        // Slot tracks not started yet (bitmask)
+int8_t midi_export_slot = -1;               // Slot of the current track (-1 when merged)
+bool midi_export_first_track = true;
+OverlapStrategy midi_export_strategy = DEFAULT_OVERLAP_STRATEGY;
+uint8_t midi_export_revisions[NUM_RECORDING_SLOTS];
+MidiExportPhase midi_export_phase = MIDI_PHASE_DONE;
+
+// Note source of the current track
+SlotReader midi_export_reader;
+unsigned long midi_export_time = 0;         // Start of the next slot event
+unsigned long midi_export_last = 0;         // Time of the last MIDI event written
+bool midi_export_has_next = false;
+TimelineEvent midi_export_next;             // Look-ahead for joining segments
+bool midi_export_first_note = true;         // Status byte not sent yet in this track
+
+// Bytes waiting to be sent
+uint8_t midi_export_chunk[MIDI_CHUNK_BYTES];
+uint8_t midi_export_chunk_length = 0;
+uint8_t midi_export_chunk_pos = 0;
+unsigned long midi_export_offset = 0;       // File bytes sent so far
+
+// Live output
+bool midi_live_enabled = false;
+int8_t midi_live_note = -1;                 // Note held on the synth
+
+// ============================================
+// ENCODING HELPERS
+// ============================================
+
+/**
+ * Write a MIDI variable-length quantity
+ * @return Number of bytes written (1-4)
+ */
+uint8_t putMidiVarLength(uint8_t* out, unsigned long value) {
+  uint8_t groups = 1;
+  while (groups < 4 && (value >> (7 * groups)) != 0) {
+    groups++;
+  }
+  for (uint8_t i = 0; i < groups; i++) {
+    uint8_t shift = 7 * (groups - 1 - i);
+    out[i] = ((value >> shift) & 0x7F) | (i < groups - 1 ? 0x80 : 0);
+  }
+  return groups;
+}
+
+/**
+ * Write a 32-bit big-endian value
+ */
+void putMidiLong(uint8_t* out, unsigned long value) {
+  out[0] = (uint8_t)(value >> 24);
+  out[1] = (uint8_t)(value >> 16);
+  out[2] = (uint8_t)(value >> 8);
+  out[3] = (uint8_t)value;
+}
+
+/**
+ * Encode one note as note-on and note-off (note-on, velocity 0)
+ * Running status: only the track's first event carries the status byte.
+ * @param out At least MIDI_CHUNK_BYTES bytes
+ * @param duration_ms Note length (may exceed a TimelineEvent's 16 bits)
+ * @return Number of bytes written
+ */
+uint8_t encodeMidiNote(uint8_t* out, unsigned long start_ms, uint8_t note_index,
+                       unsigned long duration_ms) {
+  uint8_t length = putMidiVarLength(out, start_ms - midi_export_last);
+  if (midi_export_first_note) {
+    out[length++] = MIDI_NOTE_ON | (MIDI_CHANNEL - 1);
+    midi_export_first_note = false;
+  }
+  out[length++] = getNoteMidiNumber(note_index);
+  out[length++] = MIDI_VELOCITY;
+  length += putMidiVarLength(&out[length], duration_ms);
+  out[length++] = getNoteMidiNumber(note_index);
+  out[length++] = 0;
+
+  midi_export_last = start_ms + duration_ms;
+  return length;
+}
+
+// ============================================
+// NOTE SOURCE
+// ============================================
+
+/**
+ * Fetch one event from the track's source (no joining)
+ */
+bool fetchMidiSourceEvent(TimelineEvent* out) {
+  if (midi_export_merged) {
+    return fetchNextStreamEvent(out);
+  }
+
+  // Rests only move the clock on
+  NoteEvent note;
+  do {
+    if (!readNextEvent(&midi_export_reader, &note)) {
+      return false;
+    }
+    *out = TimelineEvent(midi_export_time, note.note_index, note.duration_units * DURATION_UNIT_MS);
+    midi_export_time += out->duration_ms;
+  } while (note.note_index == NOTE_REST);
+  return true;
+}
+
+/**
+ * Start reading the notes of the current track
+ * @return false if there is nothing to read
+ */
+bool beginMidiTrackNotes() {
+  midi_export_time = 0;
+  midi_export_last = 0;
+  midi_export_first_note = true;
+  midi_export_has_next = false;
+
+  if (midi_export_merged) {
+    int slots[NUM_RECORDING_SLOTS];
+    int num_slots = getActiveSlots(slots);
+    if (!beginStreamingMerge(slots, num_slots, midi_export_strategy)) {
+      return false;
+    }
+  } else if (!beginSlotRead(midi_export_slot, &midi_export_reader)) {
+    return false;
+  }
+
+  midi_export_has_next = fetchMidiSourceEvent(&midi_export_next);
+  return midi_export_has_next;
+}
+
+/**
+ * Get the next note of the current track
+ * In a merged export, back-to-back segments of the same note (the merge
+ * splits notes at every overlap boundary) become one note, as on the
+ * buzzer. Slot tracks keep repeated strikes apart.
+ * @return false at the end of the track
+ */
+bool nextMidiTrackNote(unsigned long* start_ms, uint8_t* note_index, unsigned long* duration_ms) {
+  if (!midi_export_has_next) {
+    return false;
+  }
+
+  *start_ms = midi_export_next.timestamp_ms;
+  *note_index = midi_export_next.note_index;
+  *duration_ms = midi_export_next.duration_ms;
+
+  TimelineEvent event;
+  midi_export_has_next = false;
+  while (fetchMidiSourceEvent(&event)) {
+    if (midi_export_merged && event.note_index == *note_index &&
+        event.timestamp_ms == *start_ms + *duration_ms) {
+      *duration_ms += event.duration_ms;
+      continue;
+    }
+    midi_export_next = event;
+    midi_export_has_next = true;
+    break;
+  }
+  return true;
+}
+
+/**
+ * Count the bytes of the current track's notes (a dry run of the export)
+ */
+unsigned long measureMidiTrackNotes() {
+  uint8_t scratch[MIDI_CHUNK_BYTES];
+  unsigned long bytes = 0;
+  unsigned long start_ms;
+  unsigned long duration_ms;
+  uint8_t note_index;
+
+  beginMidiTrackNotes();
+  while (nextMidiTrackNote(&start_ms, &note_index, &duration_ms)) {
+    bytes += encodeMidiNote(scratch, start_ms, note_index, duration_ms);
+  }
+  return bytes;
+}
+
+// ============================================
+// FILE GENERATION
+// ============================================
+
+/**
+ * Pick the next slot track of a per-slot export
+ * @return false if no tracks are left
+ */
+bool nextMidiExportTrack() {
+  if (midi_export_merged) {
+    return midi_export_first_track;
+  }
+  for (int i = 0; i < NUM_RECORDING_SLOTS; i++) {
+    if (midi_export_tracks_left & (1 << i)) {
+      midi_export_tracks_left &= ~(1 << i);
+      midi_export_slot = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Produce the next chunk of the file into midi_export_chunk
+ * @return false when the file is complete
+ */
+bool fillMidiExportChunk() {
+  uint8_t* out = midi_export_chunk;
+  uint8_t length = 0;
+
+  while (length == 0) {
+    switch (midi_export_phase) {
+      case MIDI_PHASE_FILE_HEADER: {
+        uint8_t tracks = 0;
+        for (uint8_t mask = midi_export_tracks_left; mask != 0; mask >>= 1) {
+          tracks += mask & 1;
+        }
+        if (midi_export_merged) {
+          tracks = 1;
+        }
+        memcpy(out, "MThd", 4);
+        putMidiLong(&out[4], 6);
+        out[8] = 0;
+        out[9] = tracks > 1 ? 1 : 0;        // Format 1 for a track per slot
+        out[10] = 0;
+        out[11] = tracks;
+        out[12] = (uint8_t)(MIDI_TICKS_PER_QUARTER >> 8);
+        out[13] = (uint8_t)MIDI_TICKS_PER_QUARTER;
+        length = 14;
+        midi_export_phase = MIDI_PHASE_TRACK_HEADER;
+        break;
+      }
+
+      case MIDI_PHASE_TRACK_HEADER: {
+        if (!nextMidiExportTrack()) {
+          midi_export_phase = MIDI_PHASE_DONE;
+          break;
+        }
+        // Track length: tempo (first track), notes, end of track
+        unsigned long track_bytes = measureMidiTrackNotes() + 4;
+        if (midi_export_first_track) {
+          track_bytes += 7;
+        }
+        memcpy(out, "MTrk", 4);
+        putMidiLong(&out[4], track_bytes);
+        length = 8;
+        midi_export_phase = midi_export_first_track ? MIDI_PHASE_TEMPO : MIDI_PHASE_NOTES;
+        beginMidiTrackNotes();
+        break;
+      }
+
+      case MIDI_PHASE_TEMPO:
+        out[0] = 0x00;
+        out[1] = 0xFF;
+        out[2] = 0x51;
+        out[3] = 0x03;
+        out[4] = (uint8_t)(MIDI_TEMPO_US >> 16);
+        out[5] = (uint8_t)(MIDI_TEMPO_US >> 8);
+        out[6] = (uint8_t)MIDI_TEMPO_US;
+        length = 7;
+        midi_export_phase = MIDI_PHASE_NOTES;
+        break;
+
+      case MIDI_PHASE_NOTES: {
+        unsigned long start_ms;
+        unsigned long duration_ms;
+        uint8_t note_index;
+        if (nextMidiTrackNote(&start_ms, &note_index, &duration_ms)) {
+          length = encodeMidiNote(out, start_ms, note_index, duration_ms);
+        } else {
+          midi_export_phase = MIDI_PHASE_TRACK_END;
+        }
+        break;
+      }
+
+      case MIDI_PHASE_TRACK_END:
+        out[0] = 0x00;
+        out[1] = 0xFF;
+        out[2] = 0x2F;
+        out[3] = 0x00;
+        length = 4;
+        midi_export_first_track = false;
+        midi_export_phase = MIDI_PHASE_TRACK_HEADER;
+        break;
+
+      default:
+        return false;
+    }
+  }
+
+  midi_export_chunk_length = length;
+  midi_export_chunk_pos = 0;
+  return true;
+}
+
+// ============================================
+// PUBLIC FUNCTIONS
+// ============================================
+
+/**
+ * Start a Standard MIDI File export
+ * @param slot_num Slot to export, or -1 for all slots merged
+ * @param strategy Overlap strategy for a merged export (Polyphonic: one
+ *                 track per slot)
+ * @return false if there is nothing to export or the export would clash
+ *         with recording or streamed playback
+ */
+bool beginMidiExport(int slot_num, OverlapStrategy strategy) {
+  if (midi_export_active || isRecording()) {
+    return false;
+  }
+
+  if (slot_num >= 0) {
+    if (!isSlotActive(slot_num)) {
+      return false;
+    }
+    midi_export_slots = 1 << slot_num;
+    midi_export_merged = false;
+  } else {
+    int slots[NUM_RECORDING_SLOTS];
+    int num_slots = getActiveSlots(slots);
+    if (num_slots == 0) {
+      return false;
+    }
+    midi_export_slots = 0;
+    for (int i = 0; i < num_slots; i++) {
+      midi_export_slots |= 1 << slots[i];
+    }
+    // The merge shares its cursors with PS playback
+    midi_export_merged = strategy != OVERLAP_POLYPHONIC;
+    if (midi_export_merged && isPlaying()) {
+      return false;
+    }
+  }
+
+  for (int i = 0; i < NUM_RECORDING_SLOTS; i++) {
+    midi_export_revisions[i] = recording_slots[i].revision;
+  }
+  midi_export_strategy = strategy;
+  midi_export_tracks_left = midi_export_merged ? 0 : midi_export_slots;
+  midi_export_slot = -1;
+  midi_export_first_track = true;
+  midi_export_phase = MIDI_PHASE_FILE_HEADER;
+  midi_export_chunk_length = 0;
+  midi_export_chunk_pos = 0;
+  midi_export_offset = 0;
+  midi_export_active = true;
+  return true;
+}
+
+/**
+ * Read the next bytes of the export
+ * @param out Output buffer
+ * @param max_bytes Buffer size
+ * @return Bytes read; 0 when the file is complete
+ */
+uint8_t readMidiExport(uint8_t* out, uint8_t max_bytes) {
+  uint8_t count = 0;
+  while (count < max_bytes && midi_export_active) {
+    if (midi_export_chunk_pos == midi_export_chunk_length && !fillMidiExportChunk()) {
+      break;
+    }
+    while (count < max_bytes && midi_export_chunk_pos < midi_export_chunk_length) {
+      out[count++] = midi_export_chunk[midi_export_chunk_pos++];
+    }
+  }
+  midi_export_offset += count;
+  return count;
+}
+
+/**
+ * Check that the exported slots have not changed since the export began
+ */
+bool isMidiExportValid() {
+  for (int i = 0; i < NUM_RECORDING_SLOTS; i++) {
+    if ((midi_export_slots & (1 << i)) && recording_slots[i].revision != midi_export_revisions[i]) {
+      return false;
+    }
+  }
+  return !(midi_export_merged && isPlaying()) && !isRecording();
+}
+
+/**
+ * End the export
+ */
+void endMidiExport() {
+  midi_export_active = false;
+}
+
+/**
+ * Release the note held on the synth (no-op if none)
+ */
+void sendMidiLiveNoteOff() {
+  if (!midi_live_enabled || midi_live_note < 0) {
+    return;
+  }
+  Serial.write(MIDI_NOTE_ON | (MIDI_CHANNEL - 1));
+  Serial.write(getNoteMidiNumber(midi_live_note));
+  Serial.write((uint8_t)0);
+  midi_live_note = -1;
+}
+
+/**
+ * Start a note on the synth, releasing the previous one
+ */
+void sendMidiLiveNoteOn(int note_index) {
+  if (!midi_live_enabled) {
+    return;
+  }
+  sendMidiLiveNoteOff();
+  Serial.write(MIDI_NOTE_ON | (MIDI_CHANNEL - 1));
+  Serial.write(getNoteMidiNumber(note_index));
+  Serial.write((uint8_t)MIDI_VELOCITY);
+  midi_live_note = note_index;
+}
+
+/**
+ * Turn live MIDI output on or off
+ */
+void setMidiLive(bool enabled) {
+  if (!enabled) {
+    sendMidiLiveNoteOff();
+  }
+  midi_live_enabled = enabled;
+}
+
+/**
+ * Check whether live MIDI output is on
+ */
+bool isMidiLive() {
+  return midi_live_enabled;
+}
+
+#endif // MIDI_H
@@ -1,78 +1,376 @@
 #ifndef NOTE_MAPPING_H
 #define NOTE_MAPPING_H
 
+#include "hal.h"
 #include "config.h"
 
 // ============================================
 // MUSICAL NOTE DEFINITIONS
 // ============================================
 
-// Number of notes supported
-#define NUM_NOTES 8
-
-// Note frequencies (8 notes: Do Re Mi Fa Sol La Si Do)
-const int note_frequencies[NUM_NOTES] = {
-  523,  // Do (C5)
-  587,  // Re (D5)
-  659,  // Mi (E5)
-  698,  // Fa (F5)
-  784,  // Sol (G5)
-  880,  // La (A5)
-  988,  // Si (B5)
-  1046  // Do (C6)
+// A note is a pitch: semitones above C4 (MIDI NOTE_BASE_MIDI), up to B6.
+// Notes do not depend on the selected scale, so recordings keep their
+// sound when the scale or key changes. The scale only decides which note
+// each distance zone plays (see SCALES below).
+#define NUM_NOTES 36
+#define NOTE_BASE_MIDI 60
+
+// Tonic octaves: one-octave scales start at C5 + key, wider ones at C4 + key
+#define NOTE_C4 0
+#define NOTE_C5 12
+
+// Note LEDs: Do Re Mi Fa Sol La Si Do
+#define NUM_NOTE_LEDS 8
+
+// Notes are generated per octave from this list of pitch classes:
+//   X(arg, pitch class, solfege name, letter name, white-key LED)
+// A sharp shares the LED of the natural below it.
+#define PITCH_CLASS_LIST(X, arg) \
+  X(arg,  0, "Do",   "C",  0) \
+  X(arg,  1, "Do#",  "C#", 0) \
+  X(arg,  2, "Re",   "D",  1) \
+  X(arg,  3, "Re#",  "D#", 1) \
+  X(arg,  4, "Mi",   "E",  2) \
+  X(arg,  5, "Fa",   "F",  3) \
+  X(arg,  6, "Fa#",  "F#", 3) \
+  X(arg,  7, "Sol",  "G",  4) \
+  X(arg,  8, "Sol#", "G#", 4) \
+  X(arg,  9, "La",   "A",  5) \
+  X(arg, 10, "La#",  "A#", 5) \
+  X(arg, 11, "Si",   "B",  6)
+
+// Expand a pitch class column for the three octaves of notes (4, 5, 6)
+#define NOTE_OCTAVES(X) PITCH_CLASS_LIST(X, 4) PITCH_CLASS_LIST(X, 5) PITCH_CLASS_LIST(X, 6)
+
+// Note number of a pitch class in an octave
+#define NOTE_NUMBER(octave, pitch_class) (((octave) - 4) * 12 + (pitch_class))
+
+// Equal temperament around A4 = 440 Hz
+#define NOTE_A4 9
+#define SEMITONE_RATIO 1.0594630943592953
+
+/**
+ * Get the exact frequency of a note (compile time)
+ */
+constexpr double noteFrequencyExact(int note) {
+  return note < NOTE_A4 ? noteFrequencyExact(note + 1) / SEMITONE_RATIO
+       : note > NOTE_A4 ? noteFrequencyExact(note - 1) * SEMITONE_RATIO
+       : 440.0;
+}
+
+/**
+ * Get the LED of a note (compile time)
+ * C5 to C6 light the eight LEDs in order; other octaves fold onto Re-Do so
+ * every Do lights a Do LED.
+ */
+constexpr uint8_t noteLEDIndex(int octave, int white_key) {
+  return (octave - 5) * 7 + white_key >= 0 && (octave - 5) * 7 + white_key < NUM_NOTE_LEDS
+       ? (octave - 5) * 7 + white_key
+       : ((octave - 5) * 7 + white_key + 14) % 7;
+}
+
+// Column extractors for NOTE_OCTAVES
+#define NOTE_FREQUENCY(octave, pitch_class, solfege, letter, white_key) \
+  (uint16_t)(noteFrequencyExact(NOTE_NUMBER(octave, pitch_class)) + 0.5),
+#define NOTE_LED(octave, pitch_class, solfege, letter, white_key) noteLEDIndex(octave, white_key),
+#define NOTE_NAME_STRINGS(octave, pitch_class, solfege, letter, white_key) \
+  const char note_name_##octave##_##pitch_class[] PROGMEM = solfege " (" letter #octave ")";
+#define NOTE_NAME_POINTER(octave, pitch_class, solfege, letter, white_key) \
+  note_name_##octave##_##pitch_class,
+#define NOTE_NAME_BYTES(octave, pitch_class, solfege, letter, white_key) \
+  + sizeof(solfege " (" letter #octave ")")
+#define PITCH_CLASS_NAME_STRINGS(arg, pitch_class, solfege, letter, white_key) \
+  const char pitch_class_name_##pitch_class[] PROGMEM = solfege;
+#define PITCH_CLASS_NAME_POINTER(arg, pitch_class, solfege, letter, white_key) \
+  pitch_class_name_##pitch_class,
+#define PITCH_CLASS_NAME_BYTES(arg, pitch_class, solfege, letter, white_key) + sizeof(solfege)
+
+// ============================================
+// NOTE TABLES (FLASH)
+// ============================================
+
+// Plain const tables are copied into SRAM at boot on AVR; these stay in
+// flash and are only read through the accessors below.
+
+// Note frequencies (Hz)
+const uint16_t note_frequencies[NUM_NOTES] PROGMEM = { NOTE_OCTAVES(NOTE_FREQUENCY) };
+
+// LED (0 to NUM_NOTE_LEDS - 1) of each note
+const uint8_t note_leds[NUM_NOTES] PROGMEM = { NOTE_OCTAVES(NOTE_LED) };
+
+// Pin of each LED (config.h)
+const uint8_t note_led_pins[NUM_NOTE_LEDS] PROGMEM = {
+  LED_Do, LED_Re, LED_Mi, LED_Fa, LED_Sol, LED_La, LED_Si, LED_Do_High
 };
 
-// Note names for display
-const char* note_names[NUM_NOTES] = {
-  "Do (C5)",
-  "Re (D5)",
-  "Mi (E5)",
-  "Fa (F5)",
-  "Sol (G5)",
-  "La (A5)",
-  "Si (B5)",
-  "Do (C6)"
+// Note names for display ("Do (C5)"): one flash string each, then a flash
+// table of pointers to them; short names ("Do") per pitch class
+NOTE_OCTAVES(NOTE_NAME_STRINGS)
+PITCH_CLASS_LIST(PITCH_CLASS_NAME_STRINGS, 0)
+
+const char* const note_names[NUM_NOTES] PROGMEM = { NOTE_OCTAVES(NOTE_NAME_POINTER) };
+const char* const pitch_class_names[12] PROGMEM = {
+  PITCH_CLASS_LIST(PITCH_CLASS_NAME_POINTER, 0)
 };
 
-// Short note names
-const char* note_names_short[NUM_NOTES] = {
-  "Do", "Re", "Mi", "Fa", "Sol", "La", "Si", "Do*"
+static_assert(sizeof(note_frequencies) / sizeof(note_frequencies[0]) == NUM_NOTES,
+              "NOTE_OCTAVES must produce NUM_NOTES notes");
+
+// ============================================
+// SCALES
+// ============================================
+
+// Each scale lists the semitones above its tonic of the notes it spreads
+// over the distance zones, low to high:
+//   X(id, name, tonic octave, steps...)
+// The tonic is the tonic octave's C plus the key (0-11 semitones).
+#define SCALE_LIST(X) \
+  X(MAJOR,       "Major",              NOTE_C5, 0, 2, 4, 5, 7, 9, 11, 12) \
+  X(MINOR,       "Minor",              NOTE_C5, 0, 2, 3, 5, 7, 8, 10, 12) \
+  X(PENTATONIC,  "Pentatonic",         NOTE_C5, 0, 2, 4, 7, 9, 12) \
+  X(CHROMATIC,   "Chromatic",          NOTE_C5, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12) \
+  X(TWO_OCTAVES, "Major, two octaves", NOTE_C4, 0, 2, 4, 5, 7, 9, 11, 12, 14, 16, 17, 19, 21, 23, 24)
+
+// Most notes in a scale (distance zones)
+#define MAX_SCALE_NOTES 15
+
+#define SCALE_ENUM(id, name, tonic, ...) SCALE_##id,
+
+enum Scale {
+  SCALE_LIST(SCALE_ENUM)
+  NUM_SCALES
 };
 
+/**
+ * Get the last of a list of steps (compile time)
+ */
+constexpr int lastScaleStep(int step) {
+  return step;
+}
+template <typename... Steps>
+constexpr int lastScaleStep(int, Steps... steps) {
+  return lastScaleStep(steps...);
+}
+
+// Per scale: the steps, the name and compile-time range checks
+#define SCALE_TABLES(id, name, tonic, ...) \
+  const uint8_t scale_steps_##id[] PROGMEM = { __VA_ARGS__ }; \
+  const char scale_name_##id[] PROGMEM = name; \
+  static_assert(sizeof(scale_steps_##id) >= 2 && sizeof(scale_steps_##id) <= MAX_SCALE_NOTES, \
+                "Scale " #id " must have 2 to MAX_SCALE_NOTES notes"); \
+  static_assert((tonic) + 11 + lastScaleStep(__VA_ARGS__) < NUM_NOTES, \
+                "Scale " #id " must fit the notes in every key");
+SCALE_LIST(SCALE_TABLES)
+#undef SCALE_TABLES
+
+#define SCALE_STEPS_POINTER(id, name, tonic, ...) scale_steps_##id,
+#define SCALE_NAME_POINTER(id, name, tonic, ...) scale_name_##id,
+#define SCALE_NOTE_COUNT(id, name, tonic, ...) sizeof(scale_steps_##id),
+#define SCALE_TONIC(id, name, tonic, ...) tonic,
+
+const uint8_t* const scale_steps[NUM_SCALES] PROGMEM = { SCALE_LIST(SCALE_STEPS_POINTER) };
+const char* const scale_names[NUM_SCALES] PROGMEM = { SCALE_LIST(SCALE_NAME_POINTER) };
+const uint8_t scale_note_counts[NUM_SCALES] PROGMEM = { SCALE_LIST(SCALE_NOTE_COUNT) };
+const uint8_t scale_tonics[NUM_SCALES] PROGMEM = { SCALE_LIST(SCALE_TONIC) };
+
 // ============================================
 // DISTANCE TO NOTE MAPPING
 // ============================================
 
-// Distance ranges for each note (in cm)
+// Echo round-trip time per centimeter of distance (us)
+#define ECHO_US_PER_CM 58
+
+// Convert a whole-centimeter distance to an echo pulse width at compile time
+#define CM_TO_ECHO_US(cm) ((uint16_t)((cm) * ECHO_US_PER_CM))
+
+// Distance range of a zone (in cm), used for display and calibration
 struct DistanceRange {
   float min_cm;
   float max_cm;
 };
 
-const DistanceRange distance_ranges[NUM_NOTES] = {
-  {2.0,  10.0},   // Do (C5)
-  {10.0, 20.0},   // Re (D5)
-  {20.0, 30.0},   // Mi (E5)
-  {30.0, 40.0},   // Fa (F5)
-  {40.0, 50.0},   // Sol (G5)
-  {50.0, 60.0},   // La (A5)
-  {60.0, 70.0},   // Si (B5)
-  {70.0, 80.0}    // Do (C6)
+// Zones of a scale with n notes: the first covers NOTE_ZONE_MIN_CM to
+// NOTE_ZONE_FIRST_CM, the other n - 1 share the rest of the range up to
+// NOTE_ZONE_MAX_CM equally (8 notes: 2, 10, 20, ..., 80 cm)
+#define NOTE_ZONE_MIN_US CM_TO_ECHO_US(NOTE_ZONE_MIN_CM)
+#define NOTE_ZONE_FIRST_US CM_TO_ECHO_US(NOTE_ZONE_FIRST_CM)
+#define NOTE_ZONE_MAX_US CM_TO_ECHO_US(NOTE_ZONE_MAX_CM)
+
+/**
+ * Get zone edge i of a scale with n notes as an echo pulse width (compile
+ * time); edges past the last zone repeat the top edge
+ */
+constexpr uint16_t zoneBoundUs(int n, int i) {
+  return i == 0 ? NOTE_ZONE_MIN_US
+       : i >= n ? NOTE_ZONE_MAX_US
+       : NOTE_ZONE_FIRST_US + (uint16_t)((uint32_t)(NOTE_ZONE_MAX_US - NOTE_ZONE_FIRST_US) * (i - 1) / (n - 1));
+}
+
+#define ZONE_BOUNDS_ROW(n) { \
+  zoneBoundUs(n, 0),  zoneBoundUs(n, 1),  zoneBoundUs(n, 2),  zoneBoundUs(n, 3), \
+  zoneBoundUs(n, 4),  zoneBoundUs(n, 5),  zoneBoundUs(n, 6),  zoneBoundUs(n, 7), \
+  zoneBoundUs(n, 8),  zoneBoundUs(n, 9),  zoneBoundUs(n, 10), zoneBoundUs(n, 11), \
+  zoneBoundUs(n, 12), zoneBoundUs(n, 13), zoneBoundUs(n, 14), zoneBoundUs(n, 15) },
+#define SCALE_PULSE_BOUNDS(id, name, tonic, ...) ZONE_BOUNDS_ROW(sizeof(scale_steps_##id))
+
+static_assert(MAX_SCALE_NOTES + 1 == 16, "ZONE_BOUNDS_ROW lists MAX_SCALE_NOTES + 1 edges");
+
+// Zone edges of every scale as echo pulse widths (us), computed at compile
+// time: zone i covers widths in (bounds[i], bounds[i + 1]]
+const uint16_t scale_pulse_bounds_us[NUM_SCALES][MAX_SCALE_NOTES + 1] PROGMEM = {
+  SCALE_LIST(SCALE_PULSE_BOUNDS)
 };
 
+// Bytes the note and scale tables keep out of SRAM
+#define NOTE_TABLES_FLASH_BYTES (0 NOTE_OCTAVES(NOTE_NAME_BYTES) + \
+  0 PITCH_CLASS_LIST(PITCH_CLASS_NAME_BYTES, 0) + \
+  sizeof(note_names) + sizeof(pitch_class_names) + sizeof(note_frequencies) + \
+  sizeof(note_leds) + sizeof(note_led_pins) + sizeof(scale_steps) + sizeof(scale_names) + \
+  sizeof(scale_note_counts) + sizeof(scale_tonics) + sizeof(scale_pulse_bounds_us))
+
+// ============================================
+// SCALE STATE
+// ============================================
+
+// Selected scale and key; setScale() copies what note time needs into RAM
+uint8_t current_scale = DEFAULT_SCALE;
+uint8_t current_key = DEFAULT_KEY;
+uint8_t scale_zone_count = 0;
+uint8_t scale_zone_notes[MAX_SCALE_NOTES];       // Note of each zone
+const uint16_t* scale_zone_bounds = NULL;        // Zone edges (flash row)
+
+// ============================================
+// SCALE FUNCTIONS
+// ============================================
+
+/**
+ * Select the scale and key the distance zones play
+ * @param scale Scale (SCALE_*)
+ * @param key Key: semitones above C (0-11)
+ * @return false if either is out of range
+ */
+bool setScale(uint8_t scale, uint8_t key) {
+  if (scale >= NUM_SCALES || key >= 12) {
+    return false;
+  }
+
+  const uint8_t* steps = (const uint8_t*)pgm_read_ptr(&scale_steps[scale]);
+  uint8_t tonic = pgm_read_byte(&scale_tonics[scale]) + key;
+
+  scale_zone_count = pgm_read_byte(&scale_note_counts[scale]);
+  for (uint8_t z = 0; z < scale_zone_count; z++) {
+    scale_zone_notes[z] = tonic + pgm_read_byte(&steps[z]);
+  }
+  scale_zone_bounds = scale_pulse_bounds_us[scale];
+  current_scale = scale;
+  current_key = key;
+  return true;
+}
+
+/**
+ * Get the selected scale
+ */
+uint8_t getScale() {
+  return current_scale;
+}
+
+/**
+ * Get the selected key
+ * @return Semitones above C (0-11)
+ */
+uint8_t getKey() {
+  return current_key;
+}
+
+/**
+ * Get the name of a scale
+ * @return Name in flash
+ */
+const __FlashStringHelper* getScaleName(uint8_t scale) {
+  if (scale < NUM_SCALES) {
+    return (const __FlashStringHelper*)pgm_read_ptr(&scale_names[scale]);
+  }
+  return F("---");
+}
+
+/**
+ * Get the number of distance zones of the selected scale
+ */
+uint8_t getZoneCount() {
+  return scale_zone_count;
+}
+
+/**
+ * Get the note a distance zone plays in the selected scale and key
+ * @param zone Zone (0 to getZoneCount() - 1)
+ * @return Note, or -1 if invalid
+ */
+int getZoneNote(int zone) {
+  if (zone >= 0 && zone < scale_zone_count) {
+    return scale_zone_notes[zone];
+  }
+  return -1;
+}
+
 // ============================================
 // NOTE MAPPING FUNCTIONS
 // ============================================
 
 /**
- * Get note index from distance measurement
+ * Get an edge of the selected scale's zones as an echo pulse width
+ * @param edge Edge index (0 to getZoneCount()): zone i lies between edges i and i + 1
+ * @return Pulse width in microseconds
+ */
+uint16_t getZonePulseBound(int edge) {
+  return pgm_read_word(&scale_zone_bounds[edge]);
+}
+
+/**
+ * Check if an echo pulse width falls inside the playable range
+ * @param width_us Echo pulse width in microseconds
+ * @return true if some zone contains the width
+ */
+bool isEchoInRange(uint16_t width_us) {
+  return width_us > NOTE_ZONE_MIN_US && width_us <= NOTE_ZONE_MAX_US;
+}
+
+/**
+ * Get zone straight from an echo pulse width
+ * Integer binary search over the selected scale's edges (no float, no division).
+ * @param width_us Echo pulse width in microseconds
+ * @return Zone or -1 if out of range
+ */
+int getZoneFromPulseWidth(uint16_t width_us) {
+  if (!isEchoInRange(width_us)) {
+    return -1;  // Out of range
+  }
+
+  // Find the first zone whose upper bound is >= width_us
+  int low = 0;
+  int high = scale_zone_count - 1;
+  while (low < high) {
+    int mid = (low + high) / 2;
+    if (width_us > getZonePulseBound(mid + 1)) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  return low;
+}
+
+/**
+ * Get zone from distance measurement
+ * Float path, kept for display and calibration; note detection uses
+ * getZoneFromPulseWidth().
  * @param distance_cm Distance in centimeters
- * @return Note index (0-7) or -1 if out of range
+ * @return Zone or -1 if out of range
  */
-int getNoteFromDistance(float distance_cm) {
-  for (int i = 0; i < NUM_NOTES; i++) {
-    if (distance_cm > distance_ranges[i].min_cm &&
-        distance_cm <= distance_ranges[i].max_cm) {
+int getZoneFromDistance(float distance_cm) {
+  for (int i = 0; i < scale_zone_count; i++) {
+    if (distance_cm > getZonePulseBound(i) / (float)ECHO_US_PER_CM &&
+        distance_cm <= getZonePulseBound(i + 1) / (float)ECHO_US_PER_CM) {
       return i;
     }
   }
@@ -80,42 +378,87 @@ int getNoteFromDistance(float distance_cm) {
 }
 
 /**
- * Get frequency for a note index
- * @param note_index Note index (0-7)
+ * Get the distance range of a zone
+ * @param zone Zone (0 to getZoneCount() - 1)
+ * @return Range in centimeters (0 to 0 if invalid)
+ */
+DistanceRange getZoneDistanceRange(int zone) {
+  DistanceRange range = {0.0, 0.0};
+  if (zone >= 0 && zone < scale_zone_count) {
+    range.min_cm = getZonePulseBound(zone) / (float)ECHO_US_PER_CM;
+    range.max_cm = getZonePulseBound(zone + 1) / (float)ECHO_US_PER_CM;
+  }
+  return range;
+}
+
+/**
+ * Get frequency for a note
+ * @param note_index Note (0 to NUM_NOTES - 1)
  * @return Frequency in Hz, or 0 if invalid
  */
 int getNoteFrequency(int note_index) {
   if (note_index >= 0 && note_index < NUM_NOTES) {
-    return note_frequencies[note_index];
+    return pgm_read_word(&note_frequencies[note_index]);
   }
   return 0;
 }
 
 /**
- * Get LED pin for a note index
- * @param note_index Note index (0-7)
+ * Get the LED of a note
+ * @param note_index Note (0 to NUM_NOTES - 1)
+ * @return LED (0 to NUM_NOTE_LEDS - 1), or -1 if invalid
+ */
+int getNoteLEDIndex(int note_index) {
+  if (note_index >= 0 && note_index < NUM_NOTES) {
+    return pgm_read_byte(&note_leds[note_index]);
+  }
+  return -1;
+}
+
+/**
+ * Get the pin of an LED
+ * @param led LED (0 to NUM_NOTE_LEDS - 1)
+ * @return LED pin number
+ */
+int getLEDPin(int led) {
+  return pgm_read_byte(&note_led_pins[led]);
+}
+
+/**
+ * Get LED pin for a note
+ * @param note_index Note (0 to NUM_NOTES - 1)
  * @return LED pin number
  */
 int getNoteLED(int note_index) {
-  if (note_index == 7) {
-    return LED_Do_High;  // Special case for high Do
-  } else if (note_index >= 0 && note_index < 7) {
-    return LED_Do - note_index;
+  int led = getNoteLEDIndex(note_index);
+  if (led >= 0) {
+    return getLEDPin(led);
   }
   return -1;  // Invalid
 }
 
 /**
  * Get note name for display
- * @param note_index Note index (0-7)
- * @param short_form Use short name (true) or long name (false)
- * @return Note name string
+ * @param note_index Note (0 to NUM_NOTES - 1)
+ * @param short_form Use short name ("Do#") or long name ("Do# (C#5)")
+ * @return Note name in flash (print it like an F() string)
  */
-const char* getNoteName(int note_index, bool short_form = false) {
+const __FlashStringHelper* getNoteName(int note_index, bool short_form = false) {
   if (note_index >= 0 && note_index < NUM_NOTES) {
-    return short_form ? note_names_short[note_index] : note_names[note_index];
+    const char* const* entry = short_form ? &pitch_class_names[note_index % 12]
+                                          : &note_names[note_index];
+    return (const __FlashStringHelper*)pgm_read_ptr(entry);
   }
-  return "---";
+  return F("---");
+}
+
+/**
+ * Get the MIDI note number of a note
+ * @param note_index Note (0 to NUM_NOTES - 1)
+ * @return MIDI note number (C5 = 72)
+ */
+uint8_t getNoteMidiNumber(int note_index) {
+  return NOTE_BASE_MIDI + note_index;
 }
 
 #endif // NOTE_MAPPING_H
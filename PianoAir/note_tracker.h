@@ -0,0 +1,102 @@
+#ifndef NOTE_TRACKER_H
+#define NOTE_TRACKER_H
+
+#include "hal.h"
+#include "config.h"
+#include "note_mapping.h"
+
+// ============================================
+// NOTE TRACKER STATE
+// ============================================
+
+/**
+ * Events produced by the note tracker for each filtered sample
+ */
+enum TrackerEvent {
+  TRACKER_NONE = 0,       // Nothing to do (no hand, or hand briefly lost)
+  TRACKER_NOTE_ON = 1,    // A new note started (hand arrived or moved zone)
+  TRACKER_NOTE_HOLD = 2,  // The current note is still held
+  TRACKER_NOTE_OFF = 3    // The hand was removed
+};
+
+// Hysteresis band in echo pulse width
+#define NOTE_HYSTERESIS_US CM_TO_ECHO_US(NOTE_HYSTERESIS_CM)
+
+// Zone currently held and the note it started (-1 if no hand)
+int tracked_zone = -1;
+int tracked_note = -1;
+
+// Out-of-range samples seen in a row while a note is held
+uint8_t tracker_miss_count = 0;
+
+// ============================================
+// NOTE TRACKER FUNCTIONS
+// ============================================
+
+/**
+ * Reset the tracker to the no-hand state
+ */
+void resetNoteTracker() {
+  tracked_zone = -1;
+  tracked_note = -1;
+  tracker_miss_count = 0;
+}
+
+/**
+ * Check if a width is still inside the held note's zone widened by the
+ * hysteresis band on each boundary
+ */
+bool isWithinTrackedZone(uint16_t width_us) {
+  uint16_t low = getZonePulseBound(tracked_zone);
+  uint16_t high = getZonePulseBound(tracked_zone + 1);
+
+  low = low > NOTE_HYSTERESIS_US ? low - NOTE_HYSTERESIS_US : 0;
+  high = high + NOTE_HYSTERESIS_US;
+
+  return width_us > low && width_us <= high;
+}
+
+/**
+ * Feed one filtered echo width into the tracker
+ * @param width_us Filtered echo width (ECHO_WIDTH_NONE or out of range = no hand)
+ * @param out_note Output: note the event refers to (released note for NOTE_OFF)
+ * @return Tracker event
+ */
+TrackerEvent updateNoteTracker(uint16_t width_us, int* out_note) {
+  *out_note = tracked_note;
+
+  if (!isEchoInRange(width_us)) {
+    if (tracked_note == -1) {
+      return TRACKER_NONE;
+    }
+
+    // Release only after several misses in a row
+    tracker_miss_count++;
+    if (tracker_miss_count >= NOTE_RELEASE_SAMPLES) {
+      resetNoteTracker();
+      return TRACKER_NOTE_OFF;
+    }
+    return TRACKER_NONE;
+  }
+
+  tracker_miss_count = 0;
+
+  if (tracked_note != -1 && isWithinTrackedZone(width_us)) {
+    return TRACKER_NOTE_HOLD;
+  }
+
+  tracked_zone = getZoneFromPulseWidth(width_us);
+  tracked_note = getZoneNote(tracked_zone);
+  *out_note = tracked_note;
+  return TRACKER_NOTE_ON;
+}
+
+/**
+ * Get the note currently held
+ * @return Note index, or -1 if no hand
+ */
+int getTrackedNote() {
+  return tracked_note;
+}
+
+#endif // NOTE_TRACKER_H
@@ -0,0 +1,390 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include "hal.h"
+#include "config.h"
+
+// ============================================
+// DEFERRED SERIAL OUTPUT
+// ============================================
+
+// Serial.print() blocks once the 64-byte TX buffer is full: printing the
+// menu (~900 bytes) used to stall loop() for ~80 ms at 115200 baud. Text is
+// now queued as print items instead (a flash string pointer, a number, a
+// RAM string that stays valid) and loop() moves at most
+// OUTPUT_BYTES_PER_UPDATE bytes per call into the TX buffer, never more
+// than it has room for, after the sensor and playback work is done.
+//
+// Two queues share the port: status_out (command replies, errors) is sent
+// before text_out (menu, listings, diagnostics), switching only at line
+// ends so lines are never mixed. If a queue is full, the oldest items are
+// written out first, blocking as before (counted in output_overflows).
+// While output is paused (live MIDI), a full queue drops its oldest item.
+//
+// Listings longer than a few lines (L, D, T, F) are not queued all at
+// once. Like the protocol dumps, they are produced from loop(): a producer
+// writes one section of at most OUTPUT_SECTION_ITEMS items whenever the
+// text queue has room for two sections, so a reply never fills the queue
+// and the queue only has to hold two sections.
+
+// Item kinds (low 3 bits); OUTPUT_NEWLINE adds "\r\n" after the item
+#define OUTPUT_FLASH 0          // F() string
+#define OUTPUT_TEXT 1           // RAM string (must outlive the queue, e.g. note names)
+#define OUTPUT_CHAR 2
+#define OUTPUT_LONG 3
+#define OUTPUT_ULONG 4
+#define OUTPUT_FLOAT 5          // Decimals in the high bits
+#define OUTPUT_EMPTY 6          // Nothing (println())
+#define OUTPUT_KIND_MASK 0x07
+#define OUTPUT_NEWLINE 0x08
+#define OUTPUT_DIGITS_SHIFT 4
+
+// Longest rendered number: "-2147483648" or a float with its decimals
+#define OUTPUT_SCRATCH_SIZE 16
+
+/**
+ * Writes section `section` of a listing to text_out
+ * @return false if that was the last section
+ */
+typedef bool (*OutputProducer)(uint8_t section);
+
+/**
+ * One queued print item
+ */
+struct OutputItem {
+  uint8_t kind;                          // OUTPUT_* kind and flags
+  union {
+    const __FlashStringHelper* flash;
+    const char* text;
+    char c;
+    long number;
+    unsigned long unumber;
+    float real;
+  } value;
+};
+
+/**
+ * Ring of print items of one priority
+ */
+struct OutputRing {
+  OutputItem* items;
+  uint8_t size;
+  uint8_t head;                          // Next item to send
+  uint8_t count;                         // Items queued
+};
+
+// ============================================
+// OUTPUT STATE
+// ============================================
+
+OutputItem status_items[OUTPUT_STATUS_ITEMS];
+OutputItem text_items[OUTPUT_TEXT_ITEMS];
+
+// In send order: status before text
+OutputRing output_rings[2] = {
+  { status_items, OUTPUT_STATUS_ITEMS, 0, 0 },
+  { text_items, OUTPUT_TEXT_ITEMS, 0, 0 }
+};
+
+// Item being sent
+bool output_sending = false;
+uint8_t output_ring = 0;                 // Ring the item came from
+bool output_line_open = false;           // Last item of output_ring did not end a line
+OutputItem output_item;
+uint16_t output_offset = 0;              // Next byte of the item
+uint8_t output_line_end = 0;             // Line end bytes sent
+char output_scratch[OUTPUT_SCRATCH_SIZE];
+uint8_t output_scratch_length = 0;
+
+// Times a full queue had to be written out blocking (or dropped an item
+// while paused)
+unsigned long output_overflows = 0;
+
+// Hold queued text back (the port carries live MIDI)
+bool output_paused = false;
+
+// Listing being produced, and its next section
+OutputProducer output_producer = NULL;
+uint8_t output_section = 0;
+
+// ============================================
+// RENDERING
+// ============================================
+
+/**
+ * Print target that renders a number into output_scratch
+ */
+class OutputScratch : public Print {
+ public:
+  size_t write(uint8_t c) {
+    if (output_scratch_length >= OUTPUT_SCRATCH_SIZE) {
+      return 0;
+    }
+    output_scratch[output_scratch_length++] = c;
+    return 1;
+  }
+  using Print::write;
+};
+
+/**
+ * Prepare an item for sending (numbers are formatted by Print, as before)
+ */
+void startOutputItem(const OutputItem* item) {
+  output_item = *item;
+  output_offset = 0;
+  output_line_end = 0;
+  output_scratch_length = 0;
+
+  OutputScratch scratch;
+  switch (item->kind & OUTPUT_KIND_MASK) {
+    case OUTPUT_CHAR:
+      scratch.print(item->value.c);
+      break;
+    case OUTPUT_LONG:
+      scratch.print(item->value.number);
+      break;
+    case OUTPUT_ULONG:
+      scratch.print(item->value.unumber);
+      break;
+    case OUTPUT_FLOAT:
+      scratch.print((double)item->value.real, item->kind >> OUTPUT_DIGITS_SHIFT);
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * Get the next byte of the item being sent
+ * @param out Output: byte to send
+ * @return false when the item is complete
+ */
+bool nextOutputByte(char* out) {
+  uint8_t kind = output_item.kind & OUTPUT_KIND_MASK;
+  char c = '\0';
+
+  if (kind == OUTPUT_FLASH) {
+    c = pgm_read_byte((const char*)output_item.value.flash + output_offset);
+  } else if (kind == OUTPUT_TEXT) {
+    c = output_item.value.text[output_offset];
+  } else if (output_offset < output_scratch_length) {
+    c = output_scratch[output_offset];
+  }
+
+  if (c != '\0') {
+    output_offset++;
+    *out = c;
+    return true;
+  }
+
+  // Body done: "\r\n" if the item ends a line
+  if ((output_item.kind & OUTPUT_NEWLINE) && output_line_end < 2) {
+    *out = output_line_end++ == 0 ? '\r' : '\n';
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Pick the next queued item
+ * @return false if both queues are empty
+ */
+bool takeOutputItem() {
+  // Finish a started line before switching queues
+  int ring_num = -1;
+  if (output_line_open && output_rings[output_ring].count > 0) {
+    ring_num = output_ring;
+  } else {
+    for (int r = 0; r < 2; r++) {
+      if (output_rings[r].count > 0) {
+        ring_num = r;
+        break;
+      }
+    }
+  }
+  if (ring_num == -1) {
+    return false;
+  }
+
+  OutputRing* ring = &output_rings[ring_num];
+  const OutputItem* item = &ring->items[ring->head];
+  output_ring = ring_num;
+  output_line_open = (item->kind & OUTPUT_NEWLINE) == 0;
+  startOutputItem(item);
+  ring->head = (ring->head + 1) % ring->size;
+  ring->count--;
+  output_sending = true;
+  return true;
+}
+
+/**
+ * Move queued bytes into the TX buffer
+ * @param max_bytes Most bytes to write
+ * @param block Wait for TX buffer room (queue overflow only)
+ */
+void drainOutput(uint8_t max_bytes, bool block) {
+  while (max_bytes > 0) {
+    if (!block && Serial.availableForWrite() <= 0) {
+      return;
+    }
+    if (!output_sending && !takeOutputItem()) {
+      return;
+    }
+
+    char c;
+    if (nextOutputByte(&c)) {
+      Serial.write((uint8_t)c);
+      max_bytes--;
+    } else {
+      output_sending = false;
+    }
+  }
+}
+
+/**
+ * Make room for one item, writing out old items if the queue is full
+ */
+void reserveOutputItem(uint8_t priority) {
+  OutputRing* ring = &output_rings[priority];
+  if (ring->count == ring->size) {
+    output_overflows++;
+    if (output_paused) {
+      ring->head = (ring->head + 1) % ring->size;
+      ring->count--;
+      return;
+    }
+    while (ring->count == ring->size) {
+      drainOutput(OUTPUT_SCRATCH_SIZE, true);
+    }
+  }
+}
+
+// ============================================
+// OUTPUT QUEUE OBJECTS
+// ============================================
+
+/**
+ * Print-like front end of one queue
+ * print() / println() take the same arguments as Serial's for the types
+ * the sketch prints.
+ */
+class OutputQueue {
+ public:
+  explicit OutputQueue(uint8_t priority) : priority(priority) {}
+
+  void print(const __FlashStringHelper* text) { add(OUTPUT_FLASH)->value.flash = text; }
+  void print(const char* text) { add(OUTPUT_TEXT)->value.text = text; }
+  void print(char c) { add(OUTPUT_CHAR)->value.c = c; }
+  void print(unsigned char n) { add(OUTPUT_ULONG)->value.unumber = n; }
+  void print(int n) { add(OUTPUT_LONG)->value.number = n; }
+  void print(unsigned int n) { add(OUTPUT_ULONG)->value.unumber = n; }
+  void print(long n) { add(OUTPUT_LONG)->value.number = n; }
+  void print(unsigned long n) { add(OUTPUT_ULONG)->value.unumber = n; }
+  void print(double n, uint8_t digits = 2) {
+    add(OUTPUT_FLOAT | (digits << OUTPUT_DIGITS_SHIFT))->value.real = n;
+  }
+
+  void println() { add(OUTPUT_EMPTY | OUTPUT_NEWLINE); }
+  template <typename T> void println(T value) { print(value); endLine(); }
+  void println(double n, uint8_t digits) { print(n, digits); endLine(); }
+
+ private:
+  uint8_t priority;
+
+  /**
+   * Append an item to this queue
+   * @return The new item, for its value to be filled in
+   */
+  OutputItem* add(uint8_t kind) {
+    reserveOutputItem(priority);
+    OutputRing* ring = &output_rings[priority];
+    OutputItem* item = &ring->items[(ring->head + ring->count) % ring->size];
+    item->kind = kind;
+    item->value.number = 0;
+    ring->count++;
+    return item;
+  }
+
+  /**
+   * Mark the last queued item as ending a line
+   */
+  void endLine() {
+    OutputRing* ring = &output_rings[priority];
+    ring->items[(ring->head + ring->count - 1) % ring->size].kind |= OUTPUT_NEWLINE;
+  }
+};
+
+// Command replies and errors (sent first)
+OutputQueue status_out(0);
+
+// Menu, listings and diagnostics
+OutputQueue text_out(1);
+
+// ============================================
+// PUBLIC FUNCTIONS
+// ============================================
+
+/**
+ * Write the next sections of the listing being produced while the text
+ * queue has room for two of them (one is left for other output)
+ */
+void runOutputProducer() {
+  OutputRing* ring = &output_rings[1];
+  while (output_producer != NULL && ring->size - ring->count >= 2 * OUTPUT_SECTION_ITEMS) {
+    if (!output_producer(output_section++)) {
+      output_producer = NULL;
+    }
+  }
+}
+
+/**
+ * Start producing a listing; one still being produced ends where it is
+ * @param producer Function writing one section per call
+ */
+void startOutputProducer(OutputProducer producer) {
+  output_producer = producer;
+  output_section = 0;
+  runOutputProducer();
+}
+
+/**
+ * Send queued output (call in main loop once the time-critical work is done)
+ * Never waits for the serial port.
+ */
+void updateOutput() {
+  if (!output_paused) {
+    runOutputProducer();
+    drainOutput(OUTPUT_BYTES_PER_UPDATE, false);
+  }
+}
+
+/**
+ * Check whether output is still queued or being produced
+ */
+bool isOutputPending() {
+  return output_sending || output_rings[0].count > 0 || output_rings[1].count > 0 ||
+         output_producer != NULL;
+}
+
+/**
+ * Send all queued output, waiting for the serial port
+ */
+void flushOutput() {
+  while (isOutputPending()) {
+    runOutputProducer();
+    drainOutput(OUTPUT_SCRATCH_SIZE, true);
+  }
+}
+
+/**
+ * Hold queued output back, or let it go again
+ * Pausing sends what is already queued first.
+ */
+void setOutputPaused(bool paused) {
+  if (paused) {
+    flushOutput();
+  }
+  output_paused = paused;
+}
+
+#endif // OUTPUT_H
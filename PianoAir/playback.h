@@ -1,11 +1,13 @@
 #ifndef PLAYBACK_H
 #define PLAYBACK_H
 
-#include <Arduino.h>
+#include "hal.h"
 #include "config.h"
 #include "note_mapping.h"
 #include "recording.h"
 #include "utils.h"
+#include "synth.h"
+#include "profile.h"
 
 // ============================================
 // PLAYBACK STATE
@@ -14,7 +16,7 @@
 // Merged timeline for multi-track playback
 struct TimelineEvent {
   unsigned long timestamp_ms;  // Time from start of playback
-  uint8_t note_index;          // Note to play (0-7)
+  uint8_t note_index;          // Note to play (0 to NUM_NOTES - 1)
   uint16_t duration_ms;        // Duration of note
 
   TimelineEvent() : timestamp_ms(0), note_index(0), duration_ms(0) {}
@@ -23,27 +25,126 @@ struct TimelineEvent {
     : timestamp_ms(time), note_index(note), duration_ms(dur) {}
 };
 
-// Maximum events in merged timeline
-// This depends on how many slots we merge
-#define MAX_TIMELINE_EVENTS (MAX_NOTES_PER_SLOT * NUM_RECORDING_SLOTS)
-
 // Playback state
 bool is_playing = false;
 TimelineEvent timeline[MAX_TIMELINE_EVENTS];
 int timeline_event_count = 0;
 int current_timeline_index = 0;
-unsigned long playback_start_time = 0;
 unsigned long next_event_time = 0;
 
+// Next event to be started by updatePlayback()
+TimelineEvent pending_event;
+bool has_pending_event = false;
+
+// Playback source: materialized timeline or streaming merge of slots
+bool playback_streaming = false;
+
+// Slots play on separate synth voices instead of being merged
+bool playback_polyphonic = false;
+
 // Active slots for playback
 bool playback_slots[NUM_RECORDING_SLOTS];
 
+// ============================================
+// PLAYBACK CLOCK
+// ============================================
+
+// Events keep their recorded times: the timeline (and its cache) and the
+// slot cursors are never rescaled. Playback reads them against a position
+// in recorded time instead, the position at playback_anchor_time plus the
+// millis() since then scaled by the speed. A speed change re-anchors the
+// clock where it is, so playback carries on without a jump. The transpose
+// is added to each note as it starts. Integer math only.
+
+uint8_t playback_speed_percent = 100;     // Speed set with V
+int8_t playback_transpose = 0;            // Semitones set with + / -
+
+// Looper: play at the recorded speed and pitch, whatever is set
+bool playback_as_recorded = false;
+
+unsigned long playback_anchor_time = 0;   // millis() at the anchor
+unsigned long playback_anchor_position = 0;  // Recorded time at the anchor
+
+// Note on the buzzer (as recorded) and its recorded end time
+uint8_t playback_note = 0;
+unsigned long playback_note_end = 0;
+
+// ============================================
+// TIMELINE CACHE
+// ============================================
+
+// The timeline stays in place after playback. When the next PA / P[n] asks
+// for the same slots with the same strategy and none of them has been
+// re-recorded or cleared since (slot revisions unchanged), it is played
+// again as is instead of being collected, sorted and resolved again.
+
+// Key strategy of a single slot played as recorded (no overlap resolution)
+#define TIMELINE_KEY_SINGLE_SLOT 0xFF
+
+/**
+ * What the current timeline was built from
+ */
+struct TimelineKey {
+  uint8_t slot_mask;                          // Slots merged (bit n = slot n)
+  uint8_t strategy;                           // OverlapStrategy or TIMELINE_KEY_SINGLE_SLOT
+  uint8_t revisions[NUM_RECORDING_SLOTS];     // Revision of each merged slot
+};
+
+TimelineKey timeline_key;
+bool timeline_key_valid = false;
+
+// Cache statistics
+unsigned long timeline_cache_hits = 0;
+unsigned long timeline_cache_misses = 0;
+
+/**
+ * Describe a timeline request
+ * @param key Output: key for the request
+ * @param slots Array of slot numbers
+ * @param num_slots Number of slots in array
+ * @param strategy Overlap strategy, or TIMELINE_KEY_SINGLE_SLOT
+ */
+void makeTimelineKey(TimelineKey* key, int* slots, int num_slots, uint8_t strategy) {
+  key->slot_mask = 0;
+  key->strategy = strategy;
+  for (int i = 0; i < NUM_RECORDING_SLOTS; i++) {
+    key->revisions[i] = 0;
+  }
+
+  for (int s = 0; s < num_slots; s++) {
+    if (isSlotActive(slots[s])) {
+      key->slot_mask |= 1 << slots[s];
+      key->revisions[slots[s]] = getRecordingSlot(slots[s])->revision;
+    }
+  }
+}
+
+/**
+ * Check whether the timeline already holds the result of a request
+ * Counts a hit or a miss.
+ */
+bool isTimelineCached(const TimelineKey* key) {
+  if (timeline_key_valid && memcmp(key, &timeline_key, sizeof(TimelineKey)) == 0) {
+    timeline_cache_hits++;
+    return true;
+  }
+  timeline_cache_misses++;
+  return false;
+}
+
+/**
+ * Forget the cached timeline (it will be rebuilt on the next play)
+ */
+void invalidateTimelineCache() {
+  timeline_key_valid = false;
+}
+
 // ============================================
 // TIMELINE BUILDING FUNCTIONS
 // ============================================
 
 // Forward declaration
-void resolveOverlaps(OverlapStrategy strategy);
+bool resolveOverlaps(OverlapStrategy strategy);
 
 /**
  * Comparison function for sorting timeline events
@@ -60,25 +161,40 @@ int compareTimelineEvents(const void* a, const void* b) {
 /**
  * Build timeline from a single recording slot
  * @param slot_num Slot number
- * @return true if successful
+ * @return true if successful, false if the slot is empty or has more
+ *         notes than the timeline holds
  */
 bool buildTimelineFromSlot(int slot_num) {
   RecordingSlot* slot = getRecordingSlot(slot_num);
-  if (slot == NULL || !slot->is_active) {
+  if (slot == NULL || !slot->is_active || slot->note_count > MAX_TIMELINE_EVENTS) {
     return false;
   }
 
+  TimelineKey key;
+  makeTimelineKey(&key, &slot_num, 1, TIMELINE_KEY_SINGLE_SLOT);
+  if (isTimelineCached(&key)) {
+    return true;
+  }
+
+  timeline_key_valid = false;
   timeline_event_count = 0;
   unsigned long current_time = 0;
 
-  for (int i = 0; i < slot->note_count && timeline_event_count < MAX_TIMELINE_EVENTS; i++) {
-    NoteEvent* note = &slot->events[i];
-    uint16_t duration_ms = note->duration_units * DURATION_UNIT_MS;
+  SlotReader reader;
+  NoteEvent note;
+  beginSlotRead(slot_num, &reader);
+
+  while (readNextEvent(&reader, &note)) {
+    uint16_t duration_ms = note.duration_units * DURATION_UNIT_MS;
 
-    timeline[timeline_event_count++] = TimelineEvent(current_time, note->note_index, duration_ms);
+    if (note.note_index != NOTE_REST) {
+      timeline[timeline_event_count++] = TimelineEvent(current_time, note.note_index, duration_ms);
+    }
     current_time += duration_ms;
   }
 
+  timeline_key = key;
+  timeline_key_valid = true;
   return true;
 }
 
@@ -87,14 +203,35 @@ bool buildTimelineFromSlot(int slot_num) {
  * @param slots Array of slot numbers to merge
  * @param num_slots Number of slots in array
  * @param strategy Overlap resolution strategy
- * @return true if successful
+ * @return true if successful, false if there is nothing to play or the
+ *         notes (or the resolved segments) do not fit in the timeline
  */
 bool buildTimelineFromMultipleSlots(int* slots, int num_slots, OverlapStrategy strategy) {
   if (num_slots == 0 || slots == NULL) {
     return false;
   }
 
+  TimelineKey key;
+  makeTimelineKey(&key, slots, num_slots, strategy);
+  if (key.slot_mask != 0 && isTimelineCached(&key)) {
+    return true;
+  }
+
+  // Every note of every slot has to fit: a slot collected short would be
+  // missing from the sorted result
+  int total_notes = 0;
+  for (int s = 0; s < num_slots; s++) {
+    RecordingSlot* slot = getRecordingSlot(slots[s]);
+    if (slot != NULL && slot->is_active) {
+      total_notes += slot->note_count;
+    }
+  }
+  if (total_notes > MAX_TIMELINE_EVENTS) {
+    return false;
+  }
+
   // First, collect all events from all slots
+  timeline_key_valid = false;
   timeline_event_count = 0;
 
   for (int s = 0; s < num_slots; s++) {
@@ -107,11 +244,16 @@ bool buildTimelineFromMultipleSlots(int* slots, int num_slots, OverlapStrategy s
 
     unsigned long current_time = 0;
 
-    for (int i = 0; i < slot->note_count && timeline_event_count < MAX_TIMELINE_EVENTS; i++) {
-      NoteEvent* note = &slot->events[i];
-      uint16_t duration_ms = note->duration_units * DURATION_UNIT_MS;
+    SlotReader reader;
+    NoteEvent note;
+    beginSlotRead(slot_num, &reader);
+
+    while (readNextEvent(&reader, &note)) {
+      uint16_t duration_ms = note.duration_units * DURATION_UNIT_MS;
 
-      timeline[timeline_event_count++] = TimelineEvent(current_time, note->note_index, duration_ms);
+      if (note.note_index != NOTE_REST) {
+        timeline[timeline_event_count++] = TimelineEvent(current_time, note.note_index, duration_ms);
+      }
       current_time += duration_ms;
     }
   }
@@ -124,108 +266,618 @@ bool buildTimelineFromMultipleSlots(int* slots, int num_slots, OverlapStrategy s
   qsort(timeline, timeline_event_count, sizeof(TimelineEvent), compareTimelineEvents);
 
   // Resolve overlaps based on strategy
-  resolveOverlaps(strategy);
+  if (!resolveOverlaps(strategy)) {
+    timeline_event_count = 0;
+    return false;
+  }
 
+  timeline_key = key;
+  timeline_key_valid = true;
+  return true;
+}
+
+/**
+ * One note sounding during the overlap sweep
+ * The same note from several slots makes one longer run.
+ */
+struct ActiveRun {
+  uint8_t note_index;
+  unsigned long start_ms;     // Start of the run
+  unsigned long end_ms;       // End of the run
+};
+
+// Notes sounding at once: one per slot, since each slot plays one note at
+// a time and the same note from several slots shares a run
+#define MAX_ACTIVE_RUNS NUM_RECORDING_SLOTS
+
+/**
+ * Pick the note to sound among the active ones
+ * @param strategy Overlap resolution strategy
+ * @param runs Sounding notes, lowest note first (count > 0)
+ * @param count Number of runs
+ * @param turn Rotation counter (OVERLAP_ALTERNATE)
+ * @return Note index
+ */
+uint8_t pickOverlapNote(OverlapStrategy strategy, const ActiveRun* runs, uint8_t count,
+                        uint8_t turn) {
+  switch (strategy) {
+    case OVERLAP_PRIORITY_HIGH:
+      return runs[count - 1].note_index;
+
+    case OVERLAP_PRIORITY_LOW:
+      return runs[0].note_index;
+
+    case OVERLAP_ALTERNATE:
+      return runs[turn % count].note_index;
+
+    case OVERLAP_DROP:
+    case OVERLAP_POLYPHONIC:  // Not merged (see playMultipleSlotsPolyphonic)
+    default: {
+      // Earliest started note holds the buzzer (the timeline does not
+      // keep slot order, so notes starting together go to the lower one)
+      uint8_t chosen = 0;
+      for (uint8_t r = 1; r < count; r++) {
+        if (runs[r].start_ms < runs[chosen].start_ms) {
+          chosen = r;
+        }
+      }
+      return runs[chosen].note_index;
+    }
+  }
+}
+
+/**
+ * Add an event to the sounding notes, keeping them sorted by note
+ * @return false if more notes sound at once than MAX_ACTIVE_RUNS (dropped)
+ */
+bool addActiveRun(ActiveRun* runs, uint8_t* count, const TimelineEvent& event) {
+  unsigned long end = event.timestamp_ms + event.duration_ms;
+  uint8_t pos = 0;
+  while (pos < *count && runs[pos].note_index < event.note_index) {
+    pos++;
+  }
+
+  if (pos < *count && runs[pos].note_index == event.note_index) {
+    if (end > runs[pos].end_ms) {
+      runs[pos].end_ms = end;  // Same note from another slot: one longer run
+    }
+    return true;
+  }
+  if (*count == MAX_ACTIVE_RUNS) {
+    return false;
+  }
+
+  for (uint8_t r = *count; r > pos; r--) {
+    runs[r] = runs[r - 1];
+  }
+  runs[pos].note_index = event.note_index;
+  runs[pos].start_ms = event.timestamp_ms;
+  runs[pos].end_ms = end;
+  (*count)++;
   return true;
 }
 
 /**
  * Resolve overlapping notes in timeline based on strategy
+ * Sweeps the sorted timeline over its start and end points and emits one
+ * event per stretch in which the chosen note does not change, with the
+ * same rules as the streaming merge (fetchNextStreamEvent): a note covered
+ * by a preferred one resumes when that one ends.
+ *
+ * Works in place: the unread events are first moved to the end of the
+ * array and the result is written from the front. The only extra state is
+ * the list of sounding notes (at most one per slot), so memory does not
+ * grow with the number of events. O(n * slots) after the sort.
+ * A resolved timeline that would overwrite events not yet read (more
+ * segments than free slots, mostly in OVERLAP_ALTERNATE) is cut short.
  * @param strategy Overlap resolution strategy
+ * @return false if the result was cut short
  */
-void resolveOverlaps(OverlapStrategy strategy) {
+bool resolveOverlaps(OverlapStrategy strategy) {
   if (timeline_event_count <= 1) {
-    return;  // No overlaps possible
-  }
-
-  // Create a new timeline with overlaps resolved
-  TimelineEvent resolved[MAX_TIMELINE_EVENTS];
-  int resolved_count = 0;
-
-  for (int i = 0; i < timeline_event_count; i++) {
-    TimelineEvent current = timeline[i];
-    unsigned long current_end = current.timestamp_ms + current.duration_ms;
-
-    // Check for overlaps with next events
-    bool has_overlap = false;
-
-    for (int j = i + 1; j < timeline_event_count; j++) {
-      TimelineEvent next = timeline[j];
-
-      // If next event starts before current ends, we have an overlap
-      if (next.timestamp_ms < current_end) {
-        has_overlap = true;
-
-        // Apply overlap strategy
-        switch (strategy) {
-          case OVERLAP_PRIORITY_HIGH:
-            // Keep the higher note
-            if (next.note_index > current.note_index) {
-              current = next;
-              current_end = current.timestamp_ms + current.duration_ms;
-            }
-            break;
-
-          case OVERLAP_PRIORITY_LOW:
-            // Keep the lower note
-            if (next.note_index < current.note_index) {
-              current = next;
-              current_end = current.timestamp_ms + current.duration_ms;
-            }
-            break;
-
-          case OVERLAP_DROP:
-            // Keep first note, skip others
-            // (current is already the first note)
-            break;
-
-          case OVERLAP_ALTERNATE:
-            // For alternate mode, we'll split the duration
-            // This creates a rapid alternation effect
-            // Add current note with shortened duration
-            if (resolved_count < MAX_TIMELINE_EVENTS) {
-              TimelineEvent split_current = current;
-              split_current.duration_ms = ALTERNATE_SWITCH_INTERVAL_MS;
-              resolved[resolved_count++] = split_current;
-            }
-
-            // Add next note starting after the switch interval
-            if (resolved_count < MAX_TIMELINE_EVENTS) {
-              TimelineEvent split_next = next;
-              split_next.timestamp_ms = current.timestamp_ms + ALTERNATE_SWITCH_INTERVAL_MS;
-              split_next.duration_ms = ALTERNATE_SWITCH_INTERVAL_MS;
-              resolved[resolved_count++] = split_next;
-
-              // Update current end time
-              current.timestamp_ms = split_next.timestamp_ms + ALTERNATE_SWITCH_INTERVAL_MS;
-              current_end = current.timestamp_ms;
-            }
-            break;
+    return true;  // No overlaps possible
+  }
+
+  // Move the input to the end of the array so output can grow past it
+  int read_index = MAX_TIMELINE_EVENTS - timeline_event_count;
+  memmove(&timeline[read_index], &timeline[0], timeline_event_count * sizeof(TimelineEvent));
+
+  ActiveRun runs[MAX_ACTIVE_RUNS];       // Notes sounding at time t, lowest first
+  uint8_t run_count = 0;
+  uint8_t turn = 0;                      // OVERLAP_ALTERNATE rotation
+  int write_index = 0;
+  unsigned long t = timeline[read_index].timestamp_ms;
+
+  while (true) {
+    // Start every event that begins by t
+    while (read_index < MAX_TIMELINE_EVENTS && timeline[read_index].timestamp_ms <= t) {
+      const TimelineEvent& event = timeline[read_index++];
+      if (event.note_index >= NUM_NOTES || event.timestamp_ms + event.duration_ms <= t) {
+        continue;  // Invalid or empty
+      }
+      addActiveRun(runs, &run_count, event);
+    }
+
+    // Next point where the set of sounding notes changes
+    bool more_input = read_index < MAX_TIMELINE_EVENTS;
+    unsigned long next_point = more_input ? timeline[read_index].timestamp_ms : 0;
+    for (uint8_t r = 0; r < run_count; r++) {
+      if ((!more_input && r == 0) || runs[r].end_ms < next_point) {
+        next_point = runs[r].end_ms;
+      }
+    }
+
+    if (run_count == 0) {
+      if (!more_input) {
+        break;  // Done
+      }
+      t = next_point;  // Silence until the next event
+      continue;
+    }
+
+    uint8_t note = pickOverlapNote(strategy, runs, run_count, turn);
+    if (strategy == OVERLAP_ALTERNATE && run_count > 1) {
+      if (next_point > t + ALTERNATE_SWITCH_INTERVAL_MS) {
+        next_point = t + ALTERNATE_SWITCH_INTERVAL_MS;
+      }
+      turn++;
+    }
+
+    // Extend the previous event if the same note carries on
+    TimelineEvent* last = write_index > 0 ? &timeline[write_index - 1] : NULL;
+    if (last != NULL && last->note_index == note &&
+        last->timestamp_ms + last->duration_ms == t &&
+        last->duration_ms + (next_point - t) <= 0xFFFF) {
+      last->duration_ms += next_point - t;
+    } else if (write_index < read_index) {
+      timeline[write_index++] = TimelineEvent(t, note, next_point - t);
+    } else {
+      timeline_event_count = write_index;
+      return false;  // Timeline full
+    }
+
+    // Retire the notes that end here
+    t = next_point;
+    uint8_t kept = 0;
+    for (uint8_t r = 0; r < run_count; r++) {
+      if (runs[r].end_ms > t) {
+        runs[kept++] = runs[r];
+      }
+    }
+    run_count = kept;
+  }
+
+  timeline_event_count = write_index;
+  return true;
+}
+
+// ============================================
+// STREAMING MERGE FUNCTIONS
+// ============================================
+
+/**
+ * Read position inside one recording slot for streaming playback
+ */
+struct SlotCursor {
+  int8_t slot_num;          // Slot being read
+  SlotReader reader;        // Decoder positioned after the current event
+  NoteEvent event;          // Current event (a note or a rest)
+  bool done;                // All events consumed
+  int event_index;          // Notes of the slot before the current event
+  unsigned long start_ms;   // Start time of the current event
+  uint8_t revision;         // Slot revision the reader started on
+
+  SlotCursor() : slot_num(-1), done(true), event_index(0), start_ms(0), revision(0) {}
+};
+
+// Streaming merge state (one cursor per slot, no timeline needed)
+SlotCursor stream_cursors[NUM_RECORDING_SLOTS];
+int stream_cursor_count = 0;
+unsigned long stream_time = 0;        // End of the last emitted segment
+uint8_t stream_alternate_turn = 0;    // Rotation counter for OVERLAP_ALTERNATE
+OverlapStrategy stream_strategy = DEFAULT_OVERLAP_STRATEGY;
+
+/**
+ * Check if a cursor has consumed all events of its slot
+ * A slot cleared or replaced since the cursor started (C, CA, a protocol
+ * load) ends the cursor: its blocks are back in the pool and may already
+ * belong to another slot.
+ */
+bool isCursorDone(SlotCursor* cursor) {
+  if (!cursor->done && recording_slots[cursor->slot_num].revision != cursor->revision) {
+    cursor->done = true;
+  }
+  return cursor->done;
+}
+
+/**
+ * Get the current event of a cursor
+ */
+NoteEvent* getCursorEvent(SlotCursor* cursor) {
+  return &cursor->event;
+}
+
+/**
+ * Get the note a cursor sounds now
+ * @return Note index, or -1 during a rest or once done
+ */
+int getCursorNote(SlotCursor* cursor) {
+  if (isCursorDone(cursor) || cursor->event.note_index == NOTE_REST) {
+    return -1;
+  }
+  return cursor->event.note_index;
+}
+
+/**
+ * Get the end time of the current event of a cursor
+ */
+unsigned long getCursorEnd(SlotCursor* cursor) {
+  return cursor->start_ms + cursor->event.duration_units * DURATION_UNIT_MS;
+}
+
+/**
+ * Move a cursor to the next event of its slot
+ */
+void advanceCursor(SlotCursor* cursor) {
+  cursor->start_ms = getCursorEnd(cursor);
+  if (cursor->event.note_index != NOTE_REST) {
+    cursor->event_index++;
+  }
+  if (!isCursorDone(cursor)) {
+    cursor->done = !readNextEvent(&cursor->reader, &cursor->event);
+  }
+}
+
+/**
+ * Prepare streaming merge of multiple slots
+ * @param slots Array of slot numbers to merge
+ * @param num_slots Number of slots in array
+ * @param strategy Overlap resolution strategy
+ * @return true if at least one slot has events
+ */
+bool beginStreamingMerge(int* slots, int num_slots, OverlapStrategy strategy) {
+  if (num_slots == 0 || slots == NULL) {
+    return false;
+  }
+
+  stream_cursor_count = 0;
+  for (int s = 0; s < num_slots && stream_cursor_count < NUM_RECORDING_SLOTS; s++) {
+    if (!isSlotActive(slots[s])) {
+      continue;  // Skip invalid or empty slots
+    }
+
+    SlotCursor* cursor = &stream_cursors[stream_cursor_count++];
+    cursor->slot_num = slots[s];
+    cursor->event_index = 0;
+    cursor->start_ms = 0;
+    cursor->revision = recording_slots[slots[s]].revision;
+    beginSlotRead(slots[s], &cursor->reader);
+    cursor->done = !readNextEvent(&cursor->reader, &cursor->event);
+  }
+
+  stream_time = 0;
+  stream_alternate_turn = 0;
+  stream_strategy = strategy;
+
+  return stream_cursor_count > 0;
+}
+
+/**
+ * Produce the next merged event from the slot cursors
+ * Every slot's events are back to back from time 0, so at stream_time each
+ * unfinished cursor holds exactly one event: a sounding note or a rest. The
+ * overlap strategy picks one of the notes, and the segment lasts until the
+ * earliest of those events ends (or one alternate interval in
+ * OVERLAP_ALTERNATE mode). Stretches where every slot rests are skipped.
+ * @param out Output: next event
+ * @return true if an event was produced, false when all slots are finished
+ */
+bool fetchNextStreamEvent(TimelineEvent* out) {
+  SlotCursor* chosen = NULL;
+  unsigned long segment_end = 0;
+  int active_count = 0;
+
+  while (true) {
+    bool unfinished = false;
+
+    // Skip finished events and find the notes sounding at stream_time
+    for (int c = 0; c < stream_cursor_count; c++) {
+      SlotCursor* cursor = &stream_cursors[c];
+
+      while (!isCursorDone(cursor) && getCursorEnd(cursor) <= stream_time) {
+        advanceCursor(cursor);
+      }
+
+      if (isCursorDone(cursor)) {
+        continue;
+      }
+
+      unsigned long cursor_end = getCursorEnd(cursor);
+      if (!unfinished || cursor_end < segment_end) {
+        segment_end = cursor_end;
+      }
+      unfinished = true;
+      if (getCursorNote(cursor) != -1) {
+        active_count++;
+      }
+    }
+
+    if (!unfinished) {
+      return false;  // All slots finished
+    }
+    if (active_count > 0) {
+      break;
+    }
+    stream_time = segment_end;  // Every slot rests until then
+  }
+
+  // Pick the note to sound according to the overlap strategy
+  int turn = stream_alternate_turn % active_count;
+  int active_index = 0;
+
+  for (int c = 0; c < stream_cursor_count; c++) {
+    SlotCursor* cursor = &stream_cursors[c];
+    if (getCursorNote(cursor) == -1) {
+      continue;
+    }
+
+    uint8_t note = getCursorEvent(cursor)->note_index;
+
+    switch (stream_strategy) {
+      case OVERLAP_PRIORITY_HIGH:
+        if (chosen == NULL || note > getCursorEvent(chosen)->note_index) {
+          chosen = cursor;
+        }
+        break;
+
+      case OVERLAP_PRIORITY_LOW:
+        if (chosen == NULL || note < getCursorEvent(chosen)->note_index) {
+          chosen = cursor;
+        }
+        break;
+
+      case OVERLAP_ALTERNATE:
+        if (active_index == turn) {
+          chosen = cursor;
+        }
+        break;
+
+      case OVERLAP_DROP:
+      case OVERLAP_POLYPHONIC:  // Not merged (see playMultipleSlotsPolyphonic)
+        // Earliest started note holds the buzzer
+        if (chosen == NULL || cursor->start_ms < chosen->start_ms) {
+          chosen = cursor;
         }
-      } else {
-        break;  // No more overlaps for this event
+        break;
+    }
+
+    active_index++;
+  }
+
+  if (chosen == NULL) {
+    // Unknown strategy: first sounding note
+    for (int c = 0; chosen == NULL; c++) {
+      if (getCursorNote(&stream_cursors[c]) != -1) {
+        chosen = &stream_cursors[c];
       }
     }
+  }
 
-    // Add the resolved event (unless we used ALTERNATE mode, which already added events)
-    if (strategy != OVERLAP_ALTERNATE && resolved_count < MAX_TIMELINE_EVENTS) {
-      resolved[resolved_count++] = current;
+  if (stream_strategy == OVERLAP_ALTERNATE && active_count > 1) {
+    if (segment_end > stream_time + ALTERNATE_SWITCH_INTERVAL_MS) {
+      segment_end = stream_time + ALTERNATE_SWITCH_INTERVAL_MS;
     }
+    stream_alternate_turn++;
   }
 
-  // Copy resolved timeline back
-  if (strategy != OVERLAP_ALTERNATE) {
-    for (int i = 0; i < resolved_count; i++) {
-      timeline[i] = resolved[i];
+  *out = TimelineEvent(stream_time, getCursorEvent(chosen)->note_index,
+                       segment_end - stream_time);
+  stream_time = segment_end;
+
+  return true;
+}
+
+// ============================================
+// PLAYBACK CLOCK FUNCTIONS
+// ============================================
+
+/**
+ * Get the speed the clock runs at
+ * @return Percent of the recorded tempo
+ */
+uint8_t getPlaybackClockPercent() {
+  return playback_as_recorded ? 100 : playback_speed_percent;
+}
+
+/**
+ * Start the clock at recorded time 0
+ * @param start_time millis() at which recorded time 0 plays
+ */
+void startPlaybackClock(unsigned long start_time) {
+  playback_anchor_time = start_time;
+  playback_anchor_position = 0;
+}
+
+/**
+ * Get the recorded time playback has reached
+ * @return Milliseconds of recorded time
+ */
+unsigned long getPlaybackPosition() {
+  return playback_anchor_position +
+         (millis() - playback_anchor_time) * getPlaybackClockPercent() / 100;
+}
+
+/**
+ * Get the millis() at which a recorded time plays, rounded up so that
+ * getPlaybackPosition() has reached it by then
+ * @param position Milliseconds of recorded time
+ * @return Time in millis()
+ */
+unsigned long getPlaybackTime(unsigned long position) {
+  uint8_t percent = getPlaybackClockPercent();
+  if (position < playback_anchor_position) {
+    return playback_anchor_time - (playback_anchor_position - position) * 100 / percent;
+  }
+  return playback_anchor_time +
+         ((position - playback_anchor_position) * 100 + percent - 1) / percent;
+}
+
+/**
+ * Apply the transpose to a recorded note
+ * @param note_index Note (0 to NUM_NOTES - 1), or -1 for silence
+ * @return Note moved by playback_transpose and kept within the note range
+ */
+int transposePlaybackNote(int note_index) {
+  if (note_index < 0 || playback_as_recorded) {
+    return note_index;
+  }
+  int shifted = note_index + playback_transpose;
+  if (shifted < 0) {
+    return 0;
+  }
+  if (shifted > NUM_NOTES - 1) {
+    return NUM_NOTES - 1;
+  }
+  return shifted;
+}
+
+/**
+ * Start a recorded note on the buzzer, transposed, until its recorded end
+ */
+void playPlaybackNote(uint8_t note_index, unsigned long end_position) {
+  playback_note = note_index;
+  playback_note_end = end_position;
+  playNoteUntil(transposePlaybackNote(note_index), getPlaybackTime(end_position));
+}
+
+/**
+ * Set the playback speed; during playback it changes from now on
+ * @param percent Percent of the recorded tempo (clamped to
+ *                PLAYBACK_SPEED_MIN_PERCENT..PLAYBACK_SPEED_MAX_PERCENT)
+ */
+void setPlaybackSpeed(int percent) {
+  if (percent < PLAYBACK_SPEED_MIN_PERCENT) {
+    percent = PLAYBACK_SPEED_MIN_PERCENT;
+  } else if (percent > PLAYBACK_SPEED_MAX_PERCENT) {
+    percent = PLAYBACK_SPEED_MAX_PERCENT;
+  }
+  if (!is_playing || playback_as_recorded) {
+    playback_speed_percent = percent;
+    return;
+  }
+
+  // Re-anchor at the current position, then run on at the new speed
+  playback_anchor_position = getPlaybackPosition();
+  playback_anchor_time = millis();
+  playback_speed_percent = percent;
+
+  if (!playback_polyphonic) {
+    if (isNoteSounding()) {
+      playPlaybackNote(playback_note, playback_note_end);  // Moves its release
+    }
+    if (has_pending_event) {
+      next_event_time = getPlaybackTime(pending_event.timestamp_ms);
+    }
+  }
+}
+
+/**
+ * Set the transpose; during playback the sounding notes change pitch at once
+ * @param semitones Semitones up or down (clamped to +/- PLAYBACK_TRANSPOSE_MAX)
+ */
+void setPlaybackTranspose(int semitones) {
+  if (semitones < -PLAYBACK_TRANSPOSE_MAX) {
+    semitones = -PLAYBACK_TRANSPOSE_MAX;
+  } else if (semitones > PLAYBACK_TRANSPOSE_MAX) {
+    semitones = PLAYBACK_TRANSPOSE_MAX;
+  }
+  playback_transpose = semitones;
+  if (!is_playing || playback_as_recorded) {
+    return;
+  }
+
+  if (playback_polyphonic) {
+    for (int c = 0; c < stream_cursor_count; c++) {
+      synthSetVoice(c, transposePlaybackNote(getCursorNote(&stream_cursors[c])));
     }
-    timeline_event_count = resolved_count;
+    showSynthVoiceLEDs();
+  } else if (isNoteSounding()) {
+    playPlaybackNote(playback_note, playback_note_end);
   }
 }
 
+/**
+ * Get the playback speed
+ * @return Percent of the recorded tempo
+ */
+int getPlaybackSpeed() {
+  return playback_speed_percent;
+}
+
+/**
+ * Get the transpose
+ * @return Semitones up (positive) or down (negative)
+ */
+int getPlaybackTranspose() {
+  return playback_transpose;
+}
+
 // ============================================
 // PLAYBACK CONTROL FUNCTIONS
 // ============================================
 
+/**
+ * Fetch the next event from the active playback source
+ * @param out Output: next event
+ * @return true if an event was fetched, false at end of playback
+ */
+bool fetchNextPlaybackEvent(TimelineEvent* out) {
+  if (playback_streaming) {
+    return fetchNextStreamEvent(out);
+  }
+
+  if (current_timeline_index >= timeline_event_count) {
+    return false;
+  }
+
+  *out = timeline[current_timeline_index++];
+  return true;
+}
+
+/**
+ * Reset playback state and fetch the first event
+ * @return true if there is something to play
+ */
+bool beginPlayback() {
+  current_timeline_index = 0;
+  has_pending_event = fetchNextPlaybackEvent(&pending_event);
+  if (!has_pending_event) {
+    return false;
+  }
+
+  is_playing = true;
+  startPlaybackClock(millis());
+  next_event_time = getPlaybackTime(pending_event.timestamp_ms);
+
+  return true;
+}
+
+/**
+ * Mark selected slots as active for playback
+ * @param slots Array of slot numbers
+ * @param num_slots Number of slots
+ */
+void setPlaybackSlots(int* slots, int num_slots) {
+  for (int i = 0; i < NUM_RECORDING_SLOTS; i++) {
+    playback_slots[i] = false;
+  }
+  for (int i = 0; i < num_slots; i++) {
+    if (slots[i] >= 0 && slots[i] < NUM_RECORDING_SLOTS) {
+      playback_slots[slots[i]] = true;
+    }
+  }
+}
+
 /**
  * Start playback of a single slot
  * @param slot_num Slot number
@@ -236,20 +888,59 @@ bool playSingleSlot(int slot_num) {
     return false;  // Already playing
   }
 
-  if (!buildTimelineFromSlot(slot_num)) {
-    return false;  // Failed to build timeline
+  if (buildTimelineFromSlot(slot_num)) {
+    playback_streaming = false;
+  } else if (beginStreamingMerge(&slot_num, 1, OVERLAP_DROP)) {
+    playback_streaming = true;  // More notes than the timeline holds
+  } else {
+    return false;  // Empty slot
   }
 
-  is_playing = true;
-  current_timeline_index = 0;
-  playback_start_time = millis();
-  next_event_time = playback_start_time;
+  if (!beginPlayback()) {
+    return false;
+  }
 
   // Mark only this slot as active for playback
-  for (int i = 0; i < NUM_RECORDING_SLOTS; i++) {
-    playback_slots[i] = (i == slot_num);
+  setPlaybackSlots(&slot_num, 1);
+
+  return true;
+}
+
+/**
+ * Start polyphonic playback of multiple slots
+ * Each slot plays on its own synth voice, so overlapping notes all sound;
+ * slots beyond SYNTH_VOICES are not played.
+ * @param slots Array of slot numbers
+ * @param num_slots Number of slots
+ * @return true if playback started
+ */
+bool playMultipleSlotsPolyphonic(int* slots, int num_slots) {
+  if (is_playing) {
+    return false;  // Already playing
   }
 
+  if (num_slots > SYNTH_VOICES) {
+    num_slots = SYNTH_VOICES;
+  }
+  if (!beginStreamingMerge(slots, num_slots, OVERLAP_POLYPHONIC)) {
+    return false;  // Nothing to play
+  }
+
+  releaseNote();
+  startSynth();
+  for (int c = 0; c < stream_cursor_count; c++) {
+    synthSetVoice(c, transposePlaybackNote(getCursorNote(&stream_cursors[c])));
+  }
+  showSynthVoiceLEDs();
+
+  playback_streaming = true;
+  playback_polyphonic = true;
+  has_pending_event = false;
+  is_playing = true;
+  startPlaybackClock(millis());
+
+  setPlaybackSlots(slots, num_slots);
+
   return true;
 }
 
@@ -261,47 +952,89 @@ bool playSingleSlot(int slot_num) {
  * @return true if playback started
  */
 bool playMultipleSlots(int* slots, int num_slots, OverlapStrategy strategy) {
+  if (strategy == OVERLAP_POLYPHONIC) {
+    return playMultipleSlotsPolyphonic(slots, num_slots);
+  }
+
   if (is_playing) {
     return false;  // Already playing
   }
 
-  if (!buildTimelineFromMultipleSlots(slots, num_slots, strategy)) {
-    return false;  // Failed to build timeline
+  if (buildTimelineFromMultipleSlots(slots, num_slots, strategy)) {
+    playback_streaming = false;
+  } else if (beginStreamingMerge(slots, num_slots, strategy)) {
+    playback_streaming = true;  // Too many notes for the timeline: merge as PS does
+  } else {
+    return false;  // Nothing to play
   }
 
-  is_playing = true;
-  current_timeline_index = 0;
-  playback_start_time = millis();
-  next_event_time = playback_start_time;
-
-  // Mark selected slots as active for playback
-  for (int i = 0; i < NUM_RECORDING_SLOTS; i++) {
-    playback_slots[i] = false;
-  }
-  for (int i = 0; i < num_slots; i++) {
-    if (slots[i] >= 0 && slots[i] < NUM_RECORDING_SLOTS) {
-      playback_slots[slots[i]] = true;
-    }
+  if (!beginPlayback()) {
+    return false;
   }
 
+  setPlaybackSlots(slots, num_slots);
+
   return true;
 }
 
 /**
- * Start playback of all active slots
+ * Start streaming playback of multiple slots
+ * Events are merged on the fly from one cursor per slot, so no timeline
+ * is built and RAM use does not grow with the number of events.
+ * @param slots Array of slot numbers
+ * @param num_slots Number of slots
  * @param strategy Overlap resolution strategy
  * @return true if playback started
  */
-bool playAllSlots(OverlapStrategy strategy) {
-  int active_slots[NUM_RECORDING_SLOTS];
+bool playMultipleSlotsStreamed(int* slots, int num_slots, OverlapStrategy strategy) {
+  if (strategy == OVERLAP_POLYPHONIC) {
+    return playMultipleSlotsPolyphonic(slots, num_slots);  // Streams as well
+  }
+
+  if (is_playing) {
+    return false;  // Already playing
+  }
+
+  if (!beginStreamingMerge(slots, num_slots, strategy)) {
+    return false;  // Nothing to play
+  }
+
+  playback_streaming = true;
+  if (!beginPlayback()) {
+    return false;
+  }
+
+  setPlaybackSlots(slots, num_slots);
+
+  return true;
+}
+
+/**
+ * Collect all slots that contain a recording
+ * @param out_slots Output: array of at least NUM_RECORDING_SLOTS entries
+ * @return Number of active slots
+ */
+int getActiveSlots(int* out_slots) {
   int num_active = 0;
 
   for (int i = 0; i < NUM_RECORDING_SLOTS; i++) {
     if (isSlotActive(i)) {
-      active_slots[num_active++] = i;
+      out_slots[num_active++] = i;
     }
   }
 
+  return num_active;
+}
+
+/**
+ * Start playback of all active slots
+ * @param strategy Overlap resolution strategy
+ * @return true if playback started
+ */
+bool playAllSlots(OverlapStrategy strategy) {
+  int active_slots[NUM_RECORDING_SLOTS];
+  int num_active = getActiveSlots(active_slots);
+
   if (num_active == 0) {
     return false;  // No active slots
   }
@@ -309,16 +1042,73 @@ bool playAllSlots(OverlapStrategy strategy) {
   return playMultipleSlots(active_slots, num_active, strategy);
 }
 
+/**
+ * Start streaming playback of all active slots
+ * @param strategy Overlap resolution strategy
+ * @return true if playback started
+ */
+bool playAllSlotsStreamed(OverlapStrategy strategy) {
+  int active_slots[NUM_RECORDING_SLOTS];
+  int num_active = getActiveSlots(active_slots);
+
+  if (num_active == 0) {
+    return false;  // No active slots
+  }
+
+  return playMultipleSlotsStreamed(active_slots, num_active, strategy);
+}
+
 /**
  * Stop playback
  */
 void stopPlayback() {
   is_playing = false;
-  stopNote();
+  has_pending_event = false;
+  playback_as_recorded = false;
+  if (playback_polyphonic) {
+    stopSynth();
+    playback_polyphonic = false;
+  }
+  releaseNote();
   turnOffAllLEDs();
   current_timeline_index = 0;
 }
 
+/**
+ * Move each synth voice on to its slot's next note when the current one ends
+ * @return true while any slot still has notes
+ */
+bool updatePolyphonicPlayback() {
+  unsigned long position = getPlaybackPosition();
+  bool changed = false;
+  bool sounding = false;
+
+  for (int c = 0; c < stream_cursor_count; c++) {
+    SlotCursor* cursor = &stream_cursors[c];
+
+    if (!isCursorDone(cursor) && position >= getCursorEnd(cursor)) {
+      while (!isCursorDone(cursor) && position >= getCursorEnd(cursor)) {
+        advanceCursor(cursor);
+      }
+      synthSetVoice(c, transposePlaybackNote(getCursorNote(cursor)));
+      changed = true;
+    } else if (isCursorDone(cursor) && getSynthVoiceNote(c) != -1) {
+      synthSetVoice(c, -1);  // Slot cleared mid-note
+      changed = true;
+    }
+
+    if (!isCursorDone(cursor)) {
+      sounding = true;
+    }
+  }
+
+  if (changed) {
+    showSynthVoiceLEDs();
+  }
+
+  return sounding;
+}
+
 /**
  * Update playback (call in main loop)
  * @return true if still playing, false if finished
@@ -328,31 +1118,35 @@ bool updatePlayback() {
     return false;
   }
 
-  unsigned long current_time = millis();
-  unsigned long elapsed = current_time - playback_start_time;
-
-  // Check if current event should end
-  if (current_time >= next_event_time && current_timeline_index < timeline_event_count) {
-    stopNote();  // Stop previous note
+  if (playback_polyphonic) {
+    if (!updatePolyphonicPlayback()) {
+      stopPlayback();
+      return false;
+    }
+    return true;
+  }
 
-    // Get next event
-    TimelineEvent* event = &timeline[current_timeline_index];
+  unsigned long position = getPlaybackPosition();
 
-    // Wait until it's time for this event
-    if (elapsed >= event->timestamp_ms) {
-      // Play the note
-      playNote(event->note_index);
-      setNoteLED(event->note_index);
+  // Start the pending event once the clock reaches its timestamp
+  if (has_pending_event && position >= pending_event.timestamp_ms) {
+    PROFILE_PLAYBACK_LATE(millis() - getPlaybackTime(pending_event.timestamp_ms));
 
-      // Calculate when this note should end
-      next_event_time = playback_start_time + event->timestamp_ms + event->duration_ms;
+    // Hand the note to the note engine, which releases it on time
+    if (pending_event.duration_ms > 0) {
+      playPlaybackNote(pending_event.note_index,
+                       pending_event.timestamp_ms + pending_event.duration_ms);
+    }
 
-      current_timeline_index++;
+    // Fetch the following event and remember when it is due
+    has_pending_event = fetchNextPlaybackEvent(&pending_event);
+    if (has_pending_event) {
+      next_event_time = getPlaybackTime(pending_event.timestamp_ms);
     }
   }
 
-  // Check if playback is finished
-  if (current_timeline_index >= timeline_event_count && current_time >= next_event_time) {
+  // Check if playback is finished (last note released by the engine)
+  if (!has_pending_event && !isNoteSounding()) {
     stopPlayback();
     return false;
   }
@@ -368,6 +1162,14 @@ bool isPlaying() {
   return is_playing;
 }
 
+/**
+ * Check if playback merges the slots on the fly instead of playing the
+ * timeline (PS, or P / PA with more notes than the timeline holds)
+ */
+bool isPlaybackStreamed() {
+  return is_playing && playback_streaming && !playback_polyphonic;
+}
+
 /**
  * Get playback progress
  * @param out_current Output: current event index
@@ -379,6 +1181,17 @@ bool getPlaybackProgress(int* out_current, int* out_total) {
     return false;
   }
 
+  if (playback_streaming) {
+    // Progress in recorded events consumed across all merged slots
+    *out_current = 0;
+    *out_total = 0;
+    for (int c = 0; c < stream_cursor_count; c++) {
+      *out_current += stream_cursors[c].event_index;
+      *out_total += getSlotNoteCount(stream_cursors[c].slot_num);
+    }
+    return true;
+  }
+
   *out_current = current_timeline_index;
   *out_total = timeline_event_count;
   return true;
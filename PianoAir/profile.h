@@ -0,0 +1,162 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "hal.h"
+#include "config.h"
+
+// ============================================
+// TIMING INSTRUMENTATION
+// ============================================
+
+// With ENABLE_PROFILING, loop() timestamps the end of each stage and the
+// T command prints (then resets):
+// - time per loop() iteration (min / avg / max) and per stage (avg / max)
+// - echo-to-decision latency: from the echo ISR timestamping a sample to
+//   the note tracker having acted on it
+// - playback lateness: how far after its timestamp a note actually started
+// Times come from micros() (4 us resolution on a 16 MHz AVR); Timer1 is
+// busy with the synth. Without ENABLE_PROFILING the PROFILE_* macros
+// compile to nothing and no state is allocated.
+
+// Stages of loop(), in order
+enum ProfileStage {
+  PROFILE_SERIAL = 0,    // Serial input and text commands
+  PROFILE_PROTOCOL = 1,  // Binary protocol dumps
+  PROFILE_SENSOR = 2,    // Sensor trigger
+  PROFILE_STORAGE = 3,   // EEPROM saving
+  PROFILE_PLAYBACK = 4,  // Playback scheduling
+  PROFILE_NOTES = 5,     // Note engine
+  PROFILE_ECHOES = 6,    // Echo samples, note tracker, note handling
+  PROFILE_OUTPUT = 7,    // Queued serial text
+  NUM_PROFILE_STAGES = 8
+};
+
+// Histogram bins: bin 0 holds values below the unit, bin b holds
+// [unit << (b - 1), unit << b), the last bin everything above
+#define PROFILE_HISTOGRAM_BINS 8
+
+// Bin widths: echo latency in us, playback lateness in ms
+#define PROFILE_ECHO_UNIT_US 250
+#define PROFILE_LATE_UNIT_MS 1
+
+#if ENABLE_PROFILING
+
+/**
+ * Log2 histogram with sum and maximum
+ */
+struct ProfileHistogram {
+  uint16_t bins[PROFILE_HISTOGRAM_BINS];
+  unsigned long count;
+  unsigned long total;
+  unsigned long max;
+};
+
+/**
+ * Time spent in one loop() stage
+ */
+struct ProfileStageStats {
+  unsigned long total_us;
+  uint16_t max_us;
+};
+
+// ============================================
+// PROFILING STATE
+// ============================================
+
+ProfileStageStats profile_stages[NUM_PROFILE_STAGES];
+unsigned long profile_loops = 0;
+unsigned long profile_loop_total_us = 0;
+unsigned long profile_loop_min_us = 0xFFFFFFFFUL;
+unsigned long profile_loop_max_us = 0;
+
+ProfileHistogram profile_echo_latency;      // us
+ProfileHistogram profile_playback_late;     // ms
+
+// ============================================
+// RECORDING FUNCTIONS
+// ============================================
+
+/**
+ * Add a value to a histogram
+ * @param unit Width of the first bin
+ */
+void addProfileSample(ProfileHistogram* histogram, unsigned long value, unsigned long unit) {
+  uint8_t bin = 0;
+  for (unsigned long edge = unit; value >= edge && bin < PROFILE_HISTOGRAM_BINS - 1; edge <<= 1) {
+    bin++;
+  }
+  if (histogram->bins[bin] < 0xFFFF) {
+    histogram->bins[bin]++;
+  }
+  histogram->count++;
+  histogram->total += value;
+  if (value > histogram->max) {
+    histogram->max = value;
+  }
+}
+
+/**
+ * Charge the time since the previous mark to a stage
+ * @return New mark (now)
+ */
+unsigned long endProfileStage(ProfileStage stage, unsigned long mark) {
+  unsigned long now = micros();
+  unsigned long spent = now - mark;
+  ProfileStageStats* stats = &profile_stages[stage];
+  stats->total_us += spent;
+  if (spent > stats->max_us) {
+    stats->max_us = spent > 0xFFFF ? 0xFFFF : spent;
+  }
+  return now;
+}
+
+/**
+ * Record the length of a whole loop() iteration
+ */
+void endProfileLoop(unsigned long loop_start) {
+  unsigned long spent = micros() - loop_start;
+  profile_loops++;
+  profile_loop_total_us += spent;
+  if (spent < profile_loop_min_us) {
+    profile_loop_min_us = spent;
+  }
+  if (spent > profile_loop_max_us) {
+    profile_loop_max_us = spent;
+  }
+}
+
+/**
+ * Clear all statistics
+ */
+void resetProfile() {
+  memset(profile_stages, 0, sizeof(profile_stages));
+  memset(&profile_echo_latency, 0, sizeof(profile_echo_latency));
+  memset(&profile_playback_late, 0, sizeof(profile_playback_late));
+  profile_loops = 0;
+  profile_loop_total_us = 0;
+  profile_loop_min_us = 0xFFFFFFFFUL;
+  profile_loop_max_us = 0;
+}
+
+// Stage marks for loop(): one micros() call per stage
+#define PROFILE_LOOP_BEGIN() \
+  unsigned long profile_loop_start = micros(); \
+  unsigned long profile_mark = profile_loop_start
+#define PROFILE_STAGE(stage) profile_mark = endProfileStage(stage, profile_mark)
+#define PROFILE_LOOP_END() endProfileLoop(profile_loop_start)
+#define PROFILE_ECHO_HANDLED(sample_us) \
+  addProfileSample(&profile_echo_latency, micros() - (sample_us), PROFILE_ECHO_UNIT_US)
+#define PROFILE_PLAYBACK_LATE(late_ms) \
+  addProfileSample(&profile_playback_late, (late_ms), PROFILE_LATE_UNIT_MS)
+
+#else
+
+#define PROFILE_LOOP_BEGIN()
+#define PROFILE_STAGE(stage)
+#define PROFILE_LOOP_END()
+#define PROFILE_ECHO_HANDLED(sample_us)
+#define PROFILE_PLAYBACK_LATE(late_ms)
+
+#endif // ENABLE_PROFILING
+
+#endif // PROFILE_H
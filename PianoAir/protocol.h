@@ -0,0 +1,510 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include "hal.h"
+#include "config.h"
+#include "recording.h"
+#include "storage.h"
+#include "playback.h"
+#include "midi.h"
+
+// ============================================
+// BINARY SERIAL PROTOCOL
+// ============================================
+
+// Framed binary commands share the serial port with the text menu. A frame
+// starts with STX (0x02), which never appears in a text command, and is
+// only recognized at the start of a line:
+//   STX  length  command  payload[length]  crc8
+// The CRC-8 (polynomial 0x07, as in the EEPROM log) covers length, command
+// and payload. Multi-byte fields are little-endian. Replies use the same
+// framing; text printed by the sketch may appear between frames, so a
+// client skips bytes until the next STX.
+//
+// Commands (host to board) and replies:
+//   STATUS            -> STATUS reply
+//   SLOT_DUMP   slot  -> SLOT_DATA slot offset(2) bytes...  (repeated)
+//                        SLOT_END  slot length(2) notes(2)
+//   SLOT_LOAD_BEGIN slot                   -> ACK
+//   SLOT_LOAD_DATA  slot offset(2) bytes   -> ACK
+//   SLOT_LOAD_END   slot                   -> ACK notes(2)
+//   TIMELINE_DUMP     -> TIMELINE_DATA index(2) events...  (7 bytes each:
+//                        time(4) note duration(2)), TIMELINE_END count(2)
+//   MIDI_EXPORT slot  -> MIDI_DATA offset(4) bytes...  (repeated)
+//                        MIDI_END  length(4)
+//     slot 0-3 exports one slot; 0xFF exports all slots merged with the
+//     current overlap strategy. The bytes form a Standard MIDI File.
+// ACK is: command status [data]. Dumps stream from loop() whenever the
+// serial TX buffer has room for a whole frame, so they never block.
+// Slot data is the encoded format of recording.h; a dump loaded back
+// gives the same bytes. A load is aborted (the slot left empty) by a new
+// SLOT_LOAD_BEGIN, a stalled frame or a second without load frames.
+
+#define PROTO_STX 0x02
+
+// Payload bytes per frame: a frame (payload + 4) fits the 64-byte serial
+// buffers of the Uno, so the sketch never waits on a whole frame
+#define PROTO_MAX_PAYLOAD 48
+#define PROTO_FRAME_OVERHEAD 4
+
+// Slot bytes per SLOT_DATA / SLOT_LOAD_DATA frame (after slot and offset)
+#define PROTO_SLOT_CHUNK (PROTO_MAX_PAYLOAD - 3)
+
+// Timeline events per TIMELINE_DATA frame (after the index)
+#define PROTO_TIMELINE_EVENT_BYTES 7
+#define PROTO_TIMELINE_CHUNK ((PROTO_MAX_PAYLOAD - 2) / PROTO_TIMELINE_EVENT_BYTES)
+
+// A frame not completed within this time is dropped (ms)
+#define PROTO_RX_TIMEOUT_MS 100
+
+// A slot load with no frame for this long is aborted, so a client that
+// went away does not block recording (ms)
+#define PROTO_LOAD_TIMEOUT_MS 1000
+
+// 3: slot data carries semitone notes (see recording.h)
+#define PROTO_VERSION 3
+
+// Commands
+#define PROTO_CMD_STATUS          0x01
+#define PROTO_CMD_SLOT_DUMP       0x02
+#define PROTO_CMD_SLOT_LOAD_BEGIN 0x03
+#define PROTO_CMD_SLOT_LOAD_DATA  0x04
+#define PROTO_CMD_SLOT_LOAD_END   0x05
+#define PROTO_CMD_TIMELINE_DUMP   0x06
+#define PROTO_CMD_MIDI_EXPORT     0x07
+
+// Replies
+#define PROTO_RSP_ACK             0x80
+#define PROTO_RSP_STATUS          0x81
+#define PROTO_RSP_SLOT_DATA       0x82
+#define PROTO_RSP_SLOT_END        0x83
+#define PROTO_RSP_TIMELINE_DATA   0x84
+#define PROTO_RSP_TIMELINE_END    0x85
+#define PROTO_RSP_MIDI_DATA       0x86
+#define PROTO_RSP_MIDI_END        0x87
+
+// MIDI_EXPORT slot number for all slots merged
+#define PROTO_ALL_SLOTS 0xFF
+
+// ACK status codes
+#define PROTO_OK                  0
+#define PROTO_ERR_CRC             1   // Frame CRC mismatch
+#define PROTO_ERR_LENGTH          2   // Payload too long or too short
+#define PROTO_ERR_COMMAND         3   // Unknown command
+#define PROTO_ERR_ARGUMENT        4   // Bad slot number or offset
+#define PROTO_ERR_BUSY            5   // Recording, playing or a dump running
+#define PROTO_ERR_DATA            6   // Invalid encoded data or pool full
+
+// Receive state
+enum ProtoRxState {
+  PROTO_RX_IDLE = 0,      // Text mode, waiting for STX at a line start
+  PROTO_RX_LENGTH = 1,
+  PROTO_RX_COMMAND = 2,
+  PROTO_RX_PAYLOAD = 3,
+  PROTO_RX_CRC = 4
+};
+
+// Dump in progress
+enum ProtoDumpKind {
+  PROTO_DUMP_NONE = 0,
+  PROTO_DUMP_SLOT = 1,
+  PROTO_DUMP_TIMELINE = 2,
+  PROTO_DUMP_MIDI = 3
+};
+
+// ============================================
+// PROTOCOL STATE
+// ============================================
+
+ProtoRxState proto_rx_state = PROTO_RX_IDLE;
+uint8_t proto_rx_length = 0;
+uint8_t proto_rx_command = 0;
+uint8_t proto_rx_count = 0;
+uint8_t proto_rx_crc = 0;
+uint8_t proto_rx_payload[PROTO_MAX_PAYLOAD];
+unsigned long proto_rx_start_ms = 0;
+
+// Streaming dump
+ProtoDumpKind proto_dump_kind = PROTO_DUMP_NONE;
+uint8_t proto_dump_slot = 0;
+uint8_t proto_dump_revision = 0;       // Slot revision when the dump started
+uint16_t proto_dump_offset = 0;        // Bytes (or events) sent so far
+SlotReader proto_dump_reader;
+
+// Expected offset of the next SLOT_LOAD_DATA
+uint16_t proto_load_offset = 0;
+unsigned long proto_load_ms = 0;       // Last frame of the load in progress
+
+// Statistics
+unsigned long proto_frames_received = 0;
+unsigned long proto_frames_rejected = 0;
+
+// ============================================
+// FRAME OUTPUT
+// ============================================
+
+/**
+ * Send one frame
+ * @param command Reply code
+ * @param payload Payload bytes (may be NULL if length is 0)
+ * @param length Payload length (at most PROTO_MAX_PAYLOAD)
+ */
+void sendProtocolFrame(uint8_t command, const uint8_t* payload, uint8_t length) {
+  uint8_t crc = crc8Update(crc8Update(0, length), command);
+
+  Serial.write(PROTO_STX);
+  Serial.write(length);
+  Serial.write(command);
+  for (uint8_t i = 0; i < length; i++) {
+    Serial.write(payload[i]);
+    crc = crc8Update(crc, payload[i]);
+  }
+  Serial.write(crc);
+}
+
+/**
+ * Acknowledge a command
+ * @param command Command being answered
+ * @param status PROTO_OK or an error code
+ * @param value Extra 16-bit result (sent only with PROTO_OK)
+ */
+void sendProtocolAck(uint8_t command, uint8_t status, uint16_t value = 0) {
+  uint8_t payload[4] = { command, status, (uint8_t)value, (uint8_t)(value >> 8) };
+  sendProtocolFrame(PROTO_RSP_ACK, payload, status == PROTO_OK ? 4 : 2);
+}
+
+/**
+ * Store a 16-bit value little-endian
+ */
+void putProtocolWord(uint8_t* out, uint16_t value) {
+  out[0] = (uint8_t)value;
+  out[1] = (uint8_t)(value >> 8);
+}
+
+/**
+ * Read a 16-bit little-endian value
+ */
+uint16_t getProtocolWord(const uint8_t* in) {
+  return in[0] | ((uint16_t)in[1] << 8);
+}
+
+// ============================================
+// COMMAND HANDLERS
+// ============================================
+
+/**
+ * Reply with the device status
+ * Payload: version, mode, playing, recording, strategy, free pool bytes(2),
+ * slot count, then per slot: notes(2), bytes(2), revision.
+ */
+void sendProtocolStatus(OverlapStrategy strategy) {
+  uint8_t payload[8 + NUM_RECORDING_SLOTS * 5];
+
+  payload[0] = PROTO_VERSION;
+  payload[1] = current_mode;
+  payload[2] = isPlaying();
+  payload[3] = isRecording();
+  payload[4] = strategy;
+  putProtocolWord(&payload[5], getPoolFreeBytes(NULL));
+  payload[7] = NUM_RECORDING_SLOTS;
+
+  for (int i = 0; i < NUM_RECORDING_SLOTS; i++) {
+    uint8_t* entry = &payload[8 + i * 5];
+    putProtocolWord(&entry[0], getSlotNoteCount(i));
+    putProtocolWord(&entry[2], getSlotBytesUsed(i));
+    entry[4] = recording_slots[i].revision;
+  }
+
+  sendProtocolFrame(PROTO_RSP_STATUS, payload, sizeof(payload));
+}
+
+/**
+ * Handle a complete, CRC-checked frame
+ * @param strategy Current overlap strategy (for STATUS)
+ */
+void handleProtocolFrame(uint8_t command, const uint8_t* payload, uint8_t length,
+                         OverlapStrategy strategy) {
+  bool has_slot = length >= 1 && payload[0] < NUM_RECORDING_SLOTS;
+  uint8_t slot_num = length >= 1 ? payload[0] : 0;
+
+  switch (command) {
+    case PROTO_CMD_STATUS:
+      sendProtocolStatus(strategy);
+      break;
+
+    case PROTO_CMD_SLOT_DUMP:
+      if (!has_slot) {
+        sendProtocolAck(command, PROTO_ERR_ARGUMENT);
+      } else if (proto_dump_kind != PROTO_DUMP_NONE ||
+                 (isRecording() && slot_num == getActiveRecordingSlot())) {
+        sendProtocolAck(command, PROTO_ERR_BUSY);
+      } else {
+        proto_dump_kind = PROTO_DUMP_SLOT;
+        proto_dump_slot = slot_num;
+        proto_dump_revision = recording_slots[slot_num].revision;
+        proto_dump_offset = 0;
+        beginSlotRead(slot_num, &proto_dump_reader);
+      }
+      break;
+
+    case PROTO_CMD_TIMELINE_DUMP:
+      if (proto_dump_kind != PROTO_DUMP_NONE) {
+        sendProtocolAck(command, PROTO_ERR_BUSY);
+      } else {
+        proto_dump_kind = PROTO_DUMP_TIMELINE;
+        proto_dump_offset = 0;
+      }
+      break;
+
+    case PROTO_CMD_MIDI_EXPORT:
+      if (length < 1 || (!has_slot && slot_num != PROTO_ALL_SLOTS)) {
+        sendProtocolAck(command, PROTO_ERR_ARGUMENT);
+      } else if (proto_dump_kind != PROTO_DUMP_NONE ||
+                 !beginMidiExport(has_slot ? slot_num : -1, strategy)) {
+        sendProtocolAck(command, PROTO_ERR_BUSY);
+      } else {
+        proto_dump_kind = PROTO_DUMP_MIDI;
+      }
+      break;
+
+    case PROTO_CMD_SLOT_LOAD_BEGIN:
+      if (!has_slot) {
+        sendProtocolAck(command, PROTO_ERR_ARGUMENT);
+      } else if (isPlaying() || proto_dump_kind != PROTO_DUMP_NONE || !beginSlotLoad(slot_num)) {
+        sendProtocolAck(command, PROTO_ERR_BUSY);
+      } else {
+        proto_load_offset = 0;
+        proto_load_ms = millis();
+        sendProtocolAck(command, PROTO_OK);
+      }
+      break;
+
+    case PROTO_CMD_SLOT_LOAD_DATA:
+      if (length < 3 || slot_num != getLoadingSlot() ||
+          getProtocolWord(&payload[1]) != proto_load_offset) {
+        sendProtocolAck(command, PROTO_ERR_ARGUMENT);
+      } else if (!loadSlotBytes(&payload[3], length - 3)) {
+        sendProtocolAck(command, PROTO_ERR_DATA);
+      } else {
+        proto_load_offset += length - 3;
+        proto_load_ms = millis();
+        sendProtocolAck(command, PROTO_OK);
+      }
+      break;
+
+    case PROTO_CMD_SLOT_LOAD_END:
+      if (!has_slot || slot_num != getLoadingSlot()) {
+        sendProtocolAck(command, PROTO_ERR_ARGUMENT);
+      } else {
+        int notes = endSlotLoad();
+        if (notes < 0) {
+          sendProtocolAck(command, PROTO_ERR_DATA);
+        } else {
+          sendProtocolAck(command, PROTO_OK, notes);
+        }
+      }
+      break;
+
+    default:
+      sendProtocolAck(command, PROTO_ERR_COMMAND);
+      break;
+  }
+}
+
+// ============================================
+// STREAMING DUMPS
+// ============================================
+
+/**
+ * Send the next frame of a slot dump
+ * @return true when the dump is complete
+ */
+bool sendNextSlotDumpFrame() {
+  uint8_t payload[PROTO_MAX_PAYLOAD];
+  RecordingSlot* slot = &recording_slots[proto_dump_slot];
+
+  if (slot->revision != proto_dump_revision) {
+    sendProtocolAck(PROTO_CMD_SLOT_DUMP, PROTO_ERR_BUSY);  // Changed mid-dump
+    return true;
+  }
+
+  payload[0] = proto_dump_slot;
+
+  if (proto_dump_reader.remaining == 0) {
+    putProtocolWord(&payload[1], slot->data_length);
+    putProtocolWord(&payload[3], slot->note_count);
+    sendProtocolFrame(PROTO_RSP_SLOT_END, payload, 5);
+    return true;
+  }
+
+  uint8_t count = 0;
+  putProtocolWord(&payload[1], proto_dump_offset);
+  while (count < PROTO_SLOT_CHUNK && proto_dump_reader.remaining > 0) {
+    payload[3 + count++] = readSlotByte(&proto_dump_reader);
+  }
+  proto_dump_offset += count;
+  sendProtocolFrame(PROTO_RSP_SLOT_DATA, payload, 3 + count);
+  return false;
+}
+
+/**
+ * Send the next frame of a timeline dump
+ * @return true when the dump is complete
+ */
+bool sendNextTimelineDumpFrame() {
+  uint8_t payload[PROTO_MAX_PAYLOAD];
+
+  if (proto_dump_offset >= timeline_event_count) {
+    putProtocolWord(&payload[0], timeline_event_count);
+    sendProtocolFrame(PROTO_RSP_TIMELINE_END, payload, 2);
+    return true;
+  }
+
+  uint8_t length = 2;
+  putProtocolWord(&payload[0], proto_dump_offset);
+  for (uint8_t i = 0; i < PROTO_TIMELINE_CHUNK && proto_dump_offset < timeline_event_count; i++) {
+    const TimelineEvent& event = timeline[proto_dump_offset++];
+    putProtocolWord(&payload[length], (uint16_t)event.timestamp_ms);
+    putProtocolWord(&payload[length + 2], (uint16_t)(event.timestamp_ms >> 16));
+    payload[length + 4] = event.note_index;
+    putProtocolWord(&payload[length + 5], event.duration_ms);
+    length += PROTO_TIMELINE_EVENT_BYTES;
+  }
+  sendProtocolFrame(PROTO_RSP_TIMELINE_DATA, payload, length);
+  return false;
+}
+
+/**
+ * Send the next frame of a MIDI file export
+ * @return true when the export is complete
+ */
+bool sendNextMidiExportFrame() {
+  uint8_t payload[PROTO_MAX_PAYLOAD];
+
+  if (!isMidiExportValid()) {
+    endMidiExport();
+    sendProtocolAck(PROTO_CMD_MIDI_EXPORT, PROTO_ERR_BUSY);  // Changed mid-export
+    return true;
+  }
+
+  unsigned long offset = midi_export_offset;
+  uint8_t count = readMidiExport(&payload[4], PROTO_MAX_PAYLOAD - 4);
+  if (count == 0) {
+    putProtocolWord(&payload[0], (uint16_t)offset);
+    putProtocolWord(&payload[2], (uint16_t)(offset >> 16));
+    endMidiExport();
+    sendProtocolFrame(PROTO_RSP_MIDI_END, payload, 4);
+    return true;
+  }
+
+  putProtocolWord(&payload[0], (uint16_t)offset);
+  putProtocolWord(&payload[2], (uint16_t)(offset >> 16));
+  sendProtocolFrame(PROTO_RSP_MIDI_DATA, payload, 4 + count);
+  return false;
+}
+
+// ============================================
+// PUBLIC FUNCTIONS
+// ============================================
+
+/**
+ * Offer a received serial byte to the protocol
+ * @param c Byte read from Serial
+ * @param at_line_start No text command is being typed
+ * @param strategy Current overlap strategy (for STATUS)
+ * @return true if the byte belongs to a frame (not text)
+ */
+bool protocolReceiveByte(uint8_t c, bool at_line_start, OverlapStrategy strategy) {
+  switch (proto_rx_state) {
+    case PROTO_RX_IDLE:
+      if (c != PROTO_STX || !at_line_start) {
+        return false;
+      }
+      proto_rx_state = PROTO_RX_LENGTH;
+      proto_rx_start_ms = millis();
+      break;
+
+    case PROTO_RX_LENGTH:
+      if (c > PROTO_MAX_PAYLOAD) {
+        proto_frames_rejected++;
+        sendProtocolAck(0, PROTO_ERR_LENGTH);
+        proto_rx_state = PROTO_RX_IDLE;
+        break;
+      }
+      proto_rx_length = c;
+      proto_rx_crc = crc8Update(0, c);
+      proto_rx_state = PROTO_RX_COMMAND;
+      break;
+
+    case PROTO_RX_COMMAND:
+      proto_rx_command = c;
+      proto_rx_crc = crc8Update(proto_rx_crc, c);
+      proto_rx_count = 0;
+      proto_rx_state = proto_rx_length > 0 ? PROTO_RX_PAYLOAD : PROTO_RX_CRC;
+      break;
+
+    case PROTO_RX_PAYLOAD:
+      proto_rx_payload[proto_rx_count++] = c;
+      proto_rx_crc = crc8Update(proto_rx_crc, c);
+      if (proto_rx_count == proto_rx_length) {
+        proto_rx_state = PROTO_RX_CRC;
+      }
+      break;
+
+    case PROTO_RX_CRC:
+      proto_rx_state = PROTO_RX_IDLE;
+      if (c != proto_rx_crc) {
+        proto_frames_rejected++;
+        sendProtocolAck(proto_rx_command, PROTO_ERR_CRC);
+      } else {
+        proto_frames_received++;
+        handleProtocolFrame(proto_rx_command, proto_rx_payload, proto_rx_length, strategy);
+      }
+      break;
+  }
+
+  return true;
+}
+
+/**
+ * Drop stalled frames and loads and stream dump frames (call in main loop)
+ */
+void updateProtocol() {
+  if (proto_rx_state != PROTO_RX_IDLE && millis() - proto_rx_start_ms > PROTO_RX_TIMEOUT_MS) {
+    proto_rx_state = PROTO_RX_IDLE;
+    proto_frames_rejected++;
+    abortSlotLoad();  // The client stalled mid-frame
+  }
+  if (getLoadingSlot() != -1 && millis() - proto_load_ms > PROTO_LOAD_TIMEOUT_MS) {
+    abortSlotLoad();
+  }
+
+  // Only whole frames, and only when they fit the TX buffer without waiting
+  while (proto_dump_kind != PROTO_DUMP_NONE &&
+         Serial.availableForWrite() >= PROTO_MAX_PAYLOAD + PROTO_FRAME_OVERHEAD) {
+    bool done;
+    switch (proto_dump_kind) {
+      case PROTO_DUMP_SLOT:
+        done = sendNextSlotDumpFrame();
+        break;
+      case PROTO_DUMP_TIMELINE:
+        done = sendNextTimelineDumpFrame();
+        break;
+      default:
+        done = sendNextMidiExportFrame();
+        break;
+    }
+    if (done) {
+      proto_dump_kind = PROTO_DUMP_NONE;
+    }
+  }
+}
+
+/**
+ * Check whether a frame is being received or a dump is being sent
+ */
+bool isProtocolBusy() {
+  return proto_rx_state != PROTO_RX_IDLE || proto_dump_kind != PROTO_DUMP_NONE;
+}
+
+#endif // PROTOCOL_H
@@ -1,7 +1,7 @@
 #ifndef RECORDING_H
 #define RECORDING_H
 
-#include <Arduino.h>
+#include "hal.h"
 #include "config.h"
 #include "note_mapping.h"
 
@@ -13,7 +13,7 @@
  * Represents a single note event in a recording
  */
 struct NoteEvent {
-  uint8_t note_index;        // Note index (0-7)
+  uint8_t note_index;        // Note (pitch, 0 to NUM_NOTES - 1; scale independent)
   uint8_t duration_units;    // Duration in DURATION_UNIT_MS units (100ms each)
 
   NoteEvent() : note_index(0), duration_units(0) {}
@@ -22,21 +22,90 @@ struct NoteEvent {
     : note_index(note), duration_units(duration) {}
 };
 
+// ============================================
+// EVENT ENCODING
+// ============================================
+
+// Events are stored bit-packed; the first byte selects the form:
+//   0sssdddd             previous note + s - 4, duration d (0-15 units)   1 byte
+//   10nnnnnn dddddddd    note n, duration d (0-255 units)                 2 bytes
+//   10111111 dddddddd    rest of d units (0-255)                          2 bytes
+//   11rrrrrr             previous note event repeated r + 1 times (1-64)  1 byte
+// Notes are pitches, so a step of up to 4 semitones down or 3 up (every
+// step of the scales, most thirds) fits the short form. Before the first
+// event the previous note is EVENT_START_NOTE. A rest is skipped over by
+// steps and repeats: they refer to the last note before it. Only timed
+// takes (the looper) write rests; elsewhere a note lasts until the next.
+#define EVENT_LONG_FORM 0x80
+#define EVENT_REPEAT_FORM 0xC0
+#define EVENT_FORM_MASK 0xC0
+#define EVENT_SHORT_MAX_DURATION 15
+#define EVENT_STEP_BIAS 4
+#define EVENT_STEP_MAX 3
+#define EVENT_NOTE_MASK 0x3F
+#define EVENT_START_NOTE NOTE_C5
+#define EVENT_REST_NOTE EVENT_NOTE_MASK
+#define EVENT_MAX_REPEAT 64
+
+// Note of a decoded rest event (not a pitch: nothing sounds)
+#define NOTE_REST EVENT_REST_NOTE
+
+// Worst-case size of one encoded event
+#define MAX_ENCODED_EVENT_BYTES 2
+
+// End of a block chain / empty slot
+#define POOL_NO_BLOCK 0xFF
+
 /**
  * Represents a recording slot
+ * The encoded events live in a chain of pool blocks (head to tail).
  */
 struct RecordingSlot {
-  NoteEvent events[MAX_NOTES_PER_SLOT];  // Array of note events
-  int note_count;                         // Number of notes in this recording
-  bool is_active;                         // Whether this slot contains a recording
+  uint8_t head_block;             // First block, or POOL_NO_BLOCK
+  uint8_t tail_block;             // Block receiving new bytes
+  uint16_t data_length;           // Encoded bytes in the chain
+  int note_count;                 // Number of notes in this recording (rests not counted)
+  bool is_active;                 // Whether this slot contains a recording
+
+  // Encoder state for run-length repeats
+  uint8_t last_note;              // Last encoded note (steps are taken from it)
+  uint8_t last_duration;          // Last encoded duration
+  uint8_t repeat_block;           // Block of the open repeat byte, or POOL_NO_BLOCK
+  uint8_t repeat_offset;          // Offset of the open repeat byte in repeat_block
+
+  uint8_t revision;               // Bumped whenever the slot is cleared or re-recorded
+
+  RecordingSlot()
+    : head_block(POOL_NO_BLOCK), tail_block(POOL_NO_BLOCK), data_length(0),
+      note_count(0), is_active(false), last_note(0), last_duration(0),
+      repeat_block(POOL_NO_BLOCK), repeat_offset(0), revision(0) {}
+};
 
-  RecordingSlot() : note_count(0), is_active(false) {}
+/**
+ * Sequential decoder over the events of a recording slot
+ */
+struct SlotReader {
+  const RecordingSlot* slot;      // Slot being decoded
+  uint8_t block;                  // Block holding the next byte
+  uint8_t offset;                 // Next byte within block
+  uint16_t remaining;             // Encoded bytes left to decode
+  uint8_t repeat_left;            // Pending repeats of current
+  NoteEvent current;              // Last decoded note (rests are not kept)
+
+  SlotReader()
+    : slot(NULL), block(POOL_NO_BLOCK), offset(0), remaining(0), repeat_left(0) {}
 };
 
 // ============================================
 // RECORDING STATE
 // ============================================
 
+// Shared event pool: block data, chain links and the free list
+uint8_t pool_blocks[POOL_NUM_BLOCKS][POOL_BLOCK_BYTES];
+uint8_t pool_next[POOL_NUM_BLOCKS];
+uint8_t pool_free_head = POOL_NO_BLOCK;
+uint8_t pool_free_count = 0;
+
 // Array of recording slots
 RecordingSlot recording_slots[NUM_RECORDING_SLOTS];
 
@@ -46,6 +115,334 @@ int active_recording_slot = -1;
 unsigned long recording_start_time = 0;
 unsigned long last_note_time = 0;
 int last_note_index = -1;
+bool last_note_released = false;   // Hand lifted since the last note started
+
+// Timed take (see startTimedRecording): events sit on a grid of
+// DURATION_UNIT_MS from recording_start_time, silences are rests
+bool recording_timed = false;
+unsigned long recorded_units = 0;  // Grid position reached by the encoded events
+
+// Slot being filled from encoded bytes (see beginSlotLoad), -1 if none
+int loading_slot = -1;
+uint8_t load_long_header = 0;      // First byte of a long event split across calls
+
+// ============================================
+// EVENT POOL FUNCTIONS
+// ============================================
+
+/**
+ * Put every pool block on the free list
+ */
+void initializeEventPool() {
+  for (int i = 0; i < POOL_NUM_BLOCKS; i++) {
+    pool_next[i] = (i + 1 < POOL_NUM_BLOCKS) ? i + 1 : POOL_NO_BLOCK;
+  }
+  pool_free_head = 0;
+  pool_free_count = POOL_NUM_BLOCKS;
+}
+
+/**
+ * Get number of pool blocks a slot holds
+ * Blocks are only taken when a byte is written, so this follows from the length.
+ */
+uint8_t getSlotBlockCount(const RecordingSlot* slot) {
+  return (slot->data_length + POOL_BLOCK_BYTES - 1) / POOL_BLOCK_BYTES;
+}
+
+/**
+ * Get how many more bytes a slot can append
+ * @param slot Slot to check
+ * @return Free bytes in its tail block plus the free pool
+ */
+uint16_t getSlotRoom(const RecordingSlot* slot) {
+  uint16_t room = (uint16_t)pool_free_count * POOL_BLOCK_BYTES;
+  uint8_t tail_used = slot->data_length % POOL_BLOCK_BYTES;
+
+  if (tail_used != 0) {
+    room += POOL_BLOCK_BYTES - tail_used;
+  }
+  return room;
+}
+
+/**
+ * Append one byte to a slot, taking a block from the pool when needed
+ * Callers check getSlotRoom() first.
+ * @param slot Slot to write
+ * @param value Byte to append
+ */
+void appendSlotByte(RecordingSlot* slot, uint8_t value) {
+  uint8_t offset = slot->data_length % POOL_BLOCK_BYTES;
+
+  if (offset == 0) {
+    // Tail block full (or no block yet): link a free one
+    uint8_t block = pool_free_head;
+    pool_free_head = pool_next[block];
+    pool_free_count--;
+    pool_next[block] = POOL_NO_BLOCK;
+
+    if (slot->head_block == POOL_NO_BLOCK) {
+      slot->head_block = block;
+    } else {
+      pool_next[slot->tail_block] = block;
+    }
+    slot->tail_block = block;
+  }
+
+  pool_blocks[slot->tail_block][offset] = value;
+  slot->data_length++;
+}
+
+/**
+ * Return a slot's blocks to the pool and reset it to empty
+ */
+void resetSlotData(RecordingSlot* slot) {
+  if (slot->head_block != POOL_NO_BLOCK) {
+    // Splice the whole chain onto the free list
+    pool_next[slot->tail_block] = pool_free_head;
+    pool_free_head = slot->head_block;
+    pool_free_count += getSlotBlockCount(slot);
+  }
+
+  slot->head_block = POOL_NO_BLOCK;
+  slot->tail_block = POOL_NO_BLOCK;
+  slot->data_length = 0;
+  slot->note_count = 0;
+  slot->is_active = false;
+  slot->repeat_block = POOL_NO_BLOCK;
+  slot->revision++;
+}
+
+// ============================================
+// EVENT ENCODING FUNCTIONS
+// ============================================
+
+/**
+ * Get the note the next event of a slot steps from
+ */
+uint8_t getSlotStepBase(const RecordingSlot* slot) {
+  return slot->note_count > 0 ? slot->last_note : EVENT_START_NOTE;
+}
+
+/**
+ * Append one note event to a slot in bit-packed form
+ * @param slot Slot to write
+ * @param note Note (0 to NUM_NOTES - 1)
+ * @param duration Duration in DURATION_UNIT_MS units
+ * @return true if the event fitted
+ */
+bool encodeNoteEvent(RecordingSlot* slot, uint8_t note, uint8_t duration) {
+  // Same as the previous event: extend or open a repeat run
+  if (slot->note_count > 0 && note == slot->last_note && duration == slot->last_duration) {
+    if (slot->repeat_block != POOL_NO_BLOCK) {
+      uint8_t* repeat = &pool_blocks[slot->repeat_block][slot->repeat_offset];
+      if ((*repeat & ~EVENT_FORM_MASK) < EVENT_MAX_REPEAT - 1) {
+        (*repeat)++;
+        slot->note_count++;
+        return true;
+      }
+    }
+
+    if (getSlotRoom(slot) < 1) {
+      return false;
+    }
+    appendSlotByte(slot, EVENT_REPEAT_FORM);  // One repeat
+    slot->repeat_block = slot->tail_block;
+    slot->repeat_offset = (slot->data_length - 1) % POOL_BLOCK_BYTES;
+    slot->note_count++;
+    return true;
+  }
+
+  int step = (int)note - getSlotStepBase(slot);
+
+  if (duration <= EVENT_SHORT_MAX_DURATION && step >= -EVENT_STEP_BIAS && step <= EVENT_STEP_MAX) {
+    if (getSlotRoom(slot) < 1) {
+      return false;
+    }
+    appendSlotByte(slot, ((step + EVENT_STEP_BIAS) << 4) | duration);
+  } else {
+    if (getSlotRoom(slot) < 2) {
+      return false;
+    }
+    appendSlotByte(slot, EVENT_LONG_FORM | note);
+    appendSlotByte(slot, duration);
+  }
+
+  slot->last_note = note;
+  slot->last_duration = duration;
+  slot->repeat_block = POOL_NO_BLOCK;
+  slot->note_count++;
+
+  return true;
+}
+
+/**
+ * Append a rest to a slot
+ * Steps and repeats after it still refer to the last note.
+ * @param slot Slot to write
+ * @param duration Duration in DURATION_UNIT_MS units
+ * @return true if the event fitted
+ */
+bool encodeRestEvent(RecordingSlot* slot, uint8_t duration) {
+  if (getSlotRoom(slot) < 2) {
+    return false;
+  }
+  appendSlotByte(slot, EVENT_LONG_FORM | EVENT_REST_NOTE);
+  appendSlotByte(slot, duration);
+
+  // A repeat run must not reach back across the rest
+  slot->repeat_block = POOL_NO_BLOCK;
+
+  return true;
+}
+
+/**
+ * Start decoding a slot from its first event
+ * @param slot_num Slot number
+ * @param reader Output: reader positioned at the first event
+ * @return true if the slot number is valid
+ */
+bool beginSlotRead(int slot_num, SlotReader* reader) {
+  reader->slot = NULL;
+  reader->block = POOL_NO_BLOCK;
+  reader->offset = 0;
+  reader->remaining = 0;
+  reader->repeat_left = 0;
+  reader->current = NoteEvent(EVENT_START_NOTE, 0);
+
+  if (slot_num < 0 || slot_num >= NUM_RECORDING_SLOTS) {
+    return false;
+  }
+
+  reader->slot = &recording_slots[slot_num];
+  reader->block = reader->slot->head_block;
+  reader->remaining = reader->slot->data_length;
+  return true;
+}
+
+/**
+ * Read the next encoded byte of a slot, following the block chain
+ */
+uint8_t readSlotByte(SlotReader* reader) {
+  uint8_t value = pool_blocks[reader->block][reader->offset++];
+
+  if (reader->offset == POOL_BLOCK_BYTES) {
+    reader->block = pool_next[reader->block];
+    reader->offset = 0;
+  }
+  reader->remaining--;
+
+  return value;
+}
+
+/**
+ * Decode the next event of a slot
+ * @param reader Reader from beginSlotRead()
+ * @param out Output: next note event (note_index NOTE_REST for a rest)
+ * @return true if an event was decoded, false at the end of the slot
+ */
+bool readNextEvent(SlotReader* reader, NoteEvent* out) {
+  if (reader->repeat_left > 0) {
+    reader->repeat_left--;
+    *out = reader->current;
+    return true;
+  }
+
+  if (reader->remaining == 0) {
+    return false;
+  }
+
+  uint8_t head = readSlotByte(reader);
+
+  if ((head & EVENT_LONG_FORM) == 0) {
+    uint8_t note = reader->current.note_index + ((head >> 4) & 0x07) - EVENT_STEP_BIAS;
+    reader->current = NoteEvent(note, head & 0x0F);
+  } else if (head == (EVENT_LONG_FORM | EVENT_REST_NOTE)) {
+    *out = NoteEvent(NOTE_REST, readSlotByte(reader));
+    return true;  // current stays the last note
+  } else if ((head & EVENT_FORM_MASK) == EVENT_LONG_FORM) {
+    reader->current = NoteEvent(head & EVENT_NOTE_MASK, readSlotByte(reader));
+  } else {
+    reader->repeat_left = head & ~EVENT_FORM_MASK;  // r + 1 repeats, one returned now
+  }
+
+  *out = reader->current;
+  return true;
+}
+
+/**
+ * Convert an elapsed time to duration units
+ * @param duration_ms Elapsed time in milliseconds
+ * @param min_units Smallest duration to return
+ * @return Duration in units, clamped to MAX_NOTE_DURATION_UNITS
+ */
+uint8_t msToDurationUnits(unsigned long duration_ms, uint8_t min_units) {
+  unsigned long units = duration_ms / DURATION_UNIT_MS;
+
+  if (units < min_units) {
+    units = min_units;
+  }
+  if (units > MAX_NOTE_DURATION_UNITS) {
+    units = MAX_NOTE_DURATION_UNITS;
+  }
+
+  return (uint8_t)units;
+}
+
+// ============================================
+// TIMED TAKE FUNCTIONS
+// ============================================
+
+// A timed take places every event on a grid of DURATION_UNIT_MS counted
+// from a start time the caller provides (the looper's pass start), instead
+// of chaining note lengths: a note ends when the hand lifts, the silence
+// up to the next note is a rest, and each position is rounded from the
+// start time, so rounding never adds up over the take.
+
+/**
+ * Get the grid position of a time in the timed take
+ * @return Units since recording_start_time, rounded to the nearest
+ */
+unsigned long getTakeUnits(unsigned long time) {
+  return (time - recording_start_time + DURATION_UNIT_MS / 2) / DURATION_UNIT_MS;
+}
+
+/**
+ * Encode rests up to a grid position of the timed take
+ * @return false if the pool is full
+ */
+bool encodeTakeRests(RecordingSlot* slot, unsigned long until_units) {
+  while (recorded_units < until_units) {
+    unsigned long units = until_units - recorded_units;
+    if (units > MAX_NOTE_DURATION_UNITS) {
+      units = MAX_NOTE_DURATION_UNITS;
+    }
+    if (!encodeRestEvent(slot, units)) {
+      return false;
+    }
+    recorded_units += units;
+  }
+  return true;
+}
+
+/**
+ * Encode the note sounding in the timed take, ending at a given time
+ * (space for it was reserved when it started)
+ */
+void endTakeNote(RecordingSlot* slot, unsigned long time) {
+  if (last_note_index == -1) {
+    return;
+  }
+
+  unsigned long end_units = getTakeUnits(time);
+  unsigned long units = end_units > recorded_units ? end_units - recorded_units : 1;
+  if (units > MAX_NOTE_DURATION_UNITS) {
+    units = MAX_NOTE_DURATION_UNITS;
+  }
+
+  encodeNoteEvent(slot, last_note_index, units);
+  recorded_units += units;
+  last_note_index = -1;
+}
 
 // ============================================
 // RECORDING MANAGEMENT FUNCTIONS
@@ -55,9 +452,9 @@ int last_note_index = -1;
  * Initialize recording system
  */
 void initializeRecordingSystem() {
+  initializeEventPool();
   for (int i = 0; i < NUM_RECORDING_SLOTS; i++) {
-    recording_slots[i].note_count = 0;
-    recording_slots[i].is_active = false;
+    recording_slots[i] = RecordingSlot();
   }
   is_recording = false;
   active_recording_slot = -1;
@@ -73,13 +470,12 @@ bool startRecording(int slot_num) {
     return false;  // Invalid slot
   }
 
-  if (is_recording) {
-    return false;  // Already recording
+  if (is_recording || loading_slot != -1) {
+    return false;  // Already recording or loading
   }
 
   // Clear the slot
-  recording_slots[slot_num].note_count = 0;
-  recording_slots[slot_num].is_active = false;
+  resetSlotData(&recording_slots[slot_num]);
 
   // Start recording
   is_recording = true;
@@ -87,6 +483,27 @@ bool startRecording(int slot_num) {
   recording_start_time = millis();
   last_note_time = recording_start_time;
   last_note_index = -1;
+  last_note_released = false;
+  recording_timed = false;
+
+  return true;
+}
+
+/**
+ * Start a timed take: events are placed relative to start_time
+ * @param slot_num Slot number (0 to NUM_RECORDING_SLOTS-1)
+ * @param start_time Time position 0 of the take (millis, may be past)
+ * @return true if recording started successfully
+ */
+bool startTimedRecording(int slot_num, unsigned long start_time) {
+  if (!startRecording(slot_num)) {
+    return false;
+  }
+
+  recording_timed = true;
+  recording_start_time = start_time;
+  last_note_time = start_time;
+  recorded_units = 0;
 
   return true;
 }
@@ -100,38 +517,53 @@ bool stopRecording() {
     return false;  // Not recording
   }
 
-  // Finalize the last note if there was one
-  if (last_note_index != -1 && active_recording_slot >= 0) {
-    unsigned long current_time = millis();
-    unsigned long duration_ms = current_time - last_note_time;
-    uint8_t duration_units = duration_ms / DURATION_UNIT_MS;
-
-    if (duration_units > MAX_NOTE_DURATION_UNITS) {
-      duration_units = MAX_NOTE_DURATION_UNITS;
-    }
+  RecordingSlot* slot = &recording_slots[active_recording_slot];
 
-    // Update the last note's duration
-    RecordingSlot* slot = &recording_slots[active_recording_slot];
-    if (slot->note_count > 0) {
-      slot->events[slot->note_count - 1].duration_units = duration_units;
-    }
+  // Encode the note still sounding, now that its duration is known
+  // (space for it was reserved when it started)
+  if (recording_timed) {
+    endTakeNote(slot, millis());
+  } else if (last_note_index != -1) {
+    encodeNoteEvent(slot, last_note_index, msToDurationUnits(millis() - last_note_time, 0));
   }
 
   // Mark slot as active if it has notes
-  if (active_recording_slot >= 0 && recording_slots[active_recording_slot].note_count > 0) {
-    recording_slots[active_recording_slot].is_active = true;
+  if (slot->note_count > 0) {
+    slot->is_active = true;
   }
 
   is_recording = false;
   active_recording_slot = -1;
   last_note_index = -1;
+  recording_timed = false;
 
   return true;
 }
 
+/**
+ * Stop a timed take, padding it with rest up to a given time
+ * A note still sounding ends now, or at end_time if that has passed.
+ * @param end_time End of the take (millis), e.g. the end of a loop pass
+ * @return true if a timed take was stopped
+ */
+bool stopTimedRecording(unsigned long end_time) {
+  if (!is_recording || !recording_timed) {
+    return false;
+  }
+
+  RecordingSlot* slot = &recording_slots[active_recording_slot];
+  unsigned long now = millis();
+  endTakeNote(slot, (long)(now - end_time) < 0 ? now : end_time);
+  encodeTakeRests(slot, getTakeUnits(end_time));  // Best effort if the pool is full
+
+  return stopRecording();
+}
+
 /**
  * Add a note to the current recording
- * @param note_index Note index (0-7)
+ * A note is encoded when the next one starts (or recording stops), once
+ * its duration is known; until then it stays in last_note_index.
+ * @param note_index Note (0 to NUM_NOTES - 1)
  * @return true if note was added successfully
  */
 bool addNoteToRecording(int note_index) {
@@ -143,53 +575,58 @@ bool addNoteToRecording(int note_index) {
     return false;  // Invalid note
   }
 
-  RecordingSlot* slot = &recording_slots[active_recording_slot];
+  // Same note as last (and not lifted in between): just extend its duration
+  if (last_note_index == note_index && !last_note_released) {
+    return true;
+  }
 
+  RecordingSlot* slot = &recording_slots[active_recording_slot];
   unsigned long current_time = millis();
 
-  // If this is a different note than the last one, save the previous note
-  if (last_note_index != -1 && last_note_index != note_index) {
-    // Calculate duration of the previous note
-    unsigned long duration_ms = current_time - last_note_time;
-    uint8_t duration_units = duration_ms / DURATION_UNIT_MS;
-
-    if (duration_units == 0) {
-      duration_units = 1;  // Minimum duration
-    }
-    if (duration_units > MAX_NOTE_DURATION_UNITS) {
-      duration_units = MAX_NOTE_DURATION_UNITS;
-    }
-
-    // Update the last note's duration
-    if (slot->note_count > 0) {
-      slot->events[slot->note_count - 1].duration_units = duration_units;
-    }
-
-    // Add new note
-    if (slot->note_count < MAX_NOTES_PER_SLOT) {
-      slot->events[slot->note_count] = NoteEvent(note_index, 0);
-      slot->note_count++;
-      last_note_time = current_time;
-      last_note_index = note_index;
-    } else {
-      // Buffer full - stop recording
+  if (recording_timed) {
+    // Close the previous note here and fill the silence since with rests
+    endTakeNote(slot, current_time);
+    if (!encodeTakeRests(slot, getTakeUnits(current_time))) {
       stopRecording();
       return false;
     }
-  } else if (last_note_index == -1) {
-    // First note in recording
-    if (slot->note_count < MAX_NOTES_PER_SLOT) {
-      slot->events[slot->note_count] = NoteEvent(note_index, 0);
-      slot->note_count++;
-      last_note_time = current_time;
-      last_note_index = note_index;
-    }
+  } else if (last_note_index != -1) {
+    // Encode the previous note now that its duration is known
+    encodeNoteEvent(slot, last_note_index, msToDurationUnits(current_time - last_note_time, 1));
+    last_note_index = -1;
+  }
+
+  // Keep room to encode the new note when it ends (and, in a timed take,
+  // the rest that closes the take)
+  uint8_t reserve = recording_timed ? 2 * MAX_ENCODED_EVENT_BYTES : MAX_ENCODED_EVENT_BYTES;
+  if (getSlotRoom(slot) < reserve) {
+    // Pool full - stop recording
+    stopRecording();
+    return false;
   }
-  // If same note as last, just extend its duration (will be calculated when next note comes)
+
+  last_note_index = note_index;
+  last_note_time = current_time;
+  last_note_released = false;
 
   return true;
 }
 
+/**
+ * Mark the current note as released (hand lifted)
+ * The note keeps its duration until the next note starts, but playing the
+ * same note again then records a new event instead of extending it. In a
+ * timed take the note ends here instead.
+ */
+void releaseNoteInRecording() {
+  if (is_recording) {
+    last_note_released = true;
+    if (recording_timed) {
+      endTakeNote(&recording_slots[active_recording_slot], millis());
+    }
+  }
+}
+
 /**
  * Clear a recording slot
  * @param slot_num Slot number (0 to NUM_RECORDING_SLOTS-1)
@@ -200,8 +637,7 @@ bool clearRecordingSlot(int slot_num) {
     return false;
   }
 
-  recording_slots[slot_num].note_count = 0;
-  recording_slots[slot_num].is_active = false;
+  resetSlotData(&recording_slots[slot_num]);
 
   return true;
 }
@@ -215,6 +651,125 @@ void clearAllRecordings() {
   }
 }
 
+// ============================================
+// SLOT LOADING FUNCTIONS
+// ============================================
+
+// A slot can also be filled from encoded bytes received over the serial
+// protocol (protocol.h). The bytes are decoded and encoded again, so a slot
+// always holds valid canonical data and its encoder state (repeat runs)
+// stays consistent. Like a recording, the slot is not saved to EEPROM
+// until the load ends.
+
+/**
+ * Drop an unfinished load: the slot is left empty
+ */
+void abortSlotLoad() {
+  if (loading_slot == -1) {
+    return;
+  }
+
+  resetSlotData(&recording_slots[loading_slot]);
+  loading_slot = -1;
+  load_long_header = 0;
+}
+
+/**
+ * Start replacing a slot's contents with encoded bytes
+ * A load still in progress is aborted first.
+ * @param slot_num Slot number (0 to NUM_RECORDING_SLOTS-1)
+ * @return true if loading started (not while recording)
+ */
+bool beginSlotLoad(int slot_num) {
+  if (slot_num < 0 || slot_num >= NUM_RECORDING_SLOTS || is_recording) {
+    return false;
+  }
+
+  abortSlotLoad();
+  resetSlotData(&recording_slots[slot_num]);
+  loading_slot = slot_num;
+  load_long_header = 0;
+
+  return true;
+}
+
+/**
+ * Append encoded bytes to the slot being loaded
+ * A long event may be split between two calls.
+ * @param data Encoded events (recording.h format)
+ * @param count Number of bytes
+ * @return false if the data is invalid or the pool is full (load aborted)
+ */
+bool loadSlotBytes(const uint8_t* data, uint8_t count) {
+  if (loading_slot == -1) {
+    return false;
+  }
+
+  RecordingSlot* slot = &recording_slots[loading_slot];
+  bool ok = true;
+
+  for (uint8_t i = 0; i < count && ok; i++) {
+    uint8_t value = data[i];
+
+    if (load_long_header != 0) {
+      uint8_t note = load_long_header & EVENT_NOTE_MASK;
+      if (note == EVENT_REST_NOTE) {
+        ok = encodeRestEvent(slot, value);
+      } else {
+        ok = note < NUM_NOTES && encodeNoteEvent(slot, note, value);
+      }
+      load_long_header = 0;
+    } else if ((value & EVENT_LONG_FORM) == 0) {
+      int note = getSlotStepBase(slot) + ((value >> 4) & 0x07) - EVENT_STEP_BIAS;
+      ok = note >= 0 && note < NUM_NOTES && encodeNoteEvent(slot, note, value & 0x0F);
+    } else if ((value & EVENT_FORM_MASK) == EVENT_LONG_FORM) {
+      load_long_header = value;
+    } else if (slot->note_count == 0) {
+      ok = false;  // Repeat with nothing to repeat
+    } else {
+      for (uint8_t r = 0; r <= (value & ~EVENT_FORM_MASK) && ok; r++) {
+        ok = encodeNoteEvent(slot, slot->last_note, slot->last_duration);
+      }
+    }
+  }
+
+  if (!ok) {
+    resetSlotData(slot);
+    loading_slot = -1;
+  }
+  return ok;
+}
+
+/**
+ * Finish loading: the slot becomes playable and is saved
+ * @return Number of notes loaded, or -1 if the data ended mid-event
+ */
+int endSlotLoad() {
+  if (loading_slot == -1) {
+    return -1;
+  }
+
+  RecordingSlot* slot = &recording_slots[loading_slot];
+  loading_slot = -1;
+
+  if (load_long_header != 0) {
+    resetSlotData(slot);
+    return -1;
+  }
+
+  slot->is_active = slot->note_count > 0;
+  slot->revision++;  // Content changed since the reset
+  return slot->note_count;
+}
+
+/**
+ * Check if a slot is being loaded
+ * @return Slot number, or -1
+ */
+int getLoadingSlot() {
+  return loading_slot;
+}
+
 /**
  * Check if currently recording
  * @return true if recording is active
@@ -258,13 +813,42 @@ RecordingSlot* getRecordingSlot(int slot_num) {
 /**
  * Get number of notes in a slot
  * @param slot_num Slot number
- * @return Number of notes, or -1 if invalid slot
+ * @return Number of notes (including one still being recorded), or -1 if invalid slot
  */
 int getSlotNoteCount(int slot_num) {
   if (slot_num < 0 || slot_num >= NUM_RECORDING_SLOTS) {
     return -1;
   }
-  return recording_slots[slot_num].note_count;
+
+  int count = recording_slots[slot_num].note_count;
+  if (is_recording && slot_num == active_recording_slot && last_note_index != -1) {
+    count++;  // Note sounding, not encoded yet
+  }
+  return count;
+}
+
+/**
+ * Get number of encoded bytes used by a slot
+ * @param slot_num Slot number
+ * @return Bytes used, or -1 if invalid slot
+ */
+int getSlotBytesUsed(int slot_num) {
+  if (slot_num < 0 || slot_num >= NUM_RECORDING_SLOTS) {
+    return -1;
+  }
+  return recording_slots[slot_num].data_length;
+}
+
+/**
+ * Get free space in the shared event pool
+ * @param free_blocks Output: blocks on the free list
+ * @return Free bytes (whole blocks only)
+ */
+int getPoolFreeBytes(int* free_blocks) {
+  if (free_blocks != NULL) {
+    *free_blocks = pool_free_count;
+  }
+  return pool_free_count * POOL_BLOCK_BYTES;
 }
 
 /**
@@ -279,8 +863,12 @@ unsigned long getRecordingDuration(int slot_num) {
   }
 
   unsigned long total_duration = 0;
-  for (int i = 0; i < slot->note_count; i++) {
-    total_duration += slot->events[i].duration_units * DURATION_UNIT_MS;
+  SlotReader reader;
+  NoteEvent event;
+
+  beginSlotRead(slot_num, &reader);
+  while (readNextEvent(&reader, &event)) {
+    total_duration += event.duration_units * DURATION_UNIT_MS;
   }
 
   return total_duration;
@@ -0,0 +1,96 @@
+#ifndef SENSOR_FILTER_H
+#define SENSOR_FILTER_H
+
+#include "hal.h"
+#include "config.h"
+#include "note_mapping.h"
+
+// ============================================
+// SENSOR FILTER STATE
+// ============================================
+
+// Filtered width reported when the hand is out of range
+#define ECHO_WIDTH_NONE 0xFFFF
+
+// Fractional bits of the fixed-point EMA state
+#define SENSOR_EMA_FRACTION_BITS 4
+
+// Last SENSOR_MEDIAN_WINDOW raw widths (out-of-range widths stored as ECHO_WIDTH_NONE)
+uint16_t filter_window[SENSOR_MEDIAN_WINDOW];
+uint8_t filter_window_pos = 0;
+uint8_t filter_window_count = 0;
+
+// EMA state in fixed point (width << SENSOR_EMA_FRACTION_BITS)
+int32_t filter_ema = 0;
+bool filter_ema_valid = false;
+
+// ============================================
+// SENSOR FILTER FUNCTIONS
+// ============================================
+
+/**
+ * Reset the filter (e.g. after the sensor was idle)
+ */
+void resetSensorFilter() {
+  filter_window_pos = 0;
+  filter_window_count = 0;
+  filter_ema_valid = false;
+}
+
+/**
+ * Running median of the samples in the window
+ * Sorts a copy of at most SENSOR_MEDIAN_WINDOW entries (insertion sort).
+ * @return Median width
+ */
+uint16_t getWindowMedian() {
+  uint16_t sorted[SENSOR_MEDIAN_WINDOW];
+
+  for (uint8_t i = 0; i < filter_window_count; i++) {
+    uint16_t value = filter_window[i];
+    uint8_t j = i;
+    while (j > 0 && sorted[j - 1] > value) {
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    sorted[j] = value;
+  }
+
+  return sorted[filter_window_count / 2];
+}
+
+/**
+ * Feed one raw echo width through the filter
+ * @param width_us Raw echo pulse width in microseconds
+ * @return Filtered width, or ECHO_WIDTH_NONE if the hand is out of range
+ */
+uint16_t filterEchoWidth(uint16_t width_us) {
+  // Spurious in-range echoes and dropouts both count as outliers here
+  filter_window[filter_window_pos] = isEchoInRange(width_us) ? width_us : ECHO_WIDTH_NONE;
+  filter_window_pos = (filter_window_pos + 1) % SENSOR_MEDIAN_WINDOW;
+  if (filter_window_count < SENSOR_MEDIAN_WINDOW) {
+    filter_window_count++;
+  }
+
+  uint16_t median = getWindowMedian();
+
+  if (median == ECHO_WIDTH_NONE) {
+    filter_ema_valid = false;  // Hand gone: restart smoothing from scratch
+    return ECHO_WIDTH_NONE;
+  }
+
+  if (SENSOR_EMA_SHIFT == 0) {
+    return median;
+  }
+
+  int32_t sample = (int32_t)median << SENSOR_EMA_FRACTION_BITS;
+  if (!filter_ema_valid) {
+    filter_ema = sample;
+    filter_ema_valid = true;
+  } else {
+    filter_ema += (sample - filter_ema) >> SENSOR_EMA_SHIFT;
+  }
+
+  return (uint16_t)(filter_ema >> SENSOR_EMA_FRACTION_BITS);
+}
+
+#endif // SENSOR_FILTER_H
@@ -0,0 +1,470 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include "hal.h"
+#include "config.h"
+#include "recording.h"
+
+// ============================================
+// EEPROM LOG FORMAT
+// ============================================
+
+// Slots are saved as records appended to a circular log, so writes (and
+// wear) rotate over every cell of the log region:
+//   marker  seq(2)  slot  length(2)  data[length]  crc8
+// A record with length 0 marks a cleared slot. The newest record of each
+// slot (highest seq) is its live copy; everything else is free space.
+// Before the write position can run into the oldest live record, that
+// record is copied forward, so a gap of at least one live record always
+// separates new writes from live data. The marker is written last (after
+// clearing any old marker at that offset), so a record cut short by a
+// reset is never recognized and the slot keeps its previous copy.
+// The marker also tags the slot encoding: records of an older encoding
+// (0xA7: fixed 3-bit notes) are ignored and the log starts over.
+#define LOG_RECORD_MARKER 0xA8
+#define LOG_HEADER_BYTES 6
+#define LOG_RECORD_OVERHEAD (LOG_HEADER_BYTES + 1)
+#define LOG_MAX_RECORD_BYTES (LOG_RECORD_OVERHEAD + RECORDING_POOL_BYTES)
+
+// No live record for a slot
+#define LOG_NO_RECORD 0xFFFF
+
+#if EEPROM_LOG_SIZE < 2 * LOG_MAX_RECORD_BYTES + RECORDING_POOL_BYTES + NUM_RECORDING_SLOTS * LOG_RECORD_OVERHEAD
+#error "EEPROM_LOG_SIZE cannot hold the recording pool"
+#endif
+
+#if EEPROM_LOG_START + EEPROM_LOG_SIZE > HAL_EEPROM_SIZE
+#error "EEPROM log does not fit in the EEPROM"
+#endif
+
+/**
+ * Location of the live record of a slot
+ */
+struct LogIndexEntry {
+  uint16_t offset;                // Log offset of the record, or LOG_NO_RECORD
+  uint16_t length;                // Data bytes (0 = cleared slot)
+  uint16_t seq;                   // Record sequence number
+
+  LogIndexEntry() : offset(LOG_NO_RECORD), length(0), seq(0) {}
+};
+
+/**
+ * Record being written, one byte per EEPROM write cycle
+ */
+struct LogWriter {
+  bool active;                    // A record is in progress
+  bool relocating;                // Copying a live record forward (source in EEPROM)
+  uint8_t slot;                   // Slot the record belongs to
+  uint8_t revision;               // Slot revision being saved (RAM source)
+  SlotReader reader;              // RAM source
+  uint16_t source;                // Log offset of the data being copied (EEPROM source)
+  uint16_t start;                 // Log offset of the new record
+  uint16_t length;                // Data bytes
+  uint16_t seq;                   // Sequence number of the new record
+  uint16_t pos;                   // Next record byte (0 = clear old marker)
+  uint8_t crc;                    // CRC of the bytes written so far
+
+  LogWriter()
+    : active(false), relocating(false), slot(0), revision(0), source(0),
+      start(0), length(0), seq(0), pos(0), crc(0) {}
+};
+
+// ============================================
+// STORAGE STATE
+// ============================================
+
+LogIndexEntry log_index[NUM_RECORDING_SLOTS];
+uint8_t saved_revision[NUM_RECORDING_SLOTS];   // Slot revision held by its live record
+uint16_t log_head = 0;                          // Log offset of the next record
+uint16_t log_next_seq = 0;
+LogWriter log_writer;
+uint8_t log_relocations = 0;                    // Records copied forward since the last save
+unsigned int storage_failures = 0;              // Saves dropped for lack of log space
+
+// ============================================
+// LOG HELPERS
+// ============================================
+
+/**
+ * Update a CRC-8 (polynomial 0x07) with one byte
+ */
+uint8_t crc8Update(uint8_t crc, uint8_t data) {
+  crc ^= data;
+  for (uint8_t i = 0; i < 8; i++) {
+    crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+  }
+  return crc;
+}
+
+/**
+ * Read a byte at a log offset (wraps around the log region)
+ */
+uint8_t readLogByte(uint16_t offset) {
+  return halEepromRead(EEPROM_LOG_START + offset % EEPROM_LOG_SIZE);
+}
+
+/**
+ * Distance from one log offset forward to another
+ */
+uint16_t logDistance(uint16_t from, uint16_t to) {
+  return (uint16_t)((to + EEPROM_LOG_SIZE - from) % EEPROM_LOG_SIZE);
+}
+
+/**
+ * Compare sequence numbers, allowing for wrap-around
+ * @return true if a is newer than b
+ */
+bool isSeqNewer(uint16_t a, uint16_t b) {
+  return (int16_t)(a - b) > 0;
+}
+
+/**
+ * Validate the record starting at a log offset
+ * @param offset Log offset
+ * @param length Output: data bytes in the record
+ * @return true if the record is complete and its CRC matches
+ */
+bool checkLogRecord(uint16_t offset, uint16_t* length) {
+  if (readLogByte(offset) != LOG_RECORD_MARKER) {
+    return false;
+  }
+
+  uint8_t slot = readLogByte(offset + 3);
+  uint16_t data_length = readLogByte(offset + 4) | (readLogByte(offset + 5) << 8);
+  if (slot >= NUM_RECORDING_SLOTS || data_length > RECORDING_POOL_BYTES) {
+    return false;
+  }
+
+  uint8_t crc = 0;
+  uint16_t crc_pos = LOG_HEADER_BYTES + data_length;
+  for (uint16_t i = 0; i < crc_pos; i++) {
+    crc = crc8Update(crc, readLogByte(offset + i));
+  }
+  if (crc != readLogByte(offset + crc_pos)) {
+    return false;
+  }
+
+  *length = data_length;
+  return true;
+}
+
+/**
+ * Get the record byte at a position of the record being written
+ */
+uint8_t getLogWriterByte(LogWriter* writer) {
+  uint16_t pos = writer->pos;
+
+  switch (pos) {
+    case 0: return LOG_RECORD_MARKER;
+    case 1: return writer->seq & 0xFF;
+    case 2: return writer->seq >> 8;
+    case 3: return writer->slot;
+    case 4: return writer->length & 0xFF;
+    case 5: return writer->length >> 8;
+    default: break;
+  }
+
+  if (pos == LOG_HEADER_BYTES + writer->length) {
+    return writer->crc;
+  }
+  if (writer->relocating) {
+    return readLogByte(writer->source + (pos - LOG_HEADER_BYTES));
+  }
+  return readSlotByte(&writer->reader);
+}
+
+// ============================================
+// SAVING
+// ============================================
+
+/**
+ * Check whether a slot differs from its live record
+ */
+bool isSlotUnsaved(int slot_num) {
+  if ((is_recording && slot_num == active_recording_slot) || slot_num == loading_slot) {
+    return false;  // Saved once recording (or loading) stops
+  }
+  return recording_slots[slot_num].revision != saved_revision[slot_num];
+}
+
+/**
+ * Get the free log space ahead of the write position
+ * @param oldest Output: slot owning the first live record ahead, or -1
+ * @param largest Output: size of the largest live record
+ * @return Bytes that can be written before reaching live data
+ */
+uint16_t getLogGap(int* oldest, uint16_t* largest) {
+  uint16_t gap = EEPROM_LOG_SIZE;
+  *oldest = -1;
+  *largest = 0;
+
+  for (int i = 0; i < NUM_RECORDING_SLOTS; i++) {
+    if (log_index[i].offset == LOG_NO_RECORD) {
+      continue;
+    }
+
+    uint16_t distance = logDistance(log_head, log_index[i].offset);
+    if (distance < gap) {
+      gap = distance;
+      *oldest = i;
+    }
+
+    uint16_t size = LOG_RECORD_OVERHEAD + log_index[i].length;
+    if (size > *largest) {
+      *largest = size;
+    }
+  }
+
+  return gap;
+}
+
+/**
+ * Begin writing the next record at the write position
+ * Saves the smallest unsaved slot, first copying live records forward
+ * while the free gap is too small.
+ * @return true if a record was started
+ */
+bool startNextLogRecord() {
+  // Smallest unsaved slot first: clears and short takes free space for the rest
+  int slot_num = -1;
+  uint16_t length = 0;
+
+  for (int i = 0; i < NUM_RECORDING_SLOTS; i++) {
+    if (!isSlotUnsaved(i)) {
+      continue;
+    }
+
+    RecordingSlot* slot = &recording_slots[i];
+    uint16_t slot_length = slot->is_active ? slot->data_length : 0;
+
+    if (slot_length == 0 && log_index[i].offset == LOG_NO_RECORD) {
+      saved_revision[i] = slot->revision;  // Empty and never saved: nothing to write
+      continue;
+    }
+    if (slot_num == -1 || slot_length < length) {
+      slot_num = i;
+      length = slot_length;
+    }
+  }
+
+  if (slot_num == -1) {
+    return false;
+  }
+
+  LogWriter* writer = &log_writer;
+  *writer = LogWriter();
+
+  // Keep room to copy the largest live record forward after this one
+  int oldest;
+  uint16_t largest;
+  uint16_t gap = getLogGap(&oldest, &largest);
+
+  if (gap < LOG_RECORD_OVERHEAD + length + largest) {
+    if (log_relocations >= NUM_RECORDING_SLOTS) {
+      // Every live record has been moved and there is still no room
+      saved_revision[slot_num] = recording_slots[slot_num].revision;
+      log_relocations = 0;
+      storage_failures++;
+      return false;
+    }
+
+    log_relocations++;
+    writer->relocating = true;
+    writer->slot = oldest;
+    writer->source = log_index[oldest].offset + LOG_HEADER_BYTES;
+    writer->length = log_index[oldest].length;
+  } else {
+    log_relocations = 0;
+    writer->slot = slot_num;
+    writer->revision = recording_slots[slot_num].revision;
+    writer->length = length;
+    beginSlotRead(slot_num, &writer->reader);
+  }
+
+  writer->active = true;
+  writer->start = log_head;
+  writer->seq = log_next_seq;
+  return true;
+}
+
+/**
+ * Write one byte at a log offset unless it already holds that value
+ */
+void updateLogByte(uint16_t offset, uint8_t value) {
+  uint16_t address = EEPROM_LOG_START + offset % EEPROM_LOG_SIZE;
+  if (halEepromRead(address) != value) {
+    halEepromWrite(address, value);
+  }
+}
+
+/**
+ * Write (or skip, if unchanged) the next byte of the record in progress
+ * Order: clear a stale marker at the start, header after the marker, data,
+ * CRC, and finally the marker that makes the record valid.
+ */
+void writeNextLogByte() {
+  LogWriter* writer = &log_writer;
+  uint16_t record_bytes = LOG_RECORD_OVERHEAD + writer->length;
+
+  // The slot changed under a RAM save: drop the partial record, the slot
+  // stays unsaved and is started again
+  if (!writer->relocating && recording_slots[writer->slot].revision != writer->revision) {
+    writer->active = false;
+    return;
+  }
+
+  if (writer->pos == 0) {
+    if (readLogByte(writer->start) == LOG_RECORD_MARKER) {
+      updateLogByte(writer->start, 0);
+    }
+    writer->crc = crc8Update(0, LOG_RECORD_MARKER);
+    writer->pos++;
+    return;
+  }
+
+  if (writer->pos < record_bytes) {
+    uint8_t value = getLogWriterByte(writer);
+    updateLogByte(writer->start + writer->pos, value);
+    writer->crc = crc8Update(writer->crc, value);
+    writer->pos++;
+    return;
+  }
+
+  updateLogByte(writer->start, LOG_RECORD_MARKER);
+
+  // Record complete: it becomes the slot's live copy
+  LogIndexEntry* entry = &log_index[writer->slot];
+  entry->offset = writer->start;
+  entry->length = writer->length;
+  entry->seq = writer->seq;
+
+  log_head = (writer->start + record_bytes) % EEPROM_LOG_SIZE;
+  log_next_seq++;
+  if (!writer->relocating) {
+    saved_revision[writer->slot] = writer->revision;
+  }
+  writer->active = false;
+}
+
+/**
+ * Save changed slots in the background
+ * Call every loop(). Never waits for the EEPROM: returns as soon as a
+ * write cycle is running, and compares at most STORAGE_BYTES_PER_UPDATE
+ * bytes per call.
+ */
+void updateStorage() {
+  for (uint8_t i = 0; i < STORAGE_BYTES_PER_UPDATE; i++) {
+    if (!halEepromReady()) {
+      return;
+    }
+    if (!log_writer.active && !startNextLogRecord()) {
+      return;
+    }
+    writeNextLogByte();
+  }
+}
+
+/**
+ * Check whether every slot is saved
+ */
+bool isStorageIdle() {
+  if (log_writer.active) {
+    return false;
+  }
+  for (int i = 0; i < NUM_RECORDING_SLOTS; i++) {
+    if (isSlotUnsaved(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// ============================================
+// LOADING
+// ============================================
+
+/**
+ * Copy a live record into its (empty) slot
+ * @return true if the slot was restored
+ */
+bool loadSlotFromLog(int slot_num) {
+  LogIndexEntry* entry = &log_index[slot_num];
+  RecordingSlot* slot = &recording_slots[slot_num];
+
+  if (entry->offset == LOG_NO_RECORD || entry->length == 0 ||
+      getSlotRoom(slot) < entry->length) {
+    return false;
+  }
+
+  for (uint16_t i = 0; i < entry->length; i++) {
+    appendSlotByte(slot, readLogByte(entry->offset + LOG_HEADER_BYTES + i));
+  }
+
+  // Count the notes
+  SlotReader reader;
+  NoteEvent event;
+  beginSlotRead(slot_num, &reader);
+  while (readNextEvent(&reader, &event)) {
+    if (event.note_index != NOTE_REST) {
+      slot->note_count++;
+    }
+  }
+  slot->is_active = slot->note_count > 0;
+
+  return slot->is_active;
+}
+
+/**
+ * Scan the log, rebuild the slot index and restore the recordings
+ * Call after initializeRecordingSystem().
+ * @return Number of slots restored
+ */
+int initializeStorage() {
+  log_writer = LogWriter();
+  bool found = false;
+  uint16_t newest_seq = 0;
+  uint16_t newest_end = 0;
+
+  for (int i = 0; i < NUM_RECORDING_SLOTS; i++) {
+    log_index[i] = LogIndexEntry();
+  }
+
+  // Check every offset: free space holds stale records that new ones have
+  // partly overwritten, and skipping over one of those could hide a live
+  // record. Only offsets holding a marker cost more than one read.
+  for (uint16_t offset = 0; offset < EEPROM_LOG_SIZE; offset++) {
+    uint16_t length;
+    if (!checkLogRecord(offset, &length)) {
+      continue;
+    }
+
+    uint16_t seq = readLogByte(offset + 1) | (readLogByte(offset + 2) << 8);
+    LogIndexEntry* entry = &log_index[readLogByte(offset + 3)];
+
+    if (entry->offset == LOG_NO_RECORD || isSeqNewer(seq, entry->seq)) {
+      entry->offset = offset;
+      entry->length = length;
+      entry->seq = seq;
+    }
+    if (!found || isSeqNewer(seq, newest_seq)) {
+      found = true;
+      newest_seq = seq;
+      newest_end = (offset + LOG_RECORD_OVERHEAD + length) % EEPROM_LOG_SIZE;
+    }
+  }
+
+  log_head = newest_end;
+  log_next_seq = found ? newest_seq + 1 : 0;
+
+  int restored = 0;
+  for (int i = 0; i < NUM_RECORDING_SLOTS; i++) {
+    if (loadSlotFromLog(i)) {
+      restored++;
+    }
+    saved_revision[i] = recording_slots[i].revision;
+  }
+
+  return restored;
+}
+
+#endif // STORAGE_H
@@ -0,0 +1,204 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include "hal.h"
+#include "config.h"
+#include "note_mapping.h"
+#include "utils.h"
+
+// ============================================
+// WAVETABLE SYNTHESIZER
+// ============================================
+
+// tone() drives the buzzer with one square wave, so merged slots have to
+// share it. For polyphonic playback the Timer1 interrupt instead runs
+// SYNTH_VOICES phase-accumulator oscillators over a sine table, sums them
+// and turns the sum into a 1-bit pulse density stream on BUZZER_PIN with a
+// first-order sigma-delta modulator. The buzzer and the listener's ear
+// average the pulses back into the mix.
+//
+// ISR cycle budget (ATmega328P, 16 MHz, estimated from the generated code
+// pattern; `D` shows the maximum measured on the board through TCNT1):
+//   entry + register save / restore + reti     ~80
+//   per voice (phase add, table lookup, sum)   ~27  (x4 = ~108)
+//   sigma-delta + port write                   ~20
+//   cycle measurement                          ~12
+//   total with 4 voices                        ~225 of 800 (~28% CPU)
+// At 20 kHz about 10 voices would fit in half the CPU; the 4 default voices
+// (one per recording slot) leave the main loop ~70% of its time.
+
+// One sine period in 64 steps, amplitude 31: four voices sum to at most
+// +/-124, so the mix fits in 8 bits around 128 without clipping
+#define SYNTH_TABLE_BITS 6
+#define SYNTH_TABLE_SIZE (1 << SYNTH_TABLE_BITS)
+
+const int8_t synth_sine_table[SYNTH_TABLE_SIZE] PROGMEM = {
+    0,   3,   6,   9,  12,  15,  17,  20,  22,  24,  26,  27,  29,  30,  30,  31,
+   31,  31,  30,  30,  29,  27,  26,  24,  22,  20,  17,  15,  12,   9,   6,   3,
+    0,  -3,  -6,  -9, -12, -15, -17, -20, -22, -24, -26, -27, -29, -30, -30, -31,
+  -31, -31, -30, -30, -29, -27, -26, -24, -22, -20, -17, -15, -12,  -9,  -6,  -3
+};
+
+#if SYNTH_VOICES * 31 > 127
+#error "Too many synth voices for the 8-bit mix (lower the table amplitude)"
+#endif
+
+/**
+ * Phase accumulator oscillator
+ * Frequency = increment * SYNTH_SAMPLE_RATE / 65536
+ */
+struct SynthVoice {
+  uint16_t phase;             // Position in the waveform (top bits index the table)
+  uint16_t increment;         // Phase step per sample (0 = silent)
+};
+
+// ============================================
+// SYNTH STATE
+// ============================================
+
+// Oscillators (written by the main loop with interrupts masked)
+volatile SynthVoice synth_voices[SYNTH_VOICES];
+
+// Note on each voice, -1 if silent (main loop only)
+int8_t synth_voice_notes[SYNTH_VOICES];
+
+// Sigma-delta accumulator (ISR only)
+uint8_t synth_error = 0;
+
+// Longest tick measured, in CPU cycles (0 on the host)
+volatile uint16_t synth_isr_cycles_max = 0;
+
+HalFastPin synth_pin;
+bool synth_running = false;
+
+// ============================================
+// SAMPLE INTERRUPT
+// ============================================
+
+/**
+ * Render one output sample (Timer1 compare interrupt)
+ */
+void halSampleTimerTick() {
+  uint8_t mix = 128;
+
+  for (uint8_t v = 0; v < SYNTH_VOICES; v++) {
+    uint16_t phase = synth_voices[v].phase + synth_voices[v].increment;
+    synth_voices[v].phase = phase;
+    mix += (int8_t)pgm_read_byte(&synth_sine_table[phase >> (16 - SYNTH_TABLE_BITS)]);
+  }
+
+  // The carry out of the 8-bit accumulator is the output bit: its density
+  // follows mix / 256
+  uint16_t sum = synth_error + mix;
+  synth_error = (uint8_t)sum;
+  halFastPinWrite(&synth_pin, sum >> 8);
+
+  uint16_t cycles = halSampleTimerCount();
+  if (cycles > synth_isr_cycles_max) {
+    synth_isr_cycles_max = cycles;
+  }
+}
+
+// ============================================
+// SYNTH CONTROL FUNCTIONS
+// ============================================
+
+/**
+ * Set the note a voice plays
+ * @param voice Voice number (0 to SYNTH_VOICES-1)
+ * @param note_index Note (0 to NUM_NOTES - 1), or -1 to silence the voice
+ */
+void synthSetVoice(uint8_t voice, int note_index) {
+  if (voice >= SYNTH_VOICES) {
+    return;
+  }
+
+  uint16_t increment = 0;
+  int frequency = getNoteFrequency(note_index);
+  if (frequency > 0) {
+    increment = (uint16_t)(((uint32_t)frequency << 16) / SYNTH_SAMPLE_RATE);
+  }
+
+  noInterrupts();
+  synth_voices[voice].increment = increment;
+  if (increment == 0) {
+    synth_voices[voice].phase = 0;  // sin(0) = 0: a silent voice adds nothing
+  }
+  interrupts();
+
+  synth_voice_notes[voice] = increment != 0 ? note_index : -1;
+}
+
+/**
+ * Get the note a voice is playing
+ * @return Note index, or -1 if silent
+ */
+int getSynthVoiceNote(uint8_t voice) {
+  return voice < SYNTH_VOICES ? synth_voice_notes[voice] : -1;
+}
+
+/**
+ * Light the LEDs of every sounding voice (one LED update)
+ */
+void showSynthVoiceLEDs() {
+  uint8_t mask = 0;
+  for (uint8_t v = 0; v < SYNTH_VOICES; v++) {
+    mask |= getNoteLEDBit(synth_voice_notes[v]);
+  }
+  setNoteLEDMask(mask);
+}
+
+/**
+ * Take over the buzzer from tone() and start the sample interrupt
+ * All voices start silent.
+ */
+void startSynth() {
+  if (synth_running) {
+    return;
+  }
+
+  stopNote();
+  for (uint8_t v = 0; v < SYNTH_VOICES; v++) {
+    synthSetVoice(v, -1);
+  }
+  synth_error = 0;
+  halFastPinInit(&synth_pin, BUZZER_PIN);
+  halStartSampleTimer(SYNTH_SAMPLE_RATE);
+  synth_running = true;
+}
+
+/**
+ * Stop the sample interrupt and leave the buzzer pin low
+ */
+void stopSynth() {
+  if (!synth_running) {
+    return;
+  }
+
+  halStopSampleTimer();
+  for (uint8_t v = 0; v < SYNTH_VOICES; v++) {
+    synthSetVoice(v, -1);
+  }
+  digitalWrite(BUZZER_PIN, LOW);
+  synth_running = false;
+}
+
+/**
+ * Check if the synth owns the buzzer
+ */
+bool isSynthRunning() {
+  return synth_running;
+}
+
+/**
+ * Get the longest sample interrupt measured so far
+ * @return CPU cycles (0 where it cannot be measured, i.e. on the host)
+ */
+uint16_t getSynthIsrCycles() {
+  noInterrupts();
+  uint16_t cycles = synth_isr_cycles_max;
+  interrupts();
+  return cycles;
+}
+
+#endif // SYNTH_H
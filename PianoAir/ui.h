@@ -1,11 +1,18 @@
 #ifndef UI_H
 #define UI_H
 
-#include <Arduino.h>
+#include "hal.h"
 #include "config.h"
 #include "note_mapping.h"
+#include "note_tracker.h"
 #include "recording.h"
 #include "playback.h"
+#include "looper.h"
+#include "protocol.h"
+#include "output.h"
+#include "midi.h"
+#include "profile.h"
+#include "memory.h"
 
 // ============================================
 // UI STATE
@@ -27,93 +34,454 @@ int buffer_index = 0;
  * Print the main menu
  */
 void printMainMenu() {
-  Serial.println(F("\n========================================"));
-  Serial.println(F("        PIANO AIR - Main Menu"));
-  Serial.println(F("========================================"));
-  Serial.println(F("\nFREE PLAY & RECORDING:"));
-  Serial.println(F("  0 - Free play mode (Air Piano)"));
-  Serial.println(F("  R[1-4] - Record to slot (e.g., R1, R2)"));
-  Serial.println(F("  S - Stop recording"));
-  Serial.println(F("\nPLAYBACK:"));
-  Serial.println(F("  P[1-4] - Play slot (e.g., P1, P2)"));
-  Serial.println(F("  PA - Play all slots (merged)"));
-  Serial.println(F("  X - Stop playback"));
-  Serial.println(F("\nMANAGEMENT:"));
-  Serial.println(F("  L - List all recordings"));
-  Serial.println(F("  C[1-4] - Clear slot (e.g., C1, C2)"));
-  Serial.println(F("  CA - Clear all recordings"));
-  Serial.println(F("  M[1-4] - Set overlap mode (see below)"));
-  Serial.println(F("\nOVERLAP MODES:"));
-  Serial.println(F("  M1 - Priority High (play highest note)"));
-  Serial.println(F("  M2 - Priority Low (play lowest note)"));
-  Serial.println(F("  M3 - Alternate (rapid switching)"));
-  Serial.println(F("  M4 - Drop (first note wins)"));
-  Serial.println(F("========================================\n"));
+  // One flash string: a single queue item
+  text_out.print(F(
+    "\n========================================\r\n"
+    "        PIANO AIR - Main Menu\r\n"
+    "========================================\r\n"
+    "\nFREE PLAY & RECORDING:\r\n"
+    "  0 - Free play mode (Air Piano)\r\n"
+    "  R[1-4] - Record to slot (e.g., R1, R2)\r\n"
+    "  S - Stop recording\r\n"
+    "  O[1-4] - Loop the other slots, record into this one\r\n"
+    "\nPLAYBACK:\r\n"
+    "  P[1-4] - Play slot (e.g., P1, P2)\r\n"
+    "  PA - Play all slots (merged)\r\n"
+    "  PS - Play all slots (streamed merge)\r\n"
+    "  X - Stop playback (or the looper)\r\n"
+    "  V[50-200] - Playback speed in percent (e.g., V150)\r\n"
+    "  +[n] / -[n] - Transpose playback up / down n semitones\r\n"
+    "\nMANAGEMENT:\r\n"
+    "  L - List all recordings\r\n"
+    "  C[1-4] - Clear slot (e.g., C1, C2)\r\n"
+    "  CA - Clear all recordings\r\n"
+    "  M[1-5] - Set overlap mode (see below)\r\n"
+    "  N[1-5] - Set scale (see below)\r\n"
+    "  K<key> - Set key (e.g., KC, KF#, KBb)\r\n"
+    "  D - Sensor diagnostics\r\n"
+    "  T - Loop timing (print and reset)\r\n"
+    "  F - Free memory and stack high-water mark\r\n"
+    "  I - Live MIDI out on/off (serial MIDI bridge)\r\n"
+    "\nOVERLAP MODES:\r\n"
+    "  M1 - Priority High (play highest note)\r\n"
+    "  M2 - Priority Low (play lowest note)\r\n"
+    "  M3 - Alternate (rapid switching)\r\n"
+    "  M4 - Drop (first note wins)\r\n"
+    "  M5 - Polyphonic (all slots at once, synth)\r\n"
+    "\nSCALES:\r\n"
+    "  N1 - Major    N2 - Minor    N3 - Pentatonic\r\n"
+    "  N4 - Chromatic (13 zones)\r\n"
+    "  N5 - Major, two octaves (15 zones)\r\n"
+    "========================================\n\r\n"));
 }
 
 /**
  * Print current system status
  */
 void printStatus() {
-  Serial.print(F("Mode: "));
-
-  if (isRecording()) {
-    Serial.print(F("RECORDING to Slot "));
-    Serial.print(getActiveRecordingSlot() + 1);
+  text_out.print(F("Mode: "));
+
+  if (isLooperActive()) {
+    text_out.print(F("LOOPING ("));
+    text_out.print(getLooperLength() / 1000.0, 1);
+    text_out.print(F("s)"));
+    if (getLooperTakeSlot() >= 0) {
+      text_out.print(F(", recording Slot "));
+      text_out.print(getLooperTakeSlot() + 1);
+    }
+    text_out.println();
+  } else if (isRecording()) {
+    text_out.print(F("RECORDING to Slot "));
+    text_out.print(getActiveRecordingSlot() + 1);
     int note_count = getSlotNoteCount(getActiveRecordingSlot());
-    Serial.print(F(" ["));
-    Serial.print(note_count);
-    Serial.print(F("/"));
-    Serial.print(MAX_NOTES_PER_SLOT);
-    Serial.println(F(" notes]"));
+    text_out.print(F(" ["));
+    text_out.print(note_count);
+    text_out.print(F(" notes, "));
+    text_out.print(getSlotBytesUsed(getActiveRecordingSlot()));
+    text_out.print(F(" bytes, "));
+    text_out.print(getPoolFreeBytes(NULL));
+    text_out.println(F(" free]"));
   } else if (isPlaying()) {
-    Serial.print(F("PLAYING"));
+    text_out.print(F("PLAYING"));
     int current, total;
     if (getPlaybackProgress(&current, &total)) {
-      Serial.print(F(" ["));
-      Serial.print(current);
-      Serial.print(F("/"));
-      Serial.print(total);
-      Serial.print(F(" events]"));
+      text_out.print(F(" ["));
+      text_out.print(current);
+      text_out.print(F("/"));
+      text_out.print(total);
+      text_out.print(F(" events]"));
     }
-    Serial.println();
+    if (getPlaybackSpeed() != 100 || getPlaybackTranspose() != 0) {
+      text_out.print(F(" at "));
+      text_out.print(getPlaybackSpeed());
+      text_out.print(F("%, "));
+      if (getPlaybackTranspose() > 0) {
+        text_out.print('+');
+      }
+      text_out.print(getPlaybackTranspose());
+    }
+    text_out.println();
   } else {
-    Serial.println(F("FREE PLAY"));
+    text_out.println(F("FREE PLAY"));
   }
 }
 
 /**
- * List all recordings
+ * List all recordings, one section at a time (see startOutputProducer())
+ * Sections: header, one per slot, pool, EEPROM.
  */
-void listRecordings() {
-  Serial.println(F("\n--- Recording Slots ---"));
-
-  bool has_recordings = false;
+bool listRecordingsSection(uint8_t section) {
+  if (section == 0) {
+    text_out.println(F("\n--- Recording Slots ---"));
+    return true;
+  }
 
-  for (int i = 0; i < NUM_RECORDING_SLOTS; i++) {
-    Serial.print(F("Slot "));
-    Serial.print(i + 1);
-    Serial.print(F(": "));
+  if (section <= NUM_RECORDING_SLOTS) {
+    int i = section - 1;
+    text_out.print(F("Slot "));
+    text_out.print(i + 1);
+    text_out.print(F(": "));
 
     if (isSlotActive(i)) {
-      has_recordings = true;
       int note_count = getSlotNoteCount(i);
       unsigned long duration_ms = getRecordingDuration(i);
 
-      Serial.print(note_count);
-      Serial.print(F(" notes, "));
-      Serial.print(duration_ms / 1000.0, 1);
-      Serial.println(F("s"));
+      text_out.print(note_count);
+      text_out.print(F(" notes, "));
+      text_out.print(duration_ms / 1000.0, 1);
+      text_out.print(F("s, "));
+      text_out.print(getSlotBytesUsed(i));
+      text_out.println(F(" bytes"));
     } else {
-      Serial.println(F("[Empty]"));
+      text_out.println(F("[Empty]"));
+    }
+    return true;
+  }
+
+  if (section == NUM_RECORDING_SLOTS + 1) {
+    int active_slots[NUM_RECORDING_SLOTS];
+    if (getActiveSlots(active_slots) == 0) {
+      text_out.println(F("\nNo recordings found."));
+    }
+
+    // Shared pool usage
+    int free_blocks;
+    int free_bytes = getPoolFreeBytes(&free_blocks);
+    text_out.print(F("Pool: "));
+    text_out.print(free_bytes);
+    text_out.print(F("/"));
+    text_out.print(RECORDING_POOL_BYTES);
+    text_out.print(F(" bytes free ("));
+    text_out.print(free_blocks);
+    text_out.print(F("/"));
+    text_out.print(POOL_NUM_BLOCKS);
+    text_out.println(F(" blocks)"));
+    return true;
+  }
+
+  #if ENABLE_EEPROM
+  text_out.print(F("EEPROM: "));
+  text_out.print(isStorageIdle() ? F("all saved") : F("saving..."));
+  if (storage_failures > 0) {
+    text_out.print(F(", "));
+    text_out.print(storage_failures);
+    text_out.print(F(" save(s) failed (log full)"));
+  }
+  text_out.println();
+  #endif
+
+  text_out.println(F("----------------------\n"));
+  return false;
+}
+
+/**
+ * Print ultrasonic sensor statistics, one section at a time
+ */
+bool printSensorStatsSection(uint8_t section) {
+  switch (section) {
+    case 0:
+      text_out.println(F("\n--- Sensor ---"));
+      text_out.print(F("Sample rate: "));
+      text_out.print(getSensorRate());
+      text_out.println(F(" Hz"));
+      text_out.print(F("Echoes: "));
+      text_out.println(getSensorEchoCount());
+      text_out.print(F("Timeouts: "));
+      text_out.println(getSensorTimeoutCount());
+      text_out.print(F("Ring overflows: "));
+      text_out.println(getEchoOverflowCount());
+      return true;
+
+    case 1:
+      text_out.print(F("Synth ISR max: "));
+      text_out.print(getSynthIsrCycles());
+      text_out.print(F(" of "));
+      text_out.print(F_CPU / SYNTH_SAMPLE_RATE);
+      text_out.println(F(" cycles"));
+      text_out.print(F("Timeline cache: "));
+      text_out.print(timeline_cache_hits);
+      text_out.print(F(" hits, "));
+      text_out.print(timeline_cache_misses);
+      text_out.println(F(" rebuilds"));
+      return true;
+
+    default:
+      #if ENABLE_PROTOCOL
+      text_out.print(F("Protocol frames: "));
+      text_out.print(proto_frames_received);
+      text_out.print(F(" ok, "));
+      text_out.print(proto_frames_rejected);
+      text_out.println(F(" rejected"));
+      #endif
+      text_out.println(F("--------------\n"));
+      return false;
+  }
+}
+
+#if ENABLE_PROFILING
+/**
+ * Print a loop() stage name, padded to one column
+ */
+void printProfileStageName(uint8_t stage) {
+  switch (stage) {
+    case PROFILE_SERIAL:   text_out.print(F("  Serial in   ")); break;
+    case PROFILE_PROTOCOL: text_out.print(F("  Protocol    ")); break;
+    case PROFILE_SENSOR:   text_out.print(F("  Sensor      ")); break;
+    case PROFILE_STORAGE:  text_out.print(F("  EEPROM      ")); break;
+    case PROFILE_PLAYBACK: text_out.print(F("  Playback    ")); break;
+    case PROFILE_NOTES:    text_out.print(F("  Note engine ")); break;
+    case PROFILE_ECHOES:   text_out.print(F("  Echoes      ")); break;
+    default:               text_out.print(F("  Output      ")); break;
+  }
+}
+
+/**
+ * Print a third of a histogram line: average and maximum, the first half
+ * of the bin counts, or the rest of the counts and the line end
+ * @param part 0, 1 or 2
+ */
+void printProfileHistogram(const ProfileHistogram* histogram, uint8_t part) {
+  if (part == 0) {
+    text_out.print(F("avg "));
+    text_out.print(histogram->count > 0 ? histogram->total / histogram->count : 0);
+    text_out.print(F(" max "));
+    text_out.print(histogram->max);
+    text_out.print(F(" |"));
+    return;
+  }
+  uint8_t first = (part - 1) * (PROFILE_HISTOGRAM_BINS / 2);
+  for (uint8_t b = first; b < first + PROFILE_HISTOGRAM_BINS / 2; b++) {
+    text_out.print(' ');
+    text_out.print(histogram->bins[b]);
+  }
+  if (part == 2) {
+    text_out.println();
+  }
+}
+#endif
+
+/**
+ * Print loop timing statistics, one section at a time, then reset them
+ * Sections: loop, the stages two at a time, then each histogram in thirds.
+ */
+bool printTimingStatsSection(uint8_t section) {
+  #if ENABLE_PROFILING
+  // Sections after the header and the stages
+  const uint8_t histograms = 1 + NUM_PROFILE_STAGES / 2;
+
+  if (section == 0) {
+    text_out.print(F("\n--- Timing ("));
+    text_out.print(profile_loops);
+    text_out.println(F(" loops, us) ---"));
+    text_out.print(F("Loop:         min "));
+    text_out.print(profile_loops > 0 ? profile_loop_min_us : 0);
+    text_out.print(F(" avg "));
+    text_out.print(profile_loops > 0 ? profile_loop_total_us / profile_loops : 0);
+    text_out.print(F(" max "));
+    text_out.println(profile_loop_max_us);
+    return true;
+  }
+
+  if (section < histograms) {
+    for (uint8_t s = (section - 1) * 2; s < section * 2; s++) {
+      printProfileStageName(s);
+      text_out.print(F("avg "));
+      text_out.print(profile_loops > 0 ? profile_stages[s].total_us / profile_loops : 0);
+      text_out.print(F(" max "));
+      text_out.println(profile_stages[s].max_us);
+    }
+    return true;
+  }
+
+  uint8_t part = (section - histograms) % 3;
+  if (section - histograms < 3) {
+    if (part == 0) {
+      // Bin edges double: 250 us / 1 ms is the first
+      text_out.println(F("Bins (x250 us / x1 ms): <1 <2 <4 <8 <16 <32 <64 >=64"));
+      text_out.print(F("Echo to decision (us): "));
+    }
+    printProfileHistogram(&profile_echo_latency, part);
+    return true;
+  }
+
+  if (part == 0) {
+    text_out.print(F("Playback late (ms):    "));
+  }
+  printProfileHistogram(&profile_playback_late, part);
+  if (part < 2) {
+    return true;
+  }
+  text_out.println(F("--------------\n"));
+  resetProfile();
+  return false;
+  #else
+  (void)section;
+  text_out.println(F("\nTiming is off (build with ENABLE_PROFILING true)."));
+  return false;
+  #endif
+}
+
+/**
+ * Print SRAM use and the stack high-water mark, one section at a time
+ */
+bool printMemoryStatsSection(uint8_t section) {
+  #if HAL_HAS_STACK_MONITOR
+  if (section == 0) {
+    text_out.println(F("\n--- Memory ---"));
+    text_out.print(F("SRAM: "));
+    text_out.print(HAL_RAM_SIZE);
+    text_out.print(F(" bytes, static (.data + .bss) "));
+    text_out.println(getStaticMemory());
+    text_out.print(F("Free now: "));
+    text_out.println(getFreeMemory());
+    text_out.print(F("Free min since last F (stack high-water): "));
+    text_out.println(getMinFreeMemory());
+    paintFreeMemory();  // The next F reports from here
+    return true;
+  }
+  text_out.print(F("Merged playback needs: "));
+  text_out.print(MEMORY_MIN_HEADROOM);
+  text_out.print(F(" (refused "));
+  text_out.print(memory_refusals);
+  text_out.println(F(" times)"));
+  text_out.print(F("Note tables kept in flash: "));
+  text_out.println((unsigned int)NOTE_TABLES_FLASH_BYTES);
+  text_out.println(F("--------------\n"));
+  return false;
+  #else
+  (void)section;
+  text_out.println(F("\nMemory is only measured on the board."));
+  text_out.print(F("Note tables kept in flash: "));
+  text_out.print((unsigned int)NOTE_TABLES_FLASH_BYTES);
+  text_out.println(F(" bytes (host pointer size)"));
+  return false;
+  #endif
+}
+
+/**
+ * Print the selected scale and key ("Major in Re")
+ */
+void printScale() {
+  status_out.print(getScaleName(getScale()));
+  status_out.print(F(" in "));
+  status_out.print(getNoteName(getKey(), true));
+  status_out.print(F(" ("));
+  status_out.print(getZoneCount());
+  status_out.print(F(" zones)"));
+}
+
+/**
+ * Switch the scale and key the zones play
+ * A note held in free play is released first: its zone may not exist in
+ * the new scale. Recordings keep their notes.
+ */
+void changeScale(uint8_t scale, uint8_t key) {
+  if (!isPlaying()) {
+    #if ENABLE_MIDI
+    sendMidiLiveNoteOff();
+    #endif
+    releaseNote();
+    releaseNoteInRecording();
+    resetNoteTracker();
+  }
+  setScale(scale, key);
+
+  status_out.print(F("\nScale set to: "));
+  printScale();
+  status_out.println();
+}
+
+/**
+ * Parse a key name: a letter A-G, optionally followed by # or b
+ * @param text Key name
+ * @return Semitones above C (0-11), or -1 if invalid
+ */
+int parseKey(const char* text) {
+  // Semitones above C of A-G
+  static const uint8_t letter_semitones[7] PROGMEM = { 9, 11, 0, 2, 4, 5, 7 };
+
+  char letter = text[0];
+  if (letter >= 'a' && letter <= 'g') {
+    letter = letter - 32;
+  }
+  if (letter < 'A' || letter > 'G') {
+    return -1;
+  }
+
+  int key = pgm_read_byte(&letter_semitones[letter - 'A']);
+  if (text[1] == '#') {
+    key++;
+  } else if (text[1] == 'b') {
+    key--;
+  } else if (text[1] != '\0') {
+    return -1;
+  }
+  return (key + 12) % 12;
+}
+
+/**
+ * Parse a decimal number of up to 4 digits
+ * @param text Digits, ending the string
+ * @return The number, or -1 if invalid
+ */
+int parseNumber(const char* text) {
+  int value = 0;
+  int digits = 0;
+  for (; text[digits] != '\0'; digits++) {
+    if (text[digits] < '0' || text[digits] > '9' || digits == 4) {
+      return -1;
     }
+    value = value * 10 + (text[digits] - '0');
   }
+  return digits > 0 ? value : -1;
+}
 
-  if (!has_recordings) {
-    Serial.println(F("\nNo recordings found."));
+/**
+ * Print the playback speed and transpose ("Speed 150%, transpose +2")
+ */
+void printPlaybackSettings() {
+  status_out.print(F("\nSpeed "));
+  status_out.print(getPlaybackSpeed());
+  status_out.print(F("%, transpose "));
+  if (getPlaybackTranspose() > 0) {
+    status_out.print('+');
   }
+  status_out.print(getPlaybackTranspose());
+  if (isLooperActive()) {
+    status_out.print(F(" (after the looper)"));
+  }
+  status_out.println();
+}
 
-  Serial.println(F("----------------------\n"));
+/**
+ * Tell when P / PA streams because the notes do not fit in the timeline
+ */
+void printStreamedFallback() {
+  if (isPlaybackStreamed()) {
+    status_out.print(F("(More than "));
+    status_out.print(MAX_TIMELINE_EVENTS);
+    status_out.println(F(" notes: merged on the fly as PS does.)"));
+  }
 }
 
 /**
@@ -122,19 +490,22 @@ void listRecordings() {
 void printOverlapStrategy(OverlapStrategy strategy) {
   switch (strategy) {
     case OVERLAP_PRIORITY_HIGH:
-      Serial.print(F("Priority High"));
+      status_out.print(F("Priority High"));
       break;
     case OVERLAP_PRIORITY_LOW:
-      Serial.print(F("Priority Low"));
+      status_out.print(F("Priority Low"));
       break;
     case OVERLAP_ALTERNATE:
-      Serial.print(F("Alternate"));
+      status_out.print(F("Alternate"));
       break;
     case OVERLAP_DROP:
-      Serial.print(F("Drop"));
+      status_out.print(F("Drop"));
+      break;
+    case OVERLAP_POLYPHONIC:
+      status_out.print(F("Polyphonic"));
       break;
     default:
-      Serial.print(F("Unknown"));
+      status_out.print(F("Unknown"));
   }
 }
 
@@ -161,42 +532,70 @@ SystemMode handleSerialCommand(char* cmd) {
 
   // ---- FREE PLAY MODE ----
   if (input == '0') {
-    Serial.println(F("\nFree play mode activated!"));
+    // As X does: a polyphonic playback left running would keep sounding
+    if (isLooperActive()) {
+      stopLooper();
+    } else if (isPlaying()) {
+      stopPlayback();
+    }
+    status_out.println(F("\nFree play mode activated!"));
     return MODE_FREE_PLAY;
   }
 
   // ---- RECORDING COMMANDS ----
   else if (input == 'R') {
     // Check for slot number in second character
-    if (cmd[1] >= '1' && cmd[1] <= '0' + NUM_RECORDING_SLOTS) {
+    if (isLooperActive()) {
+      status_out.println(F("\nLooper running: O[1-4] records into the loop."));
+    } else if (cmd[1] >= '1' && cmd[1] <= '0' + NUM_RECORDING_SLOTS) {
       int slot_num = cmd[1] - '1';
+      if (isPlaying()) {
+        stopPlayback();
+      }
       if (startRecording(slot_num)) {
-        Serial.print(F("\nRecording to Slot "));
-        Serial.print(slot_num + 1);
-        Serial.println(F("... Play some notes!"));
-        Serial.println(F("Press 'S' to stop recording.\n"));
+        status_out.print(F("\nRecording to Slot "));
+        status_out.print(slot_num + 1);
+        status_out.println(F("... Play some notes!"));
+        status_out.println(F("Press 'S' to stop recording.\n"));
         return MODE_RECORDING;
+      } else if (getLoadingSlot() != -1) {
+        status_out.println(F("\nA slot is being loaded over serial, try again shortly."));
+      } else {
+        status_out.println(F("\nAlready recording: press 'S' to stop first."));
       }
     } else {
-      Serial.println(F("\nUsage: R[1-4] (e.g., R1, R2, R3, R4)"));
+      status_out.println(F("\nUsage: R[1-4] (e.g., R1, R2, R3, R4)"));
+    }
+  }
+
+  else if (input == 'S' && isLooperActive()) {
+    int slot = endLooperTake();
+    if (slot >= 0) {
+      status_out.print(F("\nTake stopped: Slot "));
+      status_out.print(slot + 1);
+      status_out.print(F(" ("));
+      status_out.print(getSlotNoteCount(slot));
+      status_out.println(F(" notes) loops from the next pass.\n"));
+    } else {
+      status_out.println(F("\nNot currently recording."));
     }
   }
 
   else if (input == 'S') {
     if (stopRecording()) {
-      Serial.println(F("\nRecording stopped."));
+      status_out.println(F("\nRecording stopped."));
       int slot = getActiveRecordingSlot();
       if (slot >= 0) {
-        Serial.print(F("Saved to Slot "));
-        Serial.print(slot + 1);
-        Serial.print(F(" ("));
-        Serial.print(getSlotNoteCount(slot));
-        Serial.println(F(" notes)"));
+        status_out.print(F("Saved to Slot "));
+        status_out.print(slot + 1);
+        status_out.print(F(" ("));
+        status_out.print(getSlotNoteCount(slot));
+        status_out.println(F(" notes)"));
       }
-      Serial.println();
+      status_out.println();
       return MODE_FREE_PLAY;
     } else {
-      Serial.println(F("\nNot currently recording."));
+      status_out.println(F("\nNot currently recording."));
     }
   }
 
@@ -204,44 +603,120 @@ SystemMode handleSerialCommand(char* cmd) {
   else if (input == 'P') {
     char slot_char = cmd[1];
 
+    bool merged = slot_char == 'A' || slot_char == 'a' || slot_char == 'S' || slot_char == 's';
+
+    // Merging runs deepest: refuse it once the stack has come too close
+    if (merged && !checkMemoryHeadroom()) {
+      status_out.println(F("\nNot enough free memory for merged playback (see F)."));
+    }
     // Play all slots
-    if (slot_char == 'A' || slot_char == 'a') {
+    else if (slot_char == 'A' || slot_char == 'a') {
       if (playAllSlots(current_overlap_strategy)) {
-        Serial.print(F("\nPlaying all slots ("));
+        status_out.print(F("\nPlaying all slots ("));
+        printOverlapStrategy(current_overlap_strategy);
+        status_out.println(F(" mode)..."));
+        printStreamedFallback();
+        return MODE_PLAYBACK;
+      } else {
+        status_out.println(F("\nNo recordings to play."));
+      }
+    }
+    // Play all slots, merged on the fly without building a timeline
+    else if (slot_char == 'S' || slot_char == 's') {
+      if (playAllSlotsStreamed(current_overlap_strategy)) {
+        status_out.print(F("\nStreaming all slots ("));
         printOverlapStrategy(current_overlap_strategy);
-        Serial.println(F(" mode)..."));
+        status_out.println(F(" mode)..."));
         return MODE_PLAYBACK;
       } else {
-        Serial.println(F("\nNo recordings to play."));
+        status_out.println(F("\nNo recordings to play."));
       }
     }
     // Play specific slot
     else if (slot_char >= '1' && slot_char <= '0' + NUM_RECORDING_SLOTS) {
       int slot_num = slot_char - '1';
       if (playSingleSlot(slot_num)) {
-        Serial.print(F("\nPlaying Slot "));
-        Serial.print(slot_num + 1);
-        Serial.println(F("..."));
+        status_out.print(F("\nPlaying Slot "));
+        status_out.print(slot_num + 1);
+        status_out.println(F("..."));
+        printStreamedFallback();
         return MODE_PLAYBACK;
       } else {
-        Serial.print(F("\nSlot "));
-        Serial.print(slot_num + 1);
-        Serial.println(F(" is empty."));
+        status_out.print(F("\nSlot "));
+        status_out.print(slot_num + 1);
+        status_out.println(F(" is empty."));
       }
     } else {
-      Serial.println(F("\nUsage: P[1-4] or PA (e.g., P1, P2, PA)"));
+      status_out.println(F("\nUsage: P[1-4], PA or PS (e.g., P1, P2, PA)"));
     }
   }
 
   else if (input == 'X') {
-    stopPlayback();
-    Serial.println(F("\nPlayback stopped."));
+    if (isLooperActive()) {
+      stopLooper();
+    } else {
+      stopPlayback();
+    }
+    status_out.println(F("\nPlayback stopped."));
     return MODE_FREE_PLAY;
   }
 
+  // ---- SPEED AND TRANSPOSE ----
+  // Both apply during playback too, from the current position on
+  else if (input == 'V') {
+    int percent = parseNumber(&cmd[1]);
+
+    if (percent >= PLAYBACK_SPEED_MIN_PERCENT && percent <= PLAYBACK_SPEED_MAX_PERCENT) {
+      setPlaybackSpeed(percent);
+      printPlaybackSettings();
+    } else {
+      status_out.println(F("\nUsage: V[50-200] (e.g., V50 half speed, V100 as recorded, V200 double)"));
+    }
+  }
+
+  else if (input == '+' || input == '-') {
+    int semitones = cmd[1] == '\0' ? 1 : parseNumber(&cmd[1]);
+
+    if (semitones >= 0 && semitones <= 2 * PLAYBACK_TRANSPOSE_MAX) {
+      setPlaybackTranspose(getPlaybackTranspose() + (input == '+' ? semitones : -semitones));
+      printPlaybackSettings();
+    } else {
+      status_out.println(F("\nUsage: +[n] or -[n] (e.g., + up a semitone, -12 down an octave)"));
+    }
+  }
+
+  // ---- LOOPER ----
+  else if (input == 'O') {
+    if (cmd[1] >= '1' && cmd[1] <= '0' + NUM_RECORDING_SLOTS) {
+      int slot_num = cmd[1] - '1';
+      if (isLooperActive()) {
+        armLooperSlot(slot_num);
+        status_out.print(F("\nSlot "));
+        status_out.print(slot_num + 1);
+        status_out.println(F(" records from the next pass."));
+      } else if (startLooper(slot_num)) {
+        status_out.print(F("\nLooping ("));
+        status_out.print(getLooperLength() / 1000.0, 1);
+        status_out.print(F("s), recording into Slot "));
+        status_out.print(slot_num + 1);
+        status_out.println(F("... Play along!"));
+        status_out.println(F("Press 'S' to end the take, 'X' to stop.\n"));
+        return MODE_LOOPER;
+      } else if (isPlaying() || isRecording()) {
+        status_out.println(F("\nStop playback or recording first."));
+      } else if (getLoadingSlot() != -1) {
+        status_out.println(F("\nA slot is being loaded over serial, try again shortly."));
+      } else {
+        status_out.println(F("\nNothing to loop: record another slot first."));
+      }
+    } else {
+      status_out.println(F("\nUsage: O[1-4] (e.g., O2 records Slot 2 over the others)"));
+    }
+  }
+
   // ---- MANAGEMENT COMMANDS ----
   else if (input == 'L') {
-    listRecordings();
+    startOutputProducer(listRecordingsSection);
   }
 
   else if (input == 'C') {
@@ -250,35 +725,84 @@ SystemMode handleSerialCommand(char* cmd) {
     // Clear all slots
     if (slot_char == 'A' || slot_char == 'a') {
       clearAllRecordings();
-      Serial.println(F("\nAll recordings cleared."));
+      status_out.println(F("\nAll recordings cleared."));
     }
     // Clear specific slot
     else if (slot_char >= '1' && slot_char <= '0' + NUM_RECORDING_SLOTS) {
       int slot_num = slot_char - '1';
       if (clearRecordingSlot(slot_num)) {
-        Serial.print(F("\nSlot "));
-        Serial.print(slot_num + 1);
-        Serial.println(F(" cleared."));
+        status_out.print(F("\nSlot "));
+        status_out.print(slot_num + 1);
+        status_out.println(F(" cleared."));
       }
     } else {
-      Serial.println(F("\nUsage: C[1-4] or CA (e.g., C1, C2, CA)"));
+      status_out.println(F("\nUsage: C[1-4] or CA (e.g., C1, C2, CA)"));
     }
   }
 
+  else if (input == 'D') {
+    startOutputProducer(printSensorStatsSection);
+  }
+
+  else if (input == 'T') {
+    startOutputProducer(printTimingStatsSection);
+  }
+
+  else if (input == 'F') {
+    startOutputProducer(printMemoryStatsSection);
+  }
+
   // ---- OVERLAP MODE SELECTION ----
   else if (input == 'M') {
     char mode_char = cmd[1];
 
-    if (mode_char >= '1' && mode_char <= '4') {
+    if (mode_char >= '1' && mode_char <= '5') {
       current_overlap_strategy = (OverlapStrategy)(mode_char - '1');
-      Serial.print(F("\nOverlap mode set to: "));
+      invalidateTimelineCache();
+      status_out.print(F("\nOverlap mode set to: "));
       printOverlapStrategy(current_overlap_strategy);
-      Serial.println();
+      status_out.println();
+    } else {
+      status_out.println(F("\nUsage: M[1-5] (M1=High, M2=Low, M3=Alternate, M4=Drop, M5=Polyphonic)"));
+    }
+  }
+
+  // ---- SCALE AND KEY SELECTION ----
+  else if (input == 'N') {
+    char scale_char = cmd[1];
+
+    if (scale_char >= '1' && scale_char <= '0' + NUM_SCALES) {
+      changeScale(scale_char - '1', getKey());
+    } else {
+      status_out.println(F("\nUsage: N[1-5] (N1=Major, N2=Minor, N3=Pentatonic, N4=Chromatic, N5=Two octaves)"));
+    }
+  }
+
+  else if (input == 'K') {
+    int key = parseKey(&cmd[1]);
+
+    if (key >= 0) {
+      changeScale(getScale(), key);
     } else {
-      Serial.println(F("\nUsage: M[1-4] (M1=High, M2=Low, M3=Alternate, M4=Drop)"));
+      status_out.println(F("\nUsage: K<key> (e.g., KC, KD, KF#, KBb)"));
     }
   }
 
+  // ---- LIVE MIDI OUTPUT ----
+  #if ENABLE_MIDI
+  else if (input == 'I') {
+    if (!isMidiLive()) {
+      status_out.println(F("\nLive MIDI on: text paused until the next I."));
+      setOutputPaused(true);
+      setMidiLive(true);
+    } else {
+      setMidiLive(false);
+      setOutputPaused(false);
+      status_out.println(F("\nLive MIDI off."));
+    }
+  }
+  #endif
+
   // ---- HELP / INVALID COMMAND ----
   else if (input == 'H' || input == '?') {
     printMainMenu();
@@ -295,6 +819,13 @@ SystemMode processSerialInput() {
   while (Serial.available() > 0) {
     char c = Serial.read();
 
+    #if ENABLE_PROTOCOL
+    // Binary frames start with STX where a text command would start
+    if (protocolReceiveByte((uint8_t)c, buffer_index == 0, current_overlap_strategy)) {
+      continue;
+    }
+    #endif
+
     // Check for line ending
     if (c == '\n' || c == '\r') {
       if (buffer_index > 0) {
@@ -318,7 +849,7 @@ SystemMode processSerialInput() {
       input_buffer[buffer_index++] = c;
     } else {
       // Buffer overflow - reset and warn
-      Serial.println(F("\nError: Command too long!"));
+      status_out.println(F("\nError: Command too long!"));
       buffer_index = 0;
     }
   }
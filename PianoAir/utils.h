@@ -1,7 +1,7 @@
 #ifndef UTILS_H
 #define UTILS_H
 
-#include <Arduino.h>
+#include "hal.h"
 #include "config.h"
 #include "note_mapping.h"
 
@@ -9,13 +9,51 @@
 // ULTRASONIC SENSOR STATE
 // ============================================
 
-// Timing variables for ultrasonic sensor
-unsigned long last_time_ultrasonic_trigger = 0;
+// Trigger scheduler states
+enum SensorState {
+  SENSOR_IDLE = 0,          // Waiting for the re-arm gap to pass
+  SENSOR_WAITING_ECHO = 1   // Triggered, waiting for the echo to complete
+};
 
-// Pulse timing for distance calculation
-volatile unsigned long pulse_in_begin = 0;
-volatile unsigned long pulse_in_end = 0;
-volatile bool new_distance_available = false;
+// Trigger scheduler state
+SensorState sensor_state = SENSOR_IDLE;
+unsigned long sensor_trigger_time_us = 0;   // When the last ping was sent
+unsigned long sensor_ready_time_us = 0;     // Earliest time for the next ping
+
+// Set by the echo ISR when an echo pulse completes
+volatile bool echo_cycle_done = false;
+
+// Sensor statistics
+unsigned long sensor_echo_count = 0;        // Completed echoes
+unsigned long sensor_timeout_count = 0;     // Pings without an echo in time
+unsigned long sensor_rate_window_start = 0; // Start of the current 1 s window (ms)
+uint16_t sensor_window_echoes = 0;          // Echoes in the current window
+uint16_t sensor_rate_hz = 0;                // Echoes in the last full window
+
+/**
+ * One echo measurement passed from the echo ISR to loop()
+ */
+struct EchoSample {
+  unsigned long timestamp_us;  // Time the echo pulse ended (micros)
+  uint16_t width_us;           // Echo pulse width in microseconds
+};
+
+// Start of the echo pulse being measured (ISR only)
+unsigned long pulse_in_begin = 0;
+bool pulse_in_started = false;
+
+// Single-producer/single-consumer ring: the ISR only writes echo_ring_head,
+// loop() only writes echo_ring_tail. Both are single bytes, so each side
+// reads the other's index atomically without masking interrupts.
+EchoSample echo_ring[ECHO_RING_SIZE];
+volatile uint8_t echo_ring_head = 0;
+volatile uint8_t echo_ring_tail = 0;
+
+// Samples dropped because the ring was full (written by the ISR)
+volatile uint16_t echo_ring_overflows = 0;
+
+// Width of the last sample drained by loop()
+uint16_t last_echo_width_us = 0;
 
 // ============================================
 // ULTRASONIC SENSOR FUNCTIONS
@@ -34,100 +72,281 @@ void triggerUltrasonicSensor() {
 
 /**
  * Interrupt handler for echo pin
- * Measures pulse duration for distance calculation
+ * Measures pulse duration and pushes it into the echo ring
  */
 void echo_pin_interrupt() {
+  unsigned long now = micros();
+
   if (digitalRead(ECHO_PIN) == HIGH) {
-    pulse_in_begin = micros();
-  } else {
-    pulse_in_end = micros();
-    new_distance_available = true;
+    pulse_in_begin = now;
+    pulse_in_started = true;
+    return;
   }
+
+  if (!pulse_in_started) {
+    return;  // Falling edge without a matching rising edge
+  }
+  pulse_in_started = false;
+  echo_cycle_done = true;
+
+  uint8_t head = echo_ring_head;
+  uint8_t next = (head + 1) & (ECHO_RING_SIZE - 1);
+  if (next == echo_ring_tail) {
+    echo_ring_overflows++;  // Ring full: drop the newest sample
+    return;
+  }
+
+  unsigned long width = now - pulse_in_begin;
+  echo_ring[head].timestamp_us = now;
+  echo_ring[head].width_us = width > 0xFFFF ? 0xFFFF : (uint16_t)width;
+
+  // Publish the sample only after it is fully written
+  HAL_MEMORY_BARRIER();
+  echo_ring_head = next;
+}
+
+/**
+ * Take the oldest echo sample from the ring (call from main loop)
+ * @param out Output: echo sample
+ * @return true if a sample was available
+ */
+bool popEchoSample(EchoSample* out) {
+  uint8_t tail = echo_ring_tail;
+  if (tail == echo_ring_head) {
+    return false;
+  }
+
+  HAL_MEMORY_BARRIER();
+  *out = echo_ring[tail];
+  last_echo_width_us = out->width_us;
+
+  // Release the entry only after it is fully read
+  HAL_MEMORY_BARRIER();
+  echo_ring_tail = (tail + 1) & (ECHO_RING_SIZE - 1);
+
+  return true;
 }
 
 /**
- * Calculate distance from ultrasonic pulse timing
+ * Convert an echo pulse width to distance
+ * @param width_us Echo pulse width in microseconds
  * @return Distance in centimeters
  */
-float getDistance() {
-  unsigned long duration_micros = pulse_in_end - pulse_in_begin;
-  return duration_micros / 58.0;  // Convert to cm
+float echoWidthToDistance(uint16_t width_us) {
+  return width_us / 58.0;  // Convert to cm
 }
 
 /**
- * Check if new distance measurement is available
- * @return true if new measurement ready
+ * Distance of the last measurement drained from the ring
+ * @return Distance in centimeters
  */
-bool isNewDistanceAvailable() {
-  return new_distance_available;
+float getDistance() {
+  return echoWidthToDistance(last_echo_width_us);
 }
 
 /**
- * Clear the new distance flag
+ * Get number of echo samples dropped because loop() fell behind
+ * @return Overflow count
  */
-void clearDistanceFlag() {
-  new_distance_available = false;
+uint16_t getEchoOverflowCount() {
+  noInterrupts();
+  uint16_t count = echo_ring_overflows;
+  interrupts();
+  return count;
 }
 
 /**
  * Update ultrasonic sensor (call in main loop)
- * Triggers sensor at regular intervals
+ * Pings again as soon as the previous echo has completed or timed out and
+ * the re-arm gap has passed, instead of on a fixed interval.
  */
 void updateUltrasonicSensor() {
-  unsigned long time_now = millis();
-  if (time_now - last_time_ultrasonic_trigger > ULTRASONIC_TRIGGER_DELAY) {
-    last_time_ultrasonic_trigger = time_now;
+  unsigned long now_us = micros();
+
+  if (sensor_state == SENSOR_WAITING_ECHO) {
+    if (echo_cycle_done) {
+      sensor_echo_count++;
+      sensor_window_echoes++;
+      sensor_state = SENSOR_IDLE;
+      sensor_ready_time_us = now_us + ULTRASONIC_REARM_GAP_US;
+    } else if (now_us - sensor_trigger_time_us > ULTRASONIC_ECHO_TIMEOUT_US) {
+      // No echo from the playable range
+      sensor_timeout_count++;
+      sensor_state = SENSOR_IDLE;
+      sensor_ready_time_us = now_us + ULTRASONIC_REARM_GAP_US;
+    }
+  }
+
+  if (sensor_state == SENSOR_IDLE && (long)(now_us - sensor_ready_time_us) >= 0) {
+    echo_cycle_done = false;
     triggerUltrasonicSensor();
+    sensor_trigger_time_us = micros();
+    sensor_state = SENSOR_WAITING_ECHO;
+  }
+
+  // Achieved sample rate over one-second windows
+  unsigned long now_ms = millis();
+  if (now_ms - sensor_rate_window_start >= 1000) {
+    sensor_rate_hz = sensor_window_echoes;
+    sensor_window_echoes = 0;
+    sensor_rate_window_start = now_ms;
   }
 }
 
+/**
+ * Get the echo rate achieved over the last second
+ * @return Echoes per second
+ */
+uint16_t getSensorRate() {
+  return sensor_rate_hz;
+}
+
+/**
+ * Get number of pings that got no echo before the timeout
+ * @return Timeout count
+ */
+unsigned long getSensorTimeoutCount() {
+  return sensor_timeout_count;
+}
+
+/**
+ * Get number of completed echoes
+ * @return Echo count
+ */
+unsigned long getSensorEchoCount() {
+  return sensor_echo_count;
+}
+
 // ============================================
 // LED CONTROL FUNCTIONS
 // ============================================
 
+// The lit LEDs are kept as a bitmask (bit n = LED n, see getNoteLEDIndex()
+// for the LED of a note) and every change goes out as one update of the
+// whole set. With the default wiring on an Uno, Do-La are PORTB bits 5-0
+// and Si / Do* are PORTD bits 7 / 6, so a note change is two port stores
+// (~40 cycles) instead of nine digitalWrite() calls (~500 cycles). Other
+// boards, other pin choices and the host build write only the pins that
+// changed through digitalWrite().
+
+// Mask with every LED bit set
+#define ALL_LEDS_MASK ((uint8_t)((1 << NUM_NOTE_LEDS) - 1))
+
+// Port bits of all note LEDs (compile-time constants)
+#define LED_PORTB_MASK (HAL_PORTB_BIT(LED_Do) | HAL_PORTB_BIT(LED_Re) | HAL_PORTB_BIT(LED_Mi) | \
+                        HAL_PORTB_BIT(LED_Fa) | HAL_PORTB_BIT(LED_Sol) | HAL_PORTB_BIT(LED_La) | \
+                        HAL_PORTB_BIT(LED_Si) | HAL_PORTB_BIT(LED_Do_High))
+#define LED_PORTD_MASK (HAL_PORTD_BIT(LED_Do) | HAL_PORTD_BIT(LED_Re) | HAL_PORTD_BIT(LED_Mi) | \
+                        HAL_PORTD_BIT(LED_Fa) | HAL_PORTD_BIT(LED_Sol) | HAL_PORTD_BIT(LED_La) | \
+                        HAL_PORTD_BIT(LED_Si) | HAL_PORTD_BIT(LED_Do_High))
+
+// Port writes only when every LED is on pins 0-13
+#if HAL_HAS_PORTS_BD && LED_Do <= 13 && LED_Re <= 13 && LED_Mi <= 13 && LED_Fa <= 13 && \
+    LED_Sol <= 13 && LED_La <= 13 && LED_Si <= 13 && LED_Do_High <= 13
+#define LED_USE_PORT_WRITES 1
+#else
+#define LED_USE_PORT_WRITES 0
+#endif
+
+// LEDs that are lit
+uint8_t led_note_mask = 0;
+
+/**
+ * Drive the LED pins to an LED mask
+ * @param mask LEDs to light
+ * @param changed LEDs whose pins may differ from mask (fallback only)
+ */
+void writeNoteLEDs(uint8_t mask, uint8_t changed) {
+  #if LED_USE_PORT_WRITES
+  (void)changed;
+  uint8_t portb_bits = 0;
+  uint8_t portd_bits = 0;
+  #define LED_NOTE_BITS(led, pin) \
+    if (mask & (1 << (led))) { portb_bits |= HAL_PORTB_BIT(pin); portd_bits |= HAL_PORTD_BIT(pin); }
+  LED_NOTE_BITS(0, LED_Do)
+  LED_NOTE_BITS(1, LED_Re)
+  LED_NOTE_BITS(2, LED_Mi)
+  LED_NOTE_BITS(3, LED_Fa)
+  LED_NOTE_BITS(4, LED_Sol)
+  LED_NOTE_BITS(5, LED_La)
+  LED_NOTE_BITS(6, LED_Si)
+  LED_NOTE_BITS(7, LED_Do_High)
+  #undef LED_NOTE_BITS
+  halWritePortsBD(LED_PORTB_MASK, portb_bits, LED_PORTD_MASK, portd_bits);
+  #else
+  for (uint8_t led = 0; led < NUM_NOTE_LEDS; led++) {
+    uint8_t bit = 1 << led;
+    if (changed & bit) {
+      digitalWrite(getLEDPin(led), (mask & bit) ? HIGH : LOW);
+    }
+  }
+  #endif
+
+  led_note_mask = mask;
+}
+
+/**
+ * Get the LED bit of a note
+ * @param note_index Note (0 to NUM_NOTES - 1)
+ * @return Bit in the note mask, or 0 if invalid
+ */
+uint8_t getNoteLEDBit(int note_index) {
+  int led = getNoteLEDIndex(note_index);
+  if (led >= 0) {
+    return 1 << led;
+  }
+  return 0;
+}
+
+/**
+ * Light exactly the LEDs of a set of notes (chords, several voices)
+ * @param mask LED bitmask (getNoteLEDBit() of each note)
+ */
+void setNoteLEDMask(uint8_t mask) {
+  mask &= ALL_LEDS_MASK;
+  if (mask != led_note_mask) {
+    writeNoteLEDs(mask, mask ^ led_note_mask);
+  }
+}
+
+/**
+ * Get the LEDs that are lit
+ * @return LED bitmask
+ */
+uint8_t getNoteLEDMask() {
+  return led_note_mask;
+}
+
 /**
  * Turn off all LEDs
+ * Writes every pin, so it also puts the LEDs in a known state at startup.
  */
 void turnOffAllLEDs() {
-  digitalWrite(LED_Do, LOW);
-  digitalWrite(LED_Re, LOW);
-  digitalWrite(LED_Mi, LOW);
-  digitalWrite(LED_Fa, LOW);
-  digitalWrite(LED_Sol, LOW);
-  digitalWrite(LED_La, LOW);
-  digitalWrite(LED_Si, LOW);
-  digitalWrite(LED_Do_High, LOW);
+  writeNoteLEDs(0, ALL_LEDS_MASK);
 }
 
 /**
  * Light up LED for specific note
- * @param note_index Note index (0-7)
+ * @param note_index Note (0 to NUM_NOTES - 1)
  */
 void lightUpNoteLED(int note_index) {
-  int led_pin = getNoteLED(note_index);
-  if (led_pin != -1) {
-    digitalWrite(led_pin, HIGH);
-  }
+  setNoteLEDMask(led_note_mask | getNoteLEDBit(note_index));
 }
 
 /**
  * Light up LED for specific note (turn off others first)
- * @param note_index Note index (0-7)
+ * @param note_index Note (0 to NUM_NOTES - 1)
  */
 void setNoteLED(int note_index) {
-  turnOffAllLEDs();
-  lightUpNoteLED(note_index);
+  setNoteLEDMask(getNoteLEDBit(note_index));
 }
 
 /**
  * Turn off LED for specific note
- * @param note_index Note index (0-7)
+ * @param note_index Note (0 to NUM_NOTES - 1)
  */
 void turnOffNoteLED(int note_index) {
-  int led_pin = getNoteLED(note_index);
-  if (led_pin != -1) {
-    digitalWrite(led_pin, LOW);
-  }
+  setNoteLEDMask(led_note_mask & ~getNoteLEDBit(note_index));
 }
 
 // ============================================
@@ -136,7 +355,7 @@ void turnOffNoteLED(int note_index) {
 
 /**
  * Play a note on the buzzer
- * @param note_index Note index (0-7)
+ * @param note_index Note (0 to NUM_NOTES - 1)
  */
 void playNote(int note_index) {
   int frequency = getNoteFrequency(note_index);
@@ -152,16 +371,72 @@ void stopNote() {
   noTone(BUZZER_PIN);
 }
 
+// ============================================
+// NOTE ENGINE
+// ============================================
+
+// Note currently sounding on the buzzer (-1 if silent)
+int engine_note = -1;
+
+// Time at which the sounding note is released (millis)
+unsigned long engine_note_off_time = 0;
+
+/**
+ * Start a note and schedule its release at an absolute time
+ * Returns immediately; updateNoteEngine() turns the note and its LED off.
+ * Restarting the note that is already sounding only moves its release time.
+ * @param note_index Note (0 to NUM_NOTES - 1)
+ * @param off_time Release time in millis()
+ */
+void playNoteUntil(int note_index, unsigned long off_time) {
+  if (getNoteFrequency(note_index) == 0) {
+    return;  // Invalid note
+  }
+
+  if (note_index != engine_note) {
+    playNote(note_index);
+    setNoteLED(note_index);
+    engine_note = note_index;
+  }
+  engine_note_off_time = off_time;
+}
+
 /**
- * Play a note for a specific duration
- * @param note_index Note index (0-7)
+ * Play a note for a specific duration (non-blocking)
+ * @param note_index Note (0 to NUM_NOTES - 1)
  * @param duration_ms Duration in milliseconds
  */
 void playNoteWithDuration(int note_index, unsigned int duration_ms) {
-  playNote(note_index);
-  setNoteLED(note_index);
-  delay(duration_ms);
-  stopNote();
+  playNoteUntil(note_index, millis() + duration_ms);
+}
+
+/**
+ * Release the sounding note immediately
+ */
+void releaseNote() {
+  if (engine_note != -1) {
+    stopNote();
+    turnOffNoteLED(engine_note);
+    engine_note = -1;
+  }
+}
+
+/**
+ * Check if the note engine is sounding a note
+ * @return true if a note is sounding
+ */
+bool isNoteSounding() {
+  return engine_note != -1;
+}
+
+/**
+ * Update note engine (call in main loop)
+ * Releases the sounding note once its scheduled time has passed
+ */
+void updateNoteEngine() {
+  if (engine_note != -1 && (long)(millis() - engine_note_off_time) >= 0) {
+    releaseNote();
+  }
 }
 
 // ============================================
@@ -0,0 +1,551 @@
+#include "arduino_host.h"
+
+#include <stdio.h>
+#include <string>
+
+// ============================================
+// SIMULATED HARDWARE STATE
+// ============================================
+
+// Hardware TX buffer size of the AVR core
+#define HOST_SERIAL_TX_BUFFER 64
+
+// Maximum pending scheduled input changes
+#define HOST_MAX_SCHEDULED 64
+
+// Number of external interrupts (Uno: INT0 on pin 2, INT1 on pin 3)
+#define HOST_NUM_INTERRUPTS 2
+
+// EEPROM write cycle time (ATmega328P datasheet: 3.3 ms)
+#define HOST_EEPROM_WRITE_US 3300
+
+struct ScheduledPinChange {
+  uint64_t at_us;
+  uint8_t pin;
+  uint8_t level;
+};
+
+static uint64_t clock_us = 0;
+static uint8_t pin_levels[NUM_DIGITAL_PINS];
+static unsigned int tone_frequencies[NUM_DIGITAL_PINS];
+
+static void (*interrupt_handlers[HOST_NUM_INTERRUPTS])() = { NULL, NULL };
+static int interrupt_modes[HOST_NUM_INTERRUPTS];
+static bool interrupts_enabled = true;
+static bool interrupt_pending[HOST_NUM_INTERRUPTS];
+
+static void (*timer_isr)() = NULL;
+static unsigned long timer_period_us = 0;
+static uint64_t timer_next_us = 0;
+static bool timer_pending = false;
+
+static ScheduledPinChange scheduled[HOST_MAX_SCHEDULED];
+static int scheduled_count = 0;
+
+static std::string serial_input;
+static size_t serial_input_pos = 0;
+static unsigned long serial_baud = 115200;
+static int serial_tx_pending = 0;        // Bytes still in the TX buffer
+static uint64_t serial_tx_last_us = 0;   // Last time the TX buffer was drained
+static bool serial_echo = true;
+
+static HostHooks hooks = { NULL, NULL, NULL, NULL };
+
+// EEPROM contents survive hostReset(), like the real part survives a reset
+static uint8_t eeprom_data[E2END + 1];
+static unsigned long eeprom_wear[E2END + 1];
+static bool eeprom_initialized = false;
+static uint64_t eeprom_busy_until_us = 0;
+static HostEepromStats eeprom_stats = { 0, 0, 0 };
+
+HardwareSerial Serial;
+
+// ============================================
+// CLOCK
+// ============================================
+
+/**
+ * Drain the simulated TX buffer at the configured baud rate
+ */
+static void drainSerialTx() {
+  uint64_t byte_us = 10ULL * 1000000ULL / serial_baud;  // 8N1 framing
+  uint64_t drained = (clock_us - serial_tx_last_us) / byte_us;
+
+  if (drained >= (uint64_t)serial_tx_pending) {
+    serial_tx_pending = 0;
+    serial_tx_last_us = clock_us;
+  } else {
+    serial_tx_pending -= (int)drained;
+    serial_tx_last_us += drained * byte_us;
+  }
+}
+
+static void runInterrupt(int interrupt_num) {
+  if (!interrupts_enabled) {
+    interrupt_pending[interrupt_num] = true;
+    return;
+  }
+  if (interrupt_handlers[interrupt_num] != NULL) {
+    interrupts_enabled = false;  // ISRs run with interrupts masked
+    interrupt_handlers[interrupt_num]();
+    interrupts_enabled = true;
+  }
+}
+
+static void runTimerInterrupt() {
+  if (!interrupts_enabled) {
+    timer_pending = true;
+    return;
+  }
+  if (timer_isr != NULL) {
+    interrupts_enabled = false;
+    timer_isr();
+    interrupts_enabled = true;
+  }
+}
+
+static void applyInputLevel(uint8_t pin, uint8_t level) {
+  if (pin >= NUM_DIGITAL_PINS) {
+    return;
+  }
+
+  uint8_t previous = pin_levels[pin];
+  pin_levels[pin] = level;
+  if (previous == level) {
+    return;
+  }
+
+  int interrupt_num = digitalPinToInterrupt(pin);
+  if (interrupt_num == NOT_AN_INTERRUPT) {
+    return;
+  }
+
+  int mode = interrupt_modes[interrupt_num];
+  if (mode == CHANGE || (mode == RISING && level == HIGH) || (mode == FALLING && level == LOW)) {
+    runInterrupt(interrupt_num);
+  }
+}
+
+unsigned long millis() {
+  return (unsigned long)(clock_us / 1000ULL);
+}
+
+unsigned long micros() {
+  return (unsigned long)clock_us;
+}
+
+void hostAdvanceMicros(uint64_t us) {
+  uint64_t target = clock_us + us;
+
+  while (true) {
+    bool pin_due = scheduled_count > 0 && scheduled[0].at_us <= target;
+    bool tick_due = timer_isr != NULL && timer_next_us <= target;
+    if (!pin_due && !tick_due) {
+      break;
+    }
+
+    // Timer ticks and pin changes fire in time order
+    if (tick_due && (!pin_due || timer_next_us <= scheduled[0].at_us)) {
+      if (timer_next_us > clock_us) {
+        clock_us = timer_next_us;
+      }
+      timer_next_us += timer_period_us;
+      runTimerInterrupt();
+      continue;
+    }
+
+    ScheduledPinChange change = scheduled[0];
+    memmove(&scheduled[0], &scheduled[1], (scheduled_count - 1) * sizeof(ScheduledPinChange));
+    scheduled_count--;
+
+    if (change.at_us > clock_us) {
+      clock_us = change.at_us;
+    }
+    applyInputLevel(change.pin, change.level);
+  }
+
+  clock_us = target;
+}
+
+uint64_t hostMicros() {
+  return clock_us;
+}
+
+void delay(unsigned long ms) {
+  hostAdvanceMicros((uint64_t)ms * 1000ULL);
+}
+
+void delayMicroseconds(unsigned int us) {
+  hostAdvanceMicros(us);
+}
+
+// ============================================
+// PINS, TONE AND INTERRUPTS
+// ============================================
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  (void)pin;
+  (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  if (pin >= NUM_DIGITAL_PINS) {
+    return;
+  }
+
+  uint8_t level = val ? HIGH : LOW;
+  if (pin_levels[pin] != level) {
+    pin_levels[pin] = level;
+    if (hooks.on_pin_write != NULL) {
+      hooks.on_pin_write(pin, level, micros());
+    }
+  }
+}
+
+int digitalRead(uint8_t pin) {
+  if (pin >= NUM_DIGITAL_PINS) {
+    return LOW;
+  }
+  return pin_levels[pin];
+}
+
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration) {
+  (void)duration;
+  if (pin >= NUM_DIGITAL_PINS) {
+    return;
+  }
+
+  tone_frequencies[pin] = frequency;
+  if (hooks.on_tone != NULL) {
+    hooks.on_tone(pin, frequency, micros());
+  }
+}
+
+void noTone(uint8_t pin) {
+  if (pin >= NUM_DIGITAL_PINS) {
+    return;
+  }
+
+  bool was_sounding = tone_frequencies[pin] != 0;
+  tone_frequencies[pin] = 0;
+  if (was_sounding && hooks.on_no_tone != NULL) {
+    hooks.on_no_tone(pin, micros());
+  }
+}
+
+int digitalPinToInterrupt(uint8_t pin) {
+  if (pin == 2) return 0;
+  if (pin == 3) return 1;
+  return NOT_AN_INTERRUPT;
+}
+
+void attachInterrupt(int interrupt_num, void (*isr)(), int mode) {
+  if (interrupt_num >= 0 && interrupt_num < HOST_NUM_INTERRUPTS) {
+    interrupt_handlers[interrupt_num] = isr;
+    interrupt_modes[interrupt_num] = mode;
+  }
+}
+
+void detachInterrupt(int interrupt_num) {
+  if (interrupt_num >= 0 && interrupt_num < HOST_NUM_INTERRUPTS) {
+    interrupt_handlers[interrupt_num] = NULL;
+  }
+}
+
+void noInterrupts() {
+  interrupts_enabled = false;
+}
+
+void interrupts() {
+  interrupts_enabled = true;
+
+  // Service edges that arrived while interrupts were masked
+  for (int i = 0; i < HOST_NUM_INTERRUPTS; i++) {
+    if (interrupt_pending[i]) {
+      interrupt_pending[i] = false;
+      runInterrupt(i);
+    }
+  }
+  if (timer_pending) {
+    timer_pending = false;
+    runTimerInterrupt();
+  }
+}
+
+void hostStartTimer(unsigned long period_us, void (*isr)()) {
+  timer_period_us = period_us > 0 ? period_us : 1;
+  timer_next_us = clock_us + timer_period_us;
+  timer_pending = false;
+  timer_isr = isr;
+}
+
+void hostStopTimer() {
+  timer_isr = NULL;
+  timer_pending = false;
+}
+
+// ============================================
+// EEPROM
+// ============================================
+
+static void initializeEeprom() {
+  if (!eeprom_initialized) {
+    eeprom_initialized = true;
+    hostEepromErase();
+  }
+}
+
+/**
+ * Wait for a write in progress, as the AVR does before any EEPROM access
+ */
+static void waitForEeprom() {
+  if (clock_us < eeprom_busy_until_us) {
+    eeprom_stats.stalls++;
+    hostAdvanceMicros(eeprom_busy_until_us - clock_us);
+  }
+}
+
+bool eeprom_is_ready() {
+  return clock_us >= eeprom_busy_until_us;
+}
+
+uint8_t eeprom_read_byte(const uint8_t* address) {
+  initializeEeprom();
+  waitForEeprom();
+  eeprom_stats.reads++;
+  return eeprom_data[(uintptr_t)address & E2END];
+}
+
+void eeprom_write_byte(uint8_t* address, uint8_t value) {
+  initializeEeprom();
+  waitForEeprom();
+  eeprom_stats.writes++;
+  eeprom_wear[(uintptr_t)address & E2END]++;
+  eeprom_data[(uintptr_t)address & E2END] = value;
+  eeprom_busy_until_us = clock_us + HOST_EEPROM_WRITE_US;
+}
+
+// ============================================
+// PRINT
+// ============================================
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t n = 0;
+  while (size--) {
+    n += write(*buffer++);
+  }
+  return n;
+}
+
+size_t Print::printNumber(unsigned long n, int base) {
+  char buf[8 * sizeof(long) + 1];
+  char* str = &buf[sizeof(buf) - 1];
+  *str = '\0';
+
+  if (base < 2) {
+    base = 10;
+  }
+
+  do {
+    unsigned long digit = n % base;
+    n /= base;
+    *--str = digit < 10 ? '0' + digit : 'A' + digit - 10;
+  } while (n);
+
+  return write(str);
+}
+
+size_t Print::printFloat(double number, int digits) {
+  char buf[48];
+  snprintf(buf, sizeof(buf), "%.*f", digits, number);
+  return write(buf);
+}
+
+size_t Print::print(const __FlashStringHelper* str) { return write(reinterpret_cast<const char*>(str)); }
+size_t Print::print(const char* str) { return write(str); }
+size_t Print::print(char c) { return write((uint8_t)c); }
+size_t Print::print(unsigned char n, int base) { return printNumber(n, base); }
+size_t Print::print(int n, int base) { return print((long)n, base); }
+size_t Print::print(unsigned int n, int base) { return printNumber(n, base); }
+size_t Print::print(unsigned long n, int base) { return printNumber(n, base); }
+size_t Print::print(double n, int digits) { return printFloat(n, digits); }
+
+size_t Print::print(long n, int base) {
+  if (base == 10 && n < 0) {
+    return print('-') + printNumber((unsigned long)(-n), 10);
+  }
+  return printNumber((unsigned long)n, base);
+}
+
+size_t Print::println() { return write("\r\n"); }
+size_t Print::println(const __FlashStringHelper* str) { return print(str) + println(); }
+size_t Print::println(const char* str) { return print(str) + println(); }
+size_t Print::println(char c) { return print(c) + println(); }
+size_t Print::println(unsigned char n, int base) { return print(n, base) + println(); }
+size_t Print::println(int n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned int n, int base) { return print(n, base) + println(); }
+size_t Print::println(long n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned long n, int base) { return print(n, base) + println(); }
+size_t Print::println(double n, int digits) { return print(n, digits) + println(); }
+
+// ============================================
+// SERIAL
+// ============================================
+
+void HardwareSerial::begin(unsigned long baud) {
+  serial_baud = baud > 0 ? baud : 115200;
+}
+
+int HardwareSerial::available() {
+  return (int)(serial_input.size() - serial_input_pos);
+}
+
+int HardwareSerial::peek() {
+  if (serial_input_pos >= serial_input.size()) {
+    return -1;
+  }
+  return (uint8_t)serial_input[serial_input_pos];
+}
+
+int HardwareSerial::read() {
+  if (serial_input_pos >= serial_input.size()) {
+    return -1;
+  }
+  return (uint8_t)serial_input[serial_input_pos++];
+}
+
+int HardwareSerial::availableForWrite() {
+  drainSerialTx();
+  return HOST_SERIAL_TX_BUFFER - 1 - serial_tx_pending;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  // Like the AVR core, block while the TX buffer is full
+  drainSerialTx();
+  while (serial_tx_pending >= HOST_SERIAL_TX_BUFFER - 1) {
+    hostAdvanceMicros(10ULL * 1000000ULL / serial_baud);
+    drainSerialTx();
+  }
+  serial_tx_pending++;
+
+  if (serial_echo) {
+    putchar(c);
+  }
+  if (hooks.on_serial_write != NULL) {
+    hooks.on_serial_write(c);
+  }
+  return 1;
+}
+
+// ============================================
+// SIMULATION CONTROL
+// ============================================
+
+void hostSetHooks(const HostHooks& new_hooks) {
+  hooks = new_hooks;
+}
+
+void hostReset() {
+  clock_us = 0;
+  memset(pin_levels, 0, sizeof(pin_levels));
+  memset(tone_frequencies, 0, sizeof(tone_frequencies));
+  for (int i = 0; i < HOST_NUM_INTERRUPTS; i++) {
+    interrupt_handlers[i] = NULL;
+    interrupt_pending[i] = false;
+  }
+  interrupts_enabled = true;
+  timer_isr = NULL;
+  timer_pending = false;
+  scheduled_count = 0;
+  serial_input.clear();
+  serial_input_pos = 0;
+  serial_tx_pending = 0;
+  serial_tx_last_us = 0;
+  eeprom_busy_until_us = 0;
+}
+
+void hostSetInputPin(uint8_t pin, uint8_t level) {
+  applyInputLevel(pin, level ? HIGH : LOW);
+}
+
+bool hostScheduleInputPin(uint64_t at_us, uint8_t pin, uint8_t level) {
+  if (scheduled_count >= HOST_MAX_SCHEDULED) {
+    return false;
+  }
+
+  // Keep the queue ordered by time (stable for equal times)
+  int i = scheduled_count;
+  while (i > 0 && scheduled[i - 1].at_us > at_us) {
+    scheduled[i] = scheduled[i - 1];
+    i--;
+  }
+  scheduled[i].at_us = at_us;
+  scheduled[i].pin = pin;
+  scheduled[i].level = level ? HIGH : LOW;
+  scheduled_count++;
+
+  return true;
+}
+
+void hostSerialInject(const char* text) {
+  hostSerialInjectBytes((const uint8_t*)text, strlen(text));
+}
+
+void hostSerialInjectBytes(const uint8_t* data, size_t size) {
+  // Drop consumed input so the buffer does not grow without bound
+  if (serial_input_pos > 0) {
+    serial_input.erase(0, serial_input_pos);
+    serial_input_pos = 0;
+  }
+  serial_input.append((const char*)data, size);
+}
+
+void hostSetSerialEcho(bool echo) {
+  serial_echo = echo;
+}
+
+uint8_t hostGetPinLevel(uint8_t pin) {
+  return pin < NUM_DIGITAL_PINS ? pin_levels[pin] : LOW;
+}
+
+unsigned int hostGetToneFrequency(uint8_t pin) {
+  return pin < NUM_DIGITAL_PINS ? tone_frequencies[pin] : 0;
+}
+
+HostEepromStats hostGetEepromStats() {
+  return eeprom_stats;
+}
+
+unsigned long hostGetEepromWear(uint16_t address) {
+  return eeprom_wear[address & E2END];
+}
+
+void hostEepromErase() {
+  eeprom_initialized = true;
+  memset(eeprom_data, 0xFF, sizeof(eeprom_data));
+  memset(eeprom_wear, 0, sizeof(eeprom_wear));
+}
+
+bool hostEepromLoad(const char* path) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    return false;
+  }
+
+  initializeEeprom();
+  size_t n = fread(eeprom_data, 1, sizeof(eeprom_data), file);
+  fclose(file);
+  return n == sizeof(eeprom_data);
+}
+
+bool hostEepromSave(const char* path) {
+  FILE* file = fopen(path, "wb");
+  if (file == NULL) {
+    return false;
+  }
+
+  initializeEeprom();
+  size_t n = fwrite(eeprom_data, 1, sizeof(eeprom_data), file);
+  fclose(file);
+  return n == sizeof(eeprom_data);
+}
@@ -0,0 +1,254 @@
+#ifndef ARDUINO_HOST_H
+#define ARDUINO_HOST_H
+
+// ============================================
+// HOST ARDUINO RUNTIME
+// ============================================
+
+// Minimal stand-in for the Arduino core used by the host (Linux) build.
+// It provides the subset of the Arduino API the sketch uses, backed by a
+// virtual microsecond clock, simulated pins, a scripted serial port and
+// hooks that let host tools observe every tone and pin transition.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// ============================================
+// ARDUINO CONSTANTS AND TYPES
+// ============================================
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x0
+#define OUTPUT       0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE  1
+#define FALLING 2
+#define RISING  3
+
+#define DEC 10
+#define HEX 16
+#define BIN 2
+
+#define NUM_DIGITAL_PINS 20
+
+// Clock of the simulated board (Uno)
+#define F_CPU 16000000UL
+#define NOT_AN_INTERRUPT -1
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper*>(string_literal))
+
+// Flash storage is ordinary memory on the host
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t*)(addr))
+#define pgm_read_ptr(addr) (*(void* const*)(addr))
+
+// ============================================
+// CLOCK, PIN AND INTERRUPT API
+// ============================================
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration = 0);
+void noTone(uint8_t pin);
+
+int digitalPinToInterrupt(uint8_t pin);
+void attachInterrupt(int interrupt_num, void (*isr)(), int mode);
+void detachInterrupt(int interrupt_num);
+void interrupts();
+void noInterrupts();
+
+// ============================================
+// PERIODIC TIMER (HOST ONLY)
+// ============================================
+
+// Stand-in for a hardware timer compare interrupt: calls isr every
+// period_us of virtual time, interleaved in time order with scheduled
+// pin changes and held while interrupts are masked
+void hostStartTimer(unsigned long period_us, void (*isr)());
+void hostStopTimer();
+
+// ============================================
+// EEPROM API (avr/eeprom.h SUBSET)
+// ============================================
+
+// Last EEPROM address (ATmega328P: 1 KB)
+#define E2END 0x3FF
+
+// Like the AVR, a write takes ~3.3 ms; reads and writes issued before it
+// finishes wait for it (counted as stalls, see hostGetEepromStats())
+bool eeprom_is_ready();
+uint8_t eeprom_read_byte(const uint8_t* address);
+void eeprom_write_byte(uint8_t* address, uint8_t value);
+
+// ============================================
+// PRINT AND SERIAL
+// ============================================
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size);
+  size_t write(const char* str) { return str ? write((const uint8_t*)str, strlen(str)) : 0; }
+
+  size_t print(const __FlashStringHelper* str);
+  size_t print(const char* str);
+  size_t print(char c);
+  size_t print(unsigned char n, int base = DEC);
+  size_t print(int n, int base = DEC);
+  size_t print(unsigned int n, int base = DEC);
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(double n, int digits = 2);
+
+  size_t println();
+  size_t println(const __FlashStringHelper* str);
+  size_t println(const char* str);
+  size_t println(char c);
+  size_t println(unsigned char n, int base = DEC);
+  size_t println(int n, int base = DEC);
+  size_t println(unsigned int n, int base = DEC);
+  size_t println(long n, int base = DEC);
+  size_t println(unsigned long n, int base = DEC);
+  size_t println(double n, int digits = 2);
+
+ private:
+  size_t printNumber(unsigned long n, int base);
+  size_t printFloat(double n, int digits);
+};
+
+class HardwareSerial : public Print {
+ public:
+  void begin(unsigned long baud);
+  void end() {}
+  int available();
+  int peek();
+  int read();
+  int availableForWrite();
+  void flush() {}
+  size_t write(uint8_t c);
+  using Print::write;
+  operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+
+// ============================================
+// SIMULATION CONTROL (HOST ONLY)
+// ============================================
+
+/**
+ * Observers for simulated hardware activity
+ * Any callback may be NULL. Times are virtual microseconds.
+ */
+struct HostHooks {
+  void (*on_pin_write)(uint8_t pin, uint8_t level, unsigned long time_us);
+  void (*on_tone)(uint8_t pin, unsigned int frequency, unsigned long time_us);
+  void (*on_no_tone)(uint8_t pin, unsigned long time_us);
+  void (*on_serial_write)(uint8_t c);
+};
+
+/**
+ * Install observers for simulated hardware activity
+ */
+void hostSetHooks(const HostHooks& hooks);
+
+/**
+ * Reset clock, pins, interrupts and serial buffers
+ */
+void hostReset();
+
+/**
+ * Get virtual time (64-bit, does not wrap like micros())
+ */
+uint64_t hostMicros();
+
+/**
+ * Advance virtual time, firing scheduled input changes on the way
+ */
+void hostAdvanceMicros(uint64_t us);
+
+/**
+ * Drive an input pin (fires the attached interrupt on a matching edge)
+ */
+void hostSetInputPin(uint8_t pin, uint8_t level);
+
+/**
+ * Schedule an input pin change at an absolute virtual time
+ * @return false if the schedule queue is full
+ */
+bool hostScheduleInputPin(uint64_t at_us, uint8_t pin, uint8_t level);
+
+/**
+ * Queue bytes to be read from the simulated serial port
+ */
+void hostSerialInject(const char* text);
+void hostSerialInjectBytes(const uint8_t* data, size_t size);
+
+/**
+ * Echo sketch serial output to stdout (default true)
+ */
+void hostSetSerialEcho(bool echo);
+
+/**
+ * Get the level last written to an output pin
+ */
+uint8_t hostGetPinLevel(uint8_t pin);
+
+/**
+ * Get the current tone frequency on a pin (0 if silent)
+ */
+unsigned int hostGetToneFrequency(uint8_t pin);
+
+/**
+ * EEPROM activity since startup
+ */
+struct HostEepromStats {
+  unsigned long reads;            // Bytes read
+  unsigned long writes;           // Byte write cycles
+  unsigned long stalls;           // Accesses that had to wait for a write to finish
+};
+
+/**
+ * Get EEPROM access counters
+ */
+HostEepromStats hostGetEepromStats();
+
+/**
+ * Get the number of write cycles a single EEPROM cell has seen
+ */
+unsigned long hostGetEepromWear(uint16_t address);
+
+/**
+ * Fill the EEPROM with 0xFF (factory state) and clear the wear counters
+ */
+void hostEepromErase();
+
+/**
+ * Load / save the EEPROM contents from / to a file (E2END + 1 raw bytes)
+ * @return false if the file could not be read or written
+ */
+bool hostEepromLoad(const char* path);
+bool hostEepromSave(const char* path);
+
+#endif // ARDUINO_HOST_H
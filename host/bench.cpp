@@ -0,0 +1,316 @@
+/**
+ * PianoAir host benchmark
+ *
+ * Times the sketch's hot paths (note detection, recording, timeline
+ * building, playback merging and the synth interrupt) on the
+ * workstation. Absolute numbers do not transfer to the 16 MHz AVR, but
+ * relative costs and scaling do.
+ *
+ * Usage: pianoair_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <chrono>
+
+#include "PianoAir.ino"
+
+// ============================================
+// BENCHMARK HELPERS
+// ============================================
+
+// Keeps results alive so the compiler cannot drop the measured work
+volatile long bench_sink = 0;
+
+// Notes per slot for the merge benchmarks: together the slots fill the
+// PA timeline (a larger set is streamed instead of built)
+#define BENCH_NOTES_PER_SLOT (MAX_TIMELINE_EVENTS / NUM_RECORDING_SLOTS)
+
+/**
+ * Get a monotonic timestamp in nanoseconds
+ */
+static double benchNowNs() {
+  return std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Print one benchmark result line
+ */
+static void benchReport(const char* name, double total_ns, long ops) {
+  printf("%-44s %10.1f ns/op  (%ld ops)\n", name, total_ns / ops, ops);
+}
+
+/**
+ * Fill a slot through the recording API with a pseudo-random melody
+ * @param slot_num Slot number
+ * @param seed Melody seed
+ * @param max_units Longest note in DURATION_UNIT_MS units
+ * @param max_notes Stop after this many notes (the pool may fill first)
+ * @return Number of notes recorded
+ */
+static int recordSyntheticSlot(int slot_num, unsigned int seed, unsigned int max_units,
+                               int max_notes) {
+  startRecording(slot_num);
+
+  int zones = getZoneCount();
+  int zone = seed % zones;
+  while (isRecording() && getSlotNoteCount(slot_num) < max_notes) {
+    // Always change note so every call adds an event
+    seed = seed * 1103515245u + 12345u;
+    zone = (zone + 1 + (seed >> 16) % (zones - 1)) % zones;
+    if (!addNoteToRecording(getZoneNote(zone))) {
+      break;  // Pool full (recording stopped)
+    }
+    hostAdvanceMicros((uint64_t)(1 + (seed >> 8) % max_units) * DURATION_UNIT_MS * 1000ULL);
+  }
+  stopRecording();
+
+  return getSlotNoteCount(slot_num);
+}
+
+/**
+ * Fill a slot with one note struck again and again (exercises repeat runs)
+ * @param slot_num Slot number
+ * @return Number of notes recorded
+ */
+static int recordRepeatingSlot(int slot_num) {
+  startRecording(slot_num);
+
+  for (int i = 0; isRecording() && i < 1000; i++) {
+    if (!addNoteToRecording(getZoneNote(i / 16 % 2 == 0 ? 0 : 4))) {
+      break;
+    }
+    hostAdvanceMicros(3ULL * DURATION_UNIT_MS * 1000ULL);
+    releaseNoteInRecording();
+  }
+  stopRecording();
+
+  return getSlotNoteCount(slot_num);
+}
+
+// ============================================
+// BENCHMARKS
+// ============================================
+
+static void benchNoteMapping(long iterations) {
+  double start = benchNowNs();
+  for (long i = 0; i < iterations; i++) {
+    float distance = (i % 900) / 10.0f;
+    bench_sink += getZoneFromDistance(distance);
+  }
+  benchReport("getZoneFromDistance", benchNowNs() - start, iterations);
+}
+
+static void benchPulseMapping(long iterations) {
+  double start = benchNowNs();
+  for (long i = 0; i < iterations; i++) {
+    uint16_t width_us = (uint16_t)((i % 900) * 58 / 10);
+    bench_sink += getZoneFromPulseWidth(width_us);
+  }
+  benchReport("getZoneFromPulseWidth", benchNowNs() - start, iterations);
+}
+
+static void benchRecording(long iterations) {
+  long ops = 0;
+  double start = benchNowNs();
+  while (ops < iterations) {
+    ops += recordSyntheticSlot(0, (unsigned int)ops, 8, RECORDING_POOL_BYTES);
+  }
+  benchReport("record slot (per addNoteToRecording)", benchNowNs() - start, ops);
+}
+
+static void benchDecode(long iterations) {
+  long events = 0;
+  double start = benchNowNs();
+  while (events < iterations) {
+    SlotReader reader;
+    NoteEvent event;
+    beginSlotRead(0, &reader);
+    while (readNextEvent(&reader, &event)) {
+      bench_sink += event.duration_units;
+      events++;
+    }
+  }
+  benchReport("decode slot (per readNextEvent)", benchNowNs() - start, events);
+}
+
+static void benchTimeline(long iterations, OverlapStrategy strategy, const char* name) {
+  int slots[NUM_RECORDING_SLOTS];
+  int num_slots = getActiveSlots(slots);
+  long rounds = iterations / MAX_TIMELINE_EVENTS + 1;
+
+  double start = benchNowNs();
+  for (long i = 0; i < rounds; i++) {
+    invalidateTimelineCache();
+    buildTimelineFromMultipleSlots(slots, num_slots, strategy);
+    bench_sink += timeline_event_count;
+  }
+  benchReport(name, benchNowNs() - start, rounds);
+}
+
+static void benchCachedPlay(long iterations) {
+  long rounds = iterations / MAX_TIMELINE_EVENTS + 1;
+
+  double start = benchNowNs();
+  for (long i = 0; i < rounds; i++) {
+    playAllSlots(OVERLAP_PRIORITY_HIGH);
+    stopPlayback();
+  }
+  benchReport("PA start + stop (cached timeline)", benchNowNs() - start, rounds);
+}
+
+static void benchStreaming(long iterations, OverlapStrategy strategy, const char* name) {
+  int slots[NUM_RECORDING_SLOTS];
+  int num_slots = getActiveSlots(slots);
+  long events = 0;
+
+  double start = benchNowNs();
+  for (long i = 0; i < iterations / MAX_TIMELINE_EVENTS + 1; i++) {
+    TimelineEvent event;
+    beginStreamingMerge(slots, num_slots, strategy);
+    while (fetchNextStreamEvent(&event)) {
+      bench_sink += event.note_index;
+      events++;
+    }
+  }
+  benchReport(name, benchNowNs() - start, events);
+}
+
+static void benchSynthTick(long iterations) {
+  startSynth();
+  for (int v = 0; v < SYNTH_VOICES; v++) {
+    synthSetVoice(v, v * 2);
+  }
+
+  double start = benchNowNs();
+  for (long i = 0; i < iterations; i++) {
+    halSampleTimerTick();
+  }
+  benchReport("synth sample tick (4 voices)", benchNowNs() - start, iterations);
+
+  stopSynth();
+}
+
+static void benchNoteLEDs(long iterations) {
+  double start = benchNowNs();
+  for (long i = 0; i < iterations; i++) {
+    setNoteLED(i % NUM_NOTES);
+  }
+  benchReport("setNoteLED (note change)", benchNowNs() - start, iterations);
+  turnOffAllLEDs();
+}
+
+static void benchIdleLoop(long iterations) {
+  double start = benchNowNs();
+  for (long i = 0; i < iterations; i++) {
+    loop();
+    hostAdvanceMicros(100);
+  }
+  benchReport("loop() idle iteration", benchNowNs() - start, iterations);
+}
+
+// Serial bytes written by the sketch (hook)
+static unsigned long bench_serial_bytes = 0;
+
+static void benchCountSerial(uint8_t c) {
+  (void)c;
+  bench_serial_bytes++;
+}
+
+/**
+ * Report how long loop() stalls while a command's reply is sent
+ * Runs in virtual time: a blocking serial write shows up as one long
+ * loop() iteration.
+ */
+static void reportSerialStall(const char* command, const char* name) {
+  HostHooks hooks = {};
+  hooks.on_serial_write = benchCountSerial;
+  hostSetHooks(hooks);
+  bench_serial_bytes = 0;
+  unsigned long overflows = output_overflows;
+
+  hostSerialInjectBytes((const uint8_t*)command, strlen(command));
+  uint64_t start = hostMicros();
+  uint64_t longest = 0;
+  while (true) {
+    uint64_t before = hostMicros();
+    loop();
+    uint64_t spent = hostMicros() - before;
+    if (spent > longest) {
+      longest = spent;
+    }
+    if (!isOutputPending() && Serial.availableForWrite() >= 63) {
+      break;
+    }
+    hostAdvanceMicros(100);
+  }
+
+  printf("  %-22s %5lu bytes in %6.1f ms, longest loop() %5.2f ms, %lu overflows\n",
+         name, bench_serial_bytes, (hostMicros() - start) / 1000.0, longest / 1000.0,
+         output_overflows - overflows);
+  hostSetHooks(HostHooks());
+}
+
+/**
+ * Report how many notes one take can hold for typical note lengths
+ */
+static void reportDensity() {
+  clearAllRecordings();
+  printf("Single-take capacity (%d byte pool, 2-byte events held %d notes):\n",
+         RECORDING_POOL_BYTES, RECORDING_POOL_BYTES / 2);
+
+  int notes = recordSyntheticSlot(0, 1, 15, RECORDING_POOL_BYTES);
+  printf("  notes up to 1.5 s:      %4d notes  %.2f bytes/note\n",
+         notes, getSlotBytesUsed(0) / (double)notes);
+
+  notes = recordSyntheticSlot(0, 1, 40, RECORDING_POOL_BYTES);
+  printf("  notes up to 4 s:        %4d notes  %.2f bytes/note\n",
+         notes, getSlotBytesUsed(0) / (double)notes);
+
+  notes = recordRepeatingSlot(0);
+  printf("  repeated strikes:       %4d notes  %.2f bytes/note\n",
+         notes, getSlotBytesUsed(0) / (double)notes);
+}
+
+// ============================================
+// MAIN
+// ============================================
+
+int main(int argc, char** argv) {
+  long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+  if (iterations <= 0) {
+    iterations = 1000000;
+  }
+
+  hostReset();
+  hostSetSerialEcho(false);
+  setup();
+
+  benchNoteMapping(iterations);
+  benchPulseMapping(iterations);
+  benchRecording(iterations / 10);
+  benchDecode(iterations);
+
+  for (int s = 0; s < NUM_RECORDING_SLOTS; s++) {
+    recordSyntheticSlot(s, 17u * (s + 1), 8, BENCH_NOTES_PER_SLOT);
+  }
+
+  benchTimeline(iterations, OVERLAP_PRIORITY_HIGH, "build merged timeline (High)");
+  benchTimeline(iterations, OVERLAP_ALTERNATE, "build merged timeline (Alternate)");
+  benchCachedPlay(iterations);
+  benchStreaming(iterations, OVERLAP_PRIORITY_HIGH, "streaming merge (High, per event)");
+  benchStreaming(iterations, OVERLAP_ALTERNATE, "streaming merge (Alternate, per event)");
+  benchSynthTick(iterations);
+  benchNoteLEDs(iterations);
+  benchIdleLoop(iterations / 10);
+
+  printf("\n");
+  reportDensity();
+
+  printf("\nSerial replies (virtual time, loop() every 100 us):\n");
+  reportSerialStall("H\n", "H (menu)");
+  reportSerialStall("L\n", "L (recordings)");
+  reportSerialStall("D\n", "D (diagnostics)");
+
+  return 0;
+}
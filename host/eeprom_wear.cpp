@@ -0,0 +1,205 @@
+/**
+ * PianoAir EEPROM wear and power-fail test
+ *
+ * Drives the recording log in storage.h through many record / clear
+ * cycles on the simulated EEPROM and reports:
+ * - wear: write cycles per cell and the projected number of saves before
+ *   the most-written cell reaches the 100,000-cycle datasheet endurance
+ * - blocking: EEPROM accesses that had to wait for a write (should be 0)
+ * - restore: after every cycle the board is "reset" (optionally in the
+ *   middle of a save) and each slot must come back as either its last
+ *   fully saved version or its current version
+ *
+ * Usage: pianoair_wear [--cycles N] [--seed N] [--power-fail] [--eeprom FILE]
+ */
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+
+#include "PianoAir.ino"
+
+// ============================================
+// TEST HELPERS
+// ============================================
+
+// Rated EEPROM endurance (ATmega328P datasheet)
+#define EEPROM_ENDURANCE_CYCLES 100000UL
+
+// Loop step while saving (us)
+#define WEAR_STEP_US 100
+
+typedef std::vector<uint8_t> SlotImage;
+
+static unsigned int rng_state = 1;
+
+static unsigned int nextRandom() {
+  rng_state = rng_state * 1103515245u + 12345u;
+  return rng_state >> 8;
+}
+
+/**
+ * Get the encoded bytes of a slot ("" if empty)
+ */
+static SlotImage captureSlot(int slot_num) {
+  SlotImage image;
+  if (!isSlotActive(slot_num)) {
+    return image;
+  }
+
+  SlotReader reader;
+  beginSlotRead(slot_num, &reader);
+  while (reader.remaining > 0) {
+    image.push_back(readSlotByte(&reader));
+  }
+  return image;
+}
+
+/**
+ * Record a random take into a slot through the recording API
+ */
+static void recordRandomTake(int slot_num) {
+  startRecording(slot_num);
+
+  int notes = 1 + nextRandom() % 60;
+  for (int i = 0; i < notes && isRecording(); i++) {
+    if (!addNoteToRecording(getZoneNote(nextRandom() % getZoneCount()))) {
+      break;
+    }
+    releaseNoteInRecording();
+    hostAdvanceMicros((uint64_t)(1 + nextRandom() % 20) * DURATION_UNIT_MS * 1000ULL);
+  }
+  stopRecording();
+}
+
+/**
+ * Run loop() until every slot is saved
+ * @param max_steps Stop early after this many iterations (power cut)
+ * @return Iterations run
+ */
+static long runUntilSaved(long max_steps) {
+  long steps = 0;
+  while (!isStorageIdle() && steps < max_steps) {
+    loop();
+    hostAdvanceMicros(WEAR_STEP_US);
+    steps++;
+  }
+  return steps;
+}
+
+// ============================================
+// MAIN
+// ============================================
+
+int main(int argc, char** argv) {
+  long cycles = 2000;
+  bool power_fail = false;
+  const char* eeprom_path = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--cycles" && i + 1 < argc) {
+      cycles = atol(argv[++i]);
+    } else if (arg == "--seed" && i + 1 < argc) {
+      rng_state = strtoul(argv[++i], NULL, 10);
+    } else if (arg == "--power-fail") {
+      power_fail = true;
+    } else if (arg == "--eeprom" && i + 1 < argc) {
+      eeprom_path = argv[++i];
+    } else {
+      fprintf(stderr, "Usage: %s [--cycles N] [--seed N] [--power-fail] [--eeprom FILE]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  hostReset();
+  hostEepromErase();
+  hostSetSerialEcho(false);
+  setup();
+
+  // Last version of each slot known to be fully saved
+  SlotImage saved[NUM_RECORDING_SLOTS];
+  long restore_errors = 0;
+  long saves = 0;
+  long save_steps_max = 0;
+  unsigned long scan_reads_max = 0;
+
+  for (long cycle = 0; cycle < cycles; cycle++) {
+    int slot_num = nextRandom() % NUM_RECORDING_SLOTS;
+    if (nextRandom() % 4 == 0) {
+      clearRecordingSlot(slot_num);
+    } else {
+      recordRandomTake(slot_num);
+    }
+    saves++;
+
+    SlotImage current[NUM_RECORDING_SLOTS];
+    for (int s = 0; s < NUM_RECORDING_SLOTS; s++) {
+      current[s] = captureSlot(s);
+    }
+
+    // Save, or cut the power part-way through
+    long limit = power_fail ? (long)(nextRandom() % 2000) : 1000000L;
+    long steps = runUntilSaved(limit);
+    bool completed = isStorageIdle();
+    if (completed) {
+      if (steps > save_steps_max) {
+        save_steps_max = steps;
+      }
+      for (int s = 0; s < NUM_RECORDING_SLOTS; s++) {
+        saved[s] = current[s];
+      }
+    }
+
+    // Reset the board and check what comes back
+    HostEepromStats before = hostGetEepromStats();
+    hostReset();
+    setup();
+    unsigned long scan_reads = hostGetEepromStats().reads - before.reads;
+    if (scan_reads > scan_reads_max) {
+      scan_reads_max = scan_reads;
+    }
+
+    for (int s = 0; s < NUM_RECORDING_SLOTS; s++) {
+      SlotImage restored = captureSlot(s);
+      if (restored != current[s] && restored != saved[s]) {
+        restore_errors++;
+      }
+      // Whatever survived is what the next save starts from
+      saved[s] = restored;
+    }
+  }
+
+  // Wear report
+  unsigned long wear_max = 0;
+  unsigned long wear_min = 0xFFFFFFFFUL;
+  unsigned long wear_total = 0;
+  for (uint16_t a = EEPROM_LOG_START; a < EEPROM_LOG_START + EEPROM_LOG_SIZE; a++) {
+    unsigned long wear = hostGetEepromWear(a);
+    wear_total += wear;
+    if (wear > wear_max) wear_max = wear;
+    if (wear < wear_min) wear_min = wear;
+  }
+
+  HostEepromStats stats = hostGetEepromStats();
+  printf("Cycles:                 %ld (%s)\n", cycles, power_fail ? "random power cuts" : "clean saves");
+  printf("Byte writes:            %lu (%.1f per save)\n", stats.writes, stats.writes / (double)saves);
+  printf("Cell wear:              min %lu  mean %.1f  max %lu\n",
+         wear_min, wear_total / (double)EEPROM_LOG_SIZE, wear_max);
+  if (wear_max > 0) {
+    printf("Saves to endurance:     ~%.0f (most-written cell at %lu cycles)\n",
+           saves * (double)EEPROM_ENDURANCE_CYCLES / wear_max, EEPROM_ENDURANCE_CYCLES);
+  }
+  printf("Longest save:           %.1f ms\n", save_steps_max * WEAR_STEP_US / 1000.0);
+  printf("Startup scan:           %lu EEPROM reads max\n", scan_reads_max);
+  printf("Blocking EEPROM waits:  %lu\n", stats.stalls);
+  printf("Save failures:          %u\n", storage_failures);
+  printf("Restore errors:         %ld\n", restore_errors);
+
+  if (eeprom_path != NULL && !hostEepromSave(eeprom_path)) {
+    fprintf(stderr, "Cannot write %s\n", eeprom_path);
+    return 1;
+  }
+
+  return restore_errors == 0 && stats.stalls == 0 ? 0 : 1;
+}
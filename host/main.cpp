@@ -0,0 +1,139 @@
+/**
+ * PianoAir host runner
+ *
+ * Runs the unmodified sketch on the simulated clock. Serial commands are
+ * read from stdin: a plain line is sent at startup, a line of the form
+ * "@<ms> <command>" is sent when the virtual clock reaches <ms>.
+ * An optional hand distance makes the simulated HC-SR04 answer every
+ * trigger pulse with the matching echo. With --eeprom the simulated
+ * EEPROM is loaded from FILE (if it exists) and written back at exit, so
+ * recordings persist between runs.
+ *
+ * Usage: pianoair_host [--ms N] [--step-us N] [--distance CM] [--eeprom FILE] < script
+ */
+
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+#include <string>
+
+#include "PianoAir.ino"
+
+// ============================================
+// RUNNER STATE
+// ============================================
+
+// Serial command waiting for its send time
+struct ScriptLine {
+  unsigned long at_ms;
+  std::string text;
+};
+
+// Hand distance answered by the simulated sensor (cm, <= 0 for no echo)
+static double hand_distance_cm = 0;
+
+// Delay between the trigger pulse and the start of the echo (us)
+#define SENSOR_ECHO_DELAY_US 450
+
+// ============================================
+// SIMULATED SENSOR
+// ============================================
+
+/**
+ * Answer a trigger pulse with an echo for the current hand distance
+ */
+static void onPinWrite(uint8_t pin, uint8_t level, unsigned long time_us) {
+  (void)time_us;
+  if (pin != TRIGGER_PIN || level != LOW || hand_distance_cm <= 0) {
+    return;
+  }
+
+  uint64_t echo_start = hostMicros() + SENSOR_ECHO_DELAY_US;
+  uint64_t echo_width = (uint64_t)(hand_distance_cm * 58.0);
+  hostScheduleInputPin(echo_start, ECHO_PIN, HIGH);
+  hostScheduleInputPin(echo_start + echo_width, ECHO_PIN, LOW);
+}
+
+/**
+ * Order script lines by send time
+ */
+static bool compareScriptLines(const ScriptLine& a, const ScriptLine& b) {
+  return a.at_ms < b.at_ms;
+}
+
+// ============================================
+// MAIN
+// ============================================
+
+int main(int argc, char** argv) {
+  unsigned long run_ms = 10000;
+  unsigned long step_us = 100;
+  const char* eeprom_path = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--ms" && i + 1 < argc) {
+      run_ms = strtoul(argv[++i], NULL, 10);
+    } else if (arg == "--step-us" && i + 1 < argc) {
+      step_us = strtoul(argv[++i], NULL, 10);
+    } else if (arg == "--distance" && i + 1 < argc) {
+      hand_distance_cm = atof(argv[++i]);
+    } else if (arg == "--eeprom" && i + 1 < argc) {
+      eeprom_path = argv[++i];
+    } else {
+      fprintf(stderr, "Usage: %s [--ms N] [--step-us N] [--distance CM] [--eeprom FILE] < script\n",
+              argv[0]);
+      return 2;
+    }
+  }
+
+  // Read the command script
+  std::vector<ScriptLine> script;
+  char line[256];
+  while (fgets(line, sizeof(line), stdin) != NULL) {
+    ScriptLine entry;
+    entry.at_ms = 0;
+    entry.text = line;
+
+    if (line[0] == '@') {
+      char* rest = NULL;
+      entry.at_ms = strtoul(line + 1, &rest, 10);
+      while (*rest == ' ') {
+        rest++;
+      }
+      entry.text = rest;
+    }
+    if (entry.text.empty() || entry.text[entry.text.size() - 1] != '\n') {
+      entry.text += '\n';
+    }
+    script.push_back(entry);
+  }
+  std::stable_sort(script.begin(), script.end(), compareScriptLines);
+
+  hostReset();
+  if (eeprom_path != NULL) {
+    hostEepromLoad(eeprom_path);  // Missing file: start from an erased EEPROM
+  }
+  HostHooks hooks = { onPinWrite, NULL, NULL, NULL };
+  hostSetHooks(hooks);
+
+  setup();
+
+  size_t next_line = 0;
+  while (millis() < run_ms) {
+    while (next_line < script.size() && script[next_line].at_ms <= millis()) {
+      hostSerialInject(script[next_line].text.c_str());
+      next_line++;
+    }
+
+    loop();
+    hostAdvanceMicros(step_us);
+  }
+
+  if (eeprom_path != NULL && !hostEepromSave(eeprom_path)) {
+    fprintf(stderr, "Cannot write %s\n", eeprom_path);
+    return 1;
+  }
+
+  return 0;
+}
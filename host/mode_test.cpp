@@ -0,0 +1,132 @@
+/**
+ * PianoAir mode change test
+ *
+ * Checks that leaving playback through a command silences it:
+ * - 0 after PA (single voice and M5 polyphonic) stops playback, the
+ *   buzzer and the synth
+ * - R[n] during PA stops playback before recording starts
+ * Exits with status 1 if a check fails (run by ctest).
+ *
+ * Usage: pianoair_mode_test
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "PianoAir.ino"
+
+// ============================================
+// TEST HELPERS
+// ============================================
+
+// loop() step (us)
+#define MODE_TEST_STEP_US 100
+
+int failures = 0;
+
+/**
+ * Fill slots 1 and 2 with long notes, so playback is still running when
+ * the next command arrives
+ */
+static void recordLongSlots() {
+  uint8_t bytes[2];
+  for (int s = 0; s < 2; s++) {
+    beginSlotLoad(s);
+    for (int i = 0; i < 4; i++) {
+      bytes[0] = EVENT_LONG_FORM | (12 + i * 2 + s * 5);
+      bytes[1] = 30;  // 3 s
+      loadSlotBytes(bytes, 2);
+    }
+    endSlotLoad();
+  }
+}
+
+/**
+ * Run loop() on the virtual clock
+ */
+static void runFor(unsigned long ms) {
+  for (unsigned long t = 0; t < ms * 1000UL; t += MODE_TEST_STEP_US) {
+    loop();
+    hostAdvanceMicros(MODE_TEST_STEP_US);
+  }
+}
+
+/**
+ * Send a text command and let loop() handle it
+ */
+static void sendCommand(const char* command) {
+  hostSerialInjectBytes((const uint8_t*)command, strlen(command));
+  runFor(50);
+}
+
+/**
+ * Check that nothing is sounding any more
+ * @param polyphonic The synth voices were in use (M5)
+ */
+static void checkSilent(const char* name, bool polyphonic) {
+  bool voices_off = true;
+  for (uint8_t v = 0; polyphonic && v < SYNTH_VOICES; v++) {
+    if (getSynthVoiceNote(v) != -1) {
+      voices_off = false;
+    }
+  }
+  bool ok = !isPlaying() && !isSynthRunning() && voices_off &&
+            hostGetToneFrequency(BUZZER_PIN) == 0;
+  printf("  %-14s playing %d, synth %d, voices %s, buzzer %u Hz  %s\n", name, isPlaying(),
+         isSynthRunning(), voices_off ? "off" : "on", hostGetToneFrequency(BUZZER_PIN),
+         ok ? "ok" : "FAIL");
+  if (!ok) {
+    failures++;
+  }
+}
+
+/**
+ * Start PA with an overlap mode, from a stopped state, and check that it
+ * is running
+ */
+static void startMergedPlayback(const char* mode_command) {
+  sendCommand("X\n");
+  sendCommand(mode_command);
+  sendCommand("PA\n");
+  if (!isPlaying()) {
+    printf("  PA did not start after %s", mode_command);
+    failures++;
+  }
+}
+
+// ============================================
+// MAIN
+// ============================================
+
+int main() {
+  hostReset();
+  hostSetSerialEcho(false);
+  setup();
+  recordLongSlots();
+
+  printf("Five seconds after leaving playback:\n");
+
+  startMergedPlayback("M1\n");
+  sendCommand("0\n");
+  runFor(5000);
+  checkSilent("M1, PA, 0", false);
+
+  startMergedPlayback("M5\n");
+  sendCommand("0\n");
+  runFor(5000);
+  checkSilent("M5, PA, 0", true);
+
+  startMergedPlayback("M5\n");
+  sendCommand("R3\n");
+  runFor(5000);
+  bool recording = isRecording();
+  sendCommand("S\n");
+  checkSilent("M5, PA, R3", true);
+  if (!recording) {
+    printf("  R3 did not start recording\n");
+    failures++;
+  }
+
+  printf("Result: %s\n", failures == 0 ? "PASS" : "FAIL");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+/**
+ * PianoAir serial output test
+ *
+ * Checks that the text replies never block loop() (see output.h):
+ * - every section of the L, D, T and F listings fits in
+ *   OUTPUT_SECTION_ITEMS queue items
+ * - H, L, D, T and F, with every slot recorded, are sent without a single
+ *   queue overflow and without a long loop() iteration
+ * Exits with status 1 if a check fails (run by ctest).
+ *
+ * Usage: pianoair_output_test
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "PianoAir.ino"
+
+// ============================================
+// TEST HELPERS
+// ============================================
+
+// A loop() iteration this long means a serial write waited (us)
+#define OUTPUT_TEST_MAX_LOOP_US 1000
+
+int failures = 0;
+
+/**
+ * Fill every slot with a take, together using most of the pool
+ */
+static void recordAllSlots() {
+  uint8_t bytes[2];
+  for (int s = 0; s < NUM_RECORDING_SLOTS; s++) {
+    beginSlotLoad(s);
+    for (int i = 0; i < 25; i++) {
+      bytes[0] = EVENT_LONG_FORM | (10 + (i * 7 + s) % 17);
+      bytes[1] = 3 + i % 20;
+      loadSlotBytes(bytes, 2);
+    }
+    endSlotLoad();
+  }
+}
+
+/**
+ * Check that each section of a listing queues at most OUTPUT_SECTION_ITEMS
+ */
+static void checkSections(OutputProducer producer, const char* name) {
+  uint8_t section = 0;
+  uint8_t largest = 0;
+  bool more = true;
+
+  while (more) {
+    flushOutput();
+    more = producer(section++);
+    if (output_rings[1].count > largest) {
+      largest = output_rings[1].count;
+    }
+  }
+  flushOutput();
+
+  bool ok = largest <= OUTPUT_SECTION_ITEMS;
+  printf("  %-4s %2d sections, largest %2d items  %s\n", name, section, largest,
+         ok ? "ok" : "FAIL");
+  if (!ok) {
+    failures++;
+  }
+}
+
+/**
+ * Send a command and run loop() until its reply has gone out
+ */
+static void checkReply(const char* command, const char* name) {
+  unsigned long overflows = output_overflows;
+  uint64_t start = hostMicros();
+  uint64_t longest = 0;
+
+  hostSerialInjectBytes((const uint8_t*)command, strlen(command));
+  do {
+    uint64_t before = hostMicros();
+    loop();
+    if (hostMicros() - before > longest) {
+      longest = hostMicros() - before;
+    }
+    hostAdvanceMicros(100);
+  } while (isOutputPending() || Serial.availableForWrite() < 63);
+
+  unsigned long overflowed = output_overflows - overflows;
+  bool ok = overflowed == 0 && longest < OUTPUT_TEST_MAX_LOOP_US;
+  printf("  %-4s %6.1f ms, longest loop() %5.2f ms, %lu overflows  %s\n", name,
+         (hostMicros() - start) / 1000.0, longest / 1000.0, overflowed, ok ? "ok" : "FAIL");
+  if (!ok) {
+    failures++;
+  }
+}
+
+// ============================================
+// MAIN
+// ============================================
+
+int main() {
+  hostReset();
+  hostSetSerialEcho(false);
+  setup();
+  recordAllSlots();
+  flushOutput();
+
+  printf("Listing sections (%d items each at most):\n", OUTPUT_SECTION_ITEMS);
+  checkSections(listRecordingsSection, "L");
+  checkSections(printSensorStatsSection, "D");
+  checkSections(printTimingStatsSection, "T");
+  checkSections(printMemoryStatsSection, "F");
+
+  printf("Replies with %d slots recorded:\n", NUM_RECORDING_SLOTS);
+  checkReply("H\n", "H");
+  checkReply("L\n", "L");
+  checkReply("D\n", "D");
+  checkReply("T\n", "T");
+  checkReply("F\n", "F");
+
+  printf("Result: %s\n", failures == 0 ? "PASS" : "FAIL");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,823 @@
+/**
+ * PianoAir binary protocol client and transfer test
+ *
+ * Talks to the sketch over the simulated serial port the way a PC client
+ * would over USB: frames are sent at the wire rate (115200 baud, 8N1) and
+ * the replies are collected from the sketch's output, skipping any text
+ * between frames. The test
+ * - fills every slot with random takes and queries STATUS
+ * - dumps the full slot set, clears it, loads it back and compares
+ * - dumps the timeline of the first slot and compares it with the board's
+ * - exports MIDI files (each slot, the merge, one track per slot) and
+ *   checks the notes against the slots and the merged timeline
+ * - sends text commands between frames and a frame with a bad CRC
+ * and reports bytes on the wire and transfer times on the virtual clock.
+ *
+ * Usage: pianoair_proto [--seed N] [--dump FILE] [--load FILE] [--midi FILE]
+ *   --dump FILE  write the slot set (one slot per line, hex) after the test
+ *   --load FILE  start from a slot set written by --dump instead of random takes
+ *   --midi FILE  write the merged MIDI export (Standard MIDI File)
+ */
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "PianoAir.ino"
+
+// ============================================
+// CLIENT STATE
+// ============================================
+
+// Time for one byte on the wire (8N1 at the sketch's 115200 baud)
+#define WIRE_BYTE_US (10.0 * 1000000.0 / 115200.0)
+
+// Loop step while waiting for replies (us)
+#define CLIENT_STEP_US 50
+
+// Give up on a reply after this long (us)
+#define CLIENT_TIMEOUT_US 500000ULL
+
+struct Frame {
+  uint8_t command;
+  std::vector<uint8_t> payload;
+};
+
+typedef std::vector<uint8_t> SlotImage;
+
+// One note of a MIDI track (times in ticks = ms)
+struct MidiNote {
+  unsigned long start;
+  int note_index;
+  unsigned long duration;
+
+  bool operator==(const MidiNote& other) const {
+    return start == other.start && note_index == other.note_index && duration == other.duration;
+  }
+};
+
+typedef std::vector<MidiNote> MidiTrack;
+
+static std::vector<uint8_t> rx_bytes;   // Sketch output not parsed yet
+static std::string rx_text;             // Text seen between frames
+static std::vector<Frame> rx_frames;    // Parsed replies
+static unsigned long bytes_up = 0;
+static unsigned long bytes_down = 0;
+static unsigned long crc_errors = 0;
+
+static unsigned int rng_state = 1;
+
+static unsigned int nextRandom() {
+  rng_state = rng_state * 1103515245u + 12345u;
+  return rng_state >> 8;
+}
+
+static void onSerialWrite(uint8_t c) {
+  rx_bytes.push_back(c);
+  bytes_down++;
+}
+
+// ============================================
+// FRAMING
+// ============================================
+
+/**
+ * Parse complete frames out of the sketch output
+ */
+static void parseReplies() {
+  size_t pos = 0;
+  while (pos < rx_bytes.size()) {
+    if (rx_bytes[pos] != PROTO_STX) {
+      rx_text += (char)rx_bytes[pos++];
+      continue;
+    }
+    if (pos + 2 >= rx_bytes.size()) {
+      break;
+    }
+    size_t length = rx_bytes[pos + 1];
+    size_t end = pos + 3 + length;
+    if (end >= rx_bytes.size()) {
+      break;  // Incomplete
+    }
+
+    uint8_t crc = 0;
+    for (size_t i = pos + 1; i < end; i++) {
+      crc = crc8Update(crc, rx_bytes[i]);
+    }
+    if (crc != rx_bytes[end]) {
+      crc_errors++;
+      pos++;
+      continue;
+    }
+
+    Frame frame;
+    frame.command = rx_bytes[pos + 2];
+    frame.payload.assign(rx_bytes.begin() + pos + 3, rx_bytes.begin() + end);
+    rx_frames.push_back(frame);
+    pos = end + 1;
+  }
+  rx_bytes.erase(rx_bytes.begin(), rx_bytes.begin() + pos);
+}
+
+/**
+ * Run the sketch for a while at the client's step
+ */
+static void runFor(double us) {
+  for (double t = 0; t < us; t += CLIENT_STEP_US) {
+    loop();
+    hostAdvanceMicros(CLIENT_STEP_US);
+  }
+}
+
+/**
+ * Send a frame at the wire rate
+ * @param corrupt Send a wrong CRC
+ */
+static void sendFrame(uint8_t command, const std::vector<uint8_t>& payload, bool corrupt = false) {
+  std::vector<uint8_t> frame;
+  frame.push_back(PROTO_STX);
+  frame.push_back((uint8_t)payload.size());
+  frame.push_back(command);
+  frame.insert(frame.end(), payload.begin(), payload.end());
+
+  uint8_t crc = 0;
+  for (size_t i = 1; i < frame.size(); i++) {
+    crc = crc8Update(crc, frame[i]);
+  }
+  frame.push_back(corrupt ? (uint8_t)~crc : crc);
+
+  // The last byte arrives one frame time after the first
+  for (size_t i = 0; i < frame.size(); i++) {
+    hostSerialInjectBytes(&frame[i], 1);
+    runFor(WIRE_BYTE_US);
+  }
+  bytes_up += frame.size();
+}
+
+/**
+ * Send a text command (as typed in the serial monitor)
+ */
+static void sendText(const char* text) {
+  for (const char* p = text; *p; p++) {
+    hostSerialInjectBytes((const uint8_t*)p, 1);
+    runFor(WIRE_BYTE_US);
+  }
+  bytes_up += strlen(text);
+}
+
+/**
+ * Wait for a reply with the given code
+ * @return true if it arrived (removed from the queue into *out)
+ */
+static bool waitFrame(uint8_t command, Frame* out) {
+  uint64_t deadline = hostMicros() + CLIENT_TIMEOUT_US;
+  while (hostMicros() < deadline) {
+    parseReplies();
+    for (size_t i = 0; i < rx_frames.size(); i++) {
+      if (rx_frames[i].command == command) {
+        *out = rx_frames[i];
+        rx_frames.erase(rx_frames.begin() + i);
+        return true;
+      }
+    }
+    runFor(CLIENT_STEP_US);
+  }
+  return false;
+}
+
+/**
+ * Wait for an ACK of a command
+ * @return Status code, or -1 on timeout
+ */
+static int waitAck(uint8_t command, uint16_t* value = NULL) {
+  Frame frame;
+  while (waitFrame(PROTO_RSP_ACK, &frame)) {
+    if (frame.payload.size() >= 2 && frame.payload[0] == command) {
+      if (value != NULL && frame.payload.size() >= 4) {
+        *value = frame.payload[2] | (frame.payload[3] << 8);
+      }
+      return frame.payload[1];
+    }
+  }
+  return -1;
+}
+
+/**
+ * Wait until the sketch's TX buffer has drained to the wire
+ */
+static void waitTxDrained() {
+  while (Serial.availableForWrite() < 63) {
+    runFor(CLIENT_STEP_US);
+  }
+}
+
+// ============================================
+// TRANSFERS
+// ============================================
+
+/**
+ * Download one slot
+ * @return false on a protocol error
+ */
+static bool dumpSlot(uint8_t slot_num, SlotImage* image) {
+  image->clear();
+  sendFrame(PROTO_CMD_SLOT_DUMP, std::vector<uint8_t>(1, slot_num));
+
+  uint64_t deadline = hostMicros() + CLIENT_TIMEOUT_US;
+  while (true) {
+    parseReplies();
+    bool progressed = false;
+    for (size_t i = 0; i < rx_frames.size(); i++) {
+      Frame& frame = rx_frames[i];
+      if (frame.command == PROTO_RSP_SLOT_DATA && frame.payload[0] == slot_num) {
+        uint16_t offset = frame.payload[1] | (frame.payload[2] << 8);
+        if (offset != image->size()) {
+          return false;
+        }
+        image->insert(image->end(), frame.payload.begin() + 3, frame.payload.end());
+      } else if (frame.command == PROTO_RSP_SLOT_END && frame.payload[0] == slot_num) {
+        uint16_t length = frame.payload[1] | (frame.payload[2] << 8);
+        rx_frames.erase(rx_frames.begin() + i);
+        return length == image->size();
+      } else if (frame.command == PROTO_RSP_ACK) {
+        return false;  // Refused
+      } else {
+        continue;
+      }
+      rx_frames.erase(rx_frames.begin() + i);
+      progressed = true;
+      break;
+    }
+    if (!progressed) {
+      if (hostMicros() >= deadline) {
+        return false;
+      }
+      runFor(CLIENT_STEP_US);
+    }
+  }
+}
+
+/**
+ * Upload one slot (stop-and-wait: one frame in flight)
+ * @return false on a protocol error
+ */
+static bool loadSlot(uint8_t slot_num, const SlotImage& image) {
+  sendFrame(PROTO_CMD_SLOT_LOAD_BEGIN, std::vector<uint8_t>(1, slot_num));
+  if (waitAck(PROTO_CMD_SLOT_LOAD_BEGIN) != PROTO_OK) {
+    return false;
+  }
+
+  for (size_t offset = 0; offset < image.size(); offset += PROTO_SLOT_CHUNK) {
+    size_t count = std::min(image.size() - offset, (size_t)PROTO_SLOT_CHUNK);
+    std::vector<uint8_t> payload;
+    payload.push_back(slot_num);
+    payload.push_back((uint8_t)offset);
+    payload.push_back((uint8_t)(offset >> 8));
+    payload.insert(payload.end(), image.begin() + offset, image.begin() + offset + count);
+    sendFrame(PROTO_CMD_SLOT_LOAD_DATA, payload);
+    if (waitAck(PROTO_CMD_SLOT_LOAD_DATA) != PROTO_OK) {
+      return false;
+    }
+  }
+
+  uint16_t notes = 0;
+  sendFrame(PROTO_CMD_SLOT_LOAD_END, std::vector<uint8_t>(1, slot_num));
+  return waitAck(PROTO_CMD_SLOT_LOAD_END, &notes) == PROTO_OK;
+}
+
+/**
+ * Download the merged timeline
+ * @return Number of events, or -1 on a protocol error
+ */
+static int dumpTimeline(std::vector<TimelineEvent>* events) {
+  events->clear();
+  sendFrame(PROTO_CMD_TIMELINE_DUMP, std::vector<uint8_t>());
+
+  uint64_t deadline = hostMicros() + CLIENT_TIMEOUT_US;
+  while (hostMicros() < deadline) {
+    parseReplies();
+    if (rx_frames.empty()) {
+      runFor(CLIENT_STEP_US);
+      continue;
+    }
+
+    Frame frame = rx_frames.front();
+    rx_frames.erase(rx_frames.begin());
+    if (frame.command == PROTO_RSP_TIMELINE_END) {
+      return frame.payload[0] | (frame.payload[1] << 8);
+    }
+    if (frame.command != PROTO_RSP_TIMELINE_DATA) {
+      return -1;
+    }
+    for (size_t p = 2; p + PROTO_TIMELINE_EVENT_BYTES <= frame.payload.size();
+         p += PROTO_TIMELINE_EVENT_BYTES) {
+      const uint8_t* e = &frame.payload[p];
+      unsigned long time = e[0] | (e[1] << 8) | ((unsigned long)e[2] << 16) |
+                           ((unsigned long)e[3] << 24);
+      events->push_back(TimelineEvent(time, e[4], e[5] | (e[6] << 8)));
+    }
+  }
+  return -1;
+}
+
+/**
+ * Export a MIDI file
+ * @param slot_num Slot, or PROTO_ALL_SLOTS
+ * @return false on a protocol error
+ */
+static bool exportMidi(uint8_t slot_num, std::vector<uint8_t>* file) {
+  file->clear();
+  sendFrame(PROTO_CMD_MIDI_EXPORT, std::vector<uint8_t>(1, slot_num));
+
+  uint64_t deadline = hostMicros() + CLIENT_TIMEOUT_US;
+  while (hostMicros() < deadline) {
+    parseReplies();
+    if (rx_frames.empty()) {
+      runFor(CLIENT_STEP_US);
+      continue;
+    }
+
+    Frame frame = rx_frames.front();
+    rx_frames.erase(rx_frames.begin());
+    if (frame.payload.size() < 4) {
+      return false;
+    }
+    const uint8_t* p = &frame.payload[0];
+    unsigned long offset = p[0] | (p[1] << 8) | ((unsigned long)p[2] << 16) |
+                           ((unsigned long)p[3] << 24);
+    if (frame.command == PROTO_RSP_MIDI_END) {
+      return offset == file->size();
+    }
+    if (frame.command != PROTO_RSP_MIDI_DATA || offset != file->size()) {
+      return false;
+    }
+    file->insert(file->end(), frame.payload.begin() + 4, frame.payload.end());
+  }
+  return false;
+}
+
+/**
+ * Read a MIDI variable-length quantity
+ */
+static unsigned long readVarLength(const std::vector<uint8_t>& data, size_t* pos) {
+  unsigned long value = 0;
+  while (*pos < data.size()) {
+    uint8_t c = data[(*pos)++];
+    value = (value << 7) | (c & 0x7F);
+    if ((c & 0x80) == 0) {
+      break;
+    }
+  }
+  return value;
+}
+
+static unsigned long readBigEndian(const std::vector<uint8_t>& data, size_t pos, int bytes) {
+  unsigned long value = 0;
+  for (int i = 0; i < bytes; i++) {
+    value = (value << 8) | data[pos + i];
+  }
+  return value;
+}
+
+/**
+ * Parse a Standard MIDI File into notes per track
+ * Accepts what a MIDI player needs: header, track chunks, running status,
+ * note-on with velocity 0 as note-off, meta events.
+ * @return false if the file is malformed
+ */
+static bool parseMidiFile(const std::vector<uint8_t>& data, std::vector<MidiTrack>* tracks) {
+  tracks->clear();
+  if (data.size() < 14 || memcmp(&data[0], "MThd", 4) != 0 ||
+      readBigEndian(data, 4, 4) != 6 || readBigEndian(data, 12, 2) != MIDI_TICKS_PER_QUARTER) {
+    return false;
+  }
+  unsigned long track_count = readBigEndian(data, 10, 2);
+
+  size_t pos = 14;
+  for (unsigned long t = 0; t < track_count; t++) {
+    if (pos + 8 > data.size() || memcmp(&data[pos], "MTrk", 4) != 0) {
+      return false;
+    }
+    size_t end = pos + 8 + readBigEndian(data, pos + 4, 4);
+    if (end > data.size()) {
+      return false;
+    }
+    pos += 8;
+
+    MidiTrack track;
+    unsigned long time = 0;
+    uint8_t status = 0;
+    long on_time[128];
+    for (int n = 0; n < 128; n++) {
+      on_time[n] = -1;
+    }
+    bool ended = false;
+    while (pos < end && !ended) {
+      time += readVarLength(data, &pos);
+      if (data[pos] & 0x80) {
+        status = data[pos++];
+      }
+      if (status == 0xFF) {
+        uint8_t type = data[pos++];
+        unsigned long length = readVarLength(data, &pos);
+        if (type == 0x51 && readBigEndian(data, pos, 3) != MIDI_TEMPO_US) {
+          return false;
+        }
+        ended = type == 0x2F;
+        pos += length;
+        status = 0;
+        continue;
+      }
+      if ((status & 0xF0) != MIDI_NOTE_ON || (status & 0x0F) != MIDI_CHANNEL - 1) {
+        return false;
+      }
+      uint8_t number = data[pos++];
+      uint8_t velocity = data[pos++];
+      if (velocity != 0) {
+        on_time[number] = time;
+      } else if (on_time[number] >= 0) {
+        int index = -1;
+        for (int n = 0; n < NUM_NOTES; n++) {
+          if (getNoteMidiNumber(n) == number) {
+            index = n;
+          }
+        }
+        MidiNote note = { (unsigned long)on_time[number], index, time - on_time[number] };
+        track.push_back(note);
+        on_time[number] = -1;
+      }
+    }
+    if (!ended || pos != end) {
+      return false;
+    }
+    tracks->push_back(track);
+    pos = end;
+  }
+  return pos == data.size();
+}
+
+/**
+ * Notes of a slot as a MIDI track should hold them
+ */
+static MidiTrack slotTrack(int slot_num) {
+  MidiTrack track;
+  SlotReader reader;
+  NoteEvent event;
+  unsigned long time = 0;
+  beginSlotRead(slot_num, &reader);
+  while (readNextEvent(&reader, &event)) {
+    MidiNote note = { time, event.note_index, (unsigned long)event.duration_units * DURATION_UNIT_MS };
+    if (event.note_index != NOTE_REST) {
+      track.push_back(note);
+    }
+    time += note.duration;
+  }
+  return track;
+}
+
+/**
+ * Sounding note at every millisecond (-1 for silence)
+ */
+static std::vector<int> renderTrack(const MidiTrack& track) {
+  std::vector<int> sound;
+  for (size_t i = 0; i < track.size(); i++) {
+    unsigned long end = track[i].start + track[i].duration;
+    if (sound.size() < end) {
+      sound.resize(end, -1);
+    }
+    for (unsigned long t = track[i].start; t < end; t++) {
+      sound[t] = track[i].note_index;
+    }
+  }
+  return sound;
+}
+
+/**
+ * Get a slot's encoded bytes straight from the sketch
+ */
+static SlotImage captureSlot(int slot_num) {
+  SlotImage image;
+  SlotReader reader;
+  beginSlotRead(slot_num, &reader);
+  while (reader.remaining > 0) {
+    image.push_back(readSlotByte(&reader));
+  }
+  return image;
+}
+
+/**
+ * Record a random take through the recording API
+ * @param timed Timed take as the looper records it: notes end when
+ *   released and the gaps are rests
+ */
+static void recordRandomTake(int slot_num, int max_notes, bool timed) {
+  if (timed) {
+    startTimedRecording(slot_num, millis());
+  } else {
+    startRecording(slot_num);
+  }
+
+  int notes = 1 + nextRandom() % max_notes;
+  for (int i = 0; i < notes && isRecording(); i++) {
+    if (!addNoteToRecording(getZoneNote(nextRandom() % getZoneCount()))) {
+      break;
+    }
+    if (timed) {
+      hostAdvanceMicros((uint64_t)(1 + nextRandom() % 10) * DURATION_UNIT_MS * 1000ULL);
+    }
+    releaseNoteInRecording();
+    hostAdvanceMicros((uint64_t)((timed ? 0 : 1) + nextRandom() % 20) * DURATION_UNIT_MS * 1000ULL);
+  }
+
+  if (timed) {
+    stopTimedRecording(millis() + DURATION_UNIT_MS);
+  } else {
+    stopRecording();
+  }
+}
+
+static bool readSlotSet(const char* path, SlotImage* slots) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
+    return false;
+  }
+  char line[1024];
+  for (int s = 0; s < NUM_RECORDING_SLOTS && fgets(line, sizeof(line), file); s++) {
+    unsigned int value;
+    for (char* p = line; sscanf(p, "%2x", &value) == 1; p += 2) {
+      slots[s].push_back((uint8_t)value);
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+static bool writeSlotSet(const char* path, const SlotImage* slots) {
+  FILE* file = fopen(path, "w");
+  if (file == NULL) {
+    return false;
+  }
+  for (int s = 0; s < NUM_RECORDING_SLOTS; s++) {
+    for (size_t i = 0; i < slots[s].size(); i++) {
+      fprintf(file, "%02x", slots[s][i]);
+    }
+    fprintf(file, "\n");
+  }
+  return fclose(file) == 0;
+}
+
+// ============================================
+// MAIN
+// ============================================
+
+int main(int argc, char** argv) {
+  const char* dump_path = NULL;
+  const char* load_path = NULL;
+  const char* midi_path = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--seed" && i + 1 < argc) {
+      rng_state = strtoul(argv[++i], NULL, 10);
+    } else if (arg == "--dump" && i + 1 < argc) {
+      dump_path = argv[++i];
+    } else if (arg == "--load" && i + 1 < argc) {
+      load_path = argv[++i];
+    } else if (arg == "--midi" && i + 1 < argc) {
+      midi_path = argv[++i];
+    } else {
+      fprintf(stderr, "Usage: %s [--seed N] [--dump FILE] [--load FILE] [--midi FILE]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  hostReset();
+  hostEepromErase();
+  hostSetSerialEcho(false);
+  HostHooks hooks = {};
+  hooks.on_serial_write = onSerialWrite;
+  hostSetHooks(hooks);
+  setup();
+  runFor(20000);  // Let the banner drain
+
+  int failures = 0;
+  SlotImage original[NUM_RECORDING_SLOTS];
+
+  if (load_path != NULL) {
+    if (!readSlotSet(load_path, original)) {
+      fprintf(stderr, "Cannot read %s\n", load_path);
+      return 2;
+    }
+    for (int s = 0; s < NUM_RECORDING_SLOTS; s++) {
+      if (!original[s].empty() && !loadSlot(s, original[s])) {
+        printf("Loading slot %d from %s failed\n", s + 1, load_path);
+        failures++;
+      }
+    }
+  } else {
+    // Fill the pool with random takes; the first is a timed take with rests
+    for (int s = 0; s < NUM_RECORDING_SLOTS; s++) {
+      recordRandomTake(s, s == 0 ? 30 : 120, s == 0);
+    }
+  }
+
+  size_t total_bytes = 0;
+  for (int s = 0; s < NUM_RECORDING_SLOTS; s++) {
+    original[s] = captureSlot(s);
+    total_bytes += original[s].size();
+  }
+  printf("Slot set:               %zu encoded bytes in %d slots\n", total_bytes, NUM_RECORDING_SLOTS);
+
+  // ---- STATUS ----
+  waitTxDrained();
+  uint64_t start = hostMicros();
+  Frame status;
+  sendFrame(PROTO_CMD_STATUS, std::vector<uint8_t>());
+  if (!waitFrame(PROTO_RSP_STATUS, &status) || status.payload[0] != PROTO_VERSION) {
+    printf("STATUS failed\n");
+    failures++;
+  } else {
+    printf("STATUS round trip:      %.2f ms\n", (hostMicros() - start) / 1000.0);
+  }
+
+  // ---- DOWNLOAD ----
+  waitTxDrained();
+  unsigned long up_before = bytes_up;
+  unsigned long down_before = bytes_down;
+  start = hostMicros();
+  SlotImage downloaded[NUM_RECORDING_SLOTS];
+  for (int s = 0; s < NUM_RECORDING_SLOTS; s++) {
+    if (!dumpSlot(s, &downloaded[s]) || downloaded[s] != original[s]) {
+      printf("Slot %d dump mismatch\n", s + 1);
+      failures++;
+    }
+  }
+  waitTxDrained();
+  double download_ms = (hostMicros() - start) / 1000.0;
+  printf("Download all slots:     %.1f ms  (%lu bytes down, %lu up; wire minimum %.1f ms)\n",
+         download_ms, bytes_down - down_before, bytes_up - up_before,
+         (bytes_down - down_before) * WIRE_BYTE_US / 1000.0);
+
+  // ---- TEXT BETWEEN FRAMES ----
+  rx_text.clear();
+  sendText("L\n");
+  runFor(60000);
+  parseReplies();
+  if (rx_text.find("Recording Slots") == std::string::npos) {
+    printf("Text command between frames not answered\n");
+    failures++;
+  }
+
+  // ---- UPLOAD ----
+  clearAllRecordings();
+  waitTxDrained();
+  up_before = bytes_up;
+  down_before = bytes_down;
+  start = hostMicros();
+  for (int s = 0; s < NUM_RECORDING_SLOTS; s++) {
+    if (!downloaded[s].empty() && !loadSlot(s, downloaded[s])) {
+      printf("Slot %d load refused\n", s + 1);
+      failures++;
+    }
+  }
+  double upload_ms = (hostMicros() - start) / 1000.0;
+  for (int s = 0; s < NUM_RECORDING_SLOTS; s++) {
+    if (captureSlot(s) != original[s]) {
+      printf("Slot %d differs after upload\n", s + 1);
+      failures++;
+    }
+  }
+  printf("Upload all slots:       %.1f ms  (%lu bytes up, %lu down; wire minimum %.1f ms)\n",
+         upload_ms, bytes_up - up_before, bytes_down - down_before,
+         (bytes_up - up_before) * WIRE_BYTE_US / 1000.0);
+
+  // ---- TIMELINE ----
+  // The merged slots outgrow the timeline and stream; the first slot fits
+  sendText("P1\n");
+  sendText("X\n");
+  runFor(20000);
+  waitTxDrained();
+  start = hostMicros();
+  std::vector<TimelineEvent> events;
+  int count = dumpTimeline(&events);
+  bool timeline_ok = count == timeline_event_count && (int)events.size() == count;
+  for (int i = 0; timeline_ok && i < count; i++) {
+    timeline_ok = events[i].timestamp_ms == timeline[i].timestamp_ms &&
+                  events[i].note_index == timeline[i].note_index &&
+                  events[i].duration_ms == timeline[i].duration_ms;
+  }
+  if (!timeline_ok) {
+    printf("Timeline dump mismatch\n");
+    failures++;
+  }
+  waitTxDrained();
+  printf("Timeline dump:          %.1f ms  (%d events)\n", (hostMicros() - start) / 1000.0, count);
+
+  // ---- MIDI EXPORT ----
+  std::vector<uint8_t> midi;
+  std::vector<MidiTrack> tracks;
+  for (int s = 0; s < NUM_RECORDING_SLOTS; s++) {
+    if (original[s].empty()) {
+      continue;
+    }
+    if (!exportMidi(s, &midi) || !parseMidiFile(midi, &tracks) || tracks.size() != 1 ||
+        tracks[0] != slotTrack(s)) {
+      printf("Slot %d MIDI export mismatch\n", s + 1);
+      failures++;
+    }
+  }
+
+  // Merged: same sound as the streaming merge PS plays (and PA, once the
+  // notes outgrow the timeline)
+  waitTxDrained();
+  start = hostMicros();
+  bool merged_ok = exportMidi(PROTO_ALL_SLOTS, &midi) && parseMidiFile(midi, &tracks) &&
+                   tracks.size() == 1;
+  waitTxDrained();
+  double midi_ms = (hostMicros() - start) / 1000.0;
+  if (merged_ok) {
+    MidiTrack played;
+    int slots[NUM_RECORDING_SLOTS];
+    TimelineEvent event;
+    beginStreamingMerge(slots, getActiveSlots(slots), current_overlap_strategy);
+    while (fetchNextStreamEvent(&event)) {
+      MidiNote note = { event.timestamp_ms, event.note_index, event.duration_ms };
+      played.push_back(note);
+    }
+    merged_ok = renderTrack(tracks[0]) == renderTrack(played);
+  }
+  if (!merged_ok) {
+    printf("Merged MIDI export mismatch\n");
+    failures++;
+  }
+  printf("MIDI export (merged):   %.1f ms  (%zu bytes, %zu notes)\n",
+         midi_ms, midi.size(), tracks.empty() ? (size_t)0 : tracks[0].size());
+  if (midi_path != NULL) {
+    FILE* file = fopen(midi_path, "wb");
+    if (file == NULL || fwrite(midi.data(), 1, midi.size(), file) != midi.size() || fclose(file) != 0) {
+      fprintf(stderr, "Cannot write %s\n", midi_path);
+      return 1;
+    }
+  }
+
+  // Polyphonic: one track per slot
+  sendText("M5\n");
+  std::vector<uint8_t> poly;
+  bool poly_ok = exportMidi(PROTO_ALL_SLOTS, &poly) && parseMidiFile(poly, &tracks);
+  int track = 0;
+  for (int s = 0; poly_ok && s < NUM_RECORDING_SLOTS; s++) {
+    if (!original[s].empty()) {
+      poly_ok = track < (int)tracks.size() && tracks[track++] == slotTrack(s);
+    }
+  }
+  if (!poly_ok || track != (int)tracks.size()) {
+    printf("Polyphonic MIDI export mismatch\n");
+    failures++;
+  }
+  sendText("M1\n");
+
+  // ---- ERRORS ----
+  sendFrame(PROTO_CMD_STATUS, std::vector<uint8_t>(), true);
+  if (waitAck(PROTO_CMD_STATUS) != PROTO_ERR_CRC) {
+    printf("Bad CRC not reported\n");
+    failures++;
+  }
+  sendFrame(PROTO_CMD_SLOT_LOAD_BEGIN, std::vector<uint8_t>(1, 0));
+  waitAck(PROTO_CMD_SLOT_LOAD_BEGIN);
+  std::vector<uint8_t> bad;
+  bad.push_back(0);
+  bad.push_back(0);
+  bad.push_back(0);
+  bad.push_back(EVENT_REPEAT_FORM);  // Repeat before any event
+  sendFrame(PROTO_CMD_SLOT_LOAD_DATA, bad);
+  if (waitAck(PROTO_CMD_SLOT_LOAD_DATA) != PROTO_ERR_DATA) {
+    printf("Invalid slot data accepted\n");
+    failures++;
+  }
+
+  // A client that goes away mid-load must not block recording
+  sendFrame(PROTO_CMD_SLOT_LOAD_BEGIN, std::vector<uint8_t>(1, 1));
+  waitAck(PROTO_CMD_SLOT_LOAD_BEGIN);
+  sendFrame(PROTO_CMD_SLOT_LOAD_BEGIN, std::vector<uint8_t>(1, 0));
+  waitAck(PROTO_CMD_SLOT_LOAD_BEGIN);
+  if (getLoadingSlot() != 0) {
+    printf("New load did not replace the pending one\n");
+    failures++;
+  }
+  runFor((PROTO_LOAD_TIMEOUT_MS + 100) * 1000.0);
+  if (getLoadingSlot() != -1 || !startRecording(0)) {
+    printf("Abandoned load not aborted\n");
+    failures++;
+  }
+  stopRecording();
+
+  printf("Frames with bad CRC:    %lu (from the board)\n", crc_errors);
+  printf("Result:                 %s\n", failures == 0 && crc_errors == 0 ? "PASS" : "FAIL");
+
+  if (dump_path != NULL && !writeSlotSet(dump_path, downloaded)) {
+    fprintf(stderr, "Cannot write %s\n", dump_path);
+    return 1;
+  }
+
+  return failures == 0 && crc_errors == 0 ? 0 : 1;
+}
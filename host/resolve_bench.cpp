@@ -0,0 +1,182 @@
+/**
+ * PianoAir overlap resolver benchmark
+ *
+ * Builds merged timelines of growing size from synthetic "slots" (notes
+ * back to back, as recorded) and times sort + resolveOverlaps() for every
+ * overlap strategy. Built with a large MAX_TIMELINE_EVENTS (see
+ * CMakeLists.txt) so the scaling can be seen well beyond the board's 40
+ * events. Each result is also checked against a brute-force reference:
+ * at every millisecond the resolved timeline must sound the note the
+ * strategy picks from the input events sounding at that time.
+ *
+ * Usage: pianoair_resolve [max_events]
+ */
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "PianoAir.ino"
+
+// ============================================
+// HELPERS
+// ============================================
+
+// Slots merged in every run
+#define RESOLVE_SLOTS 4
+
+static unsigned int rng_state = 1;
+
+static unsigned int nextRandom() {
+  rng_state = rng_state * 1103515245u + 12345u;
+  return rng_state >> 8;
+}
+
+static double nowNs() {
+  return std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Fill the timeline with RESOLVE_SLOTS slots of back-to-back notes
+ * @param events Total number of events
+ */
+static std::vector<TimelineEvent> makeInput(int events) {
+  std::vector<TimelineEvent> input;
+  for (int s = 0; s < RESOLVE_SLOTS; s++) {
+    unsigned long time = 0;
+    for (int i = s; i < events; i += RESOLVE_SLOTS) {
+      uint16_t duration = (1 + nextRandom() % 15) * DURATION_UNIT_MS;
+      input.push_back(TimelineEvent(time, nextRandom() % NUM_NOTES, duration));
+      time += duration;
+    }
+  }
+  return input;
+}
+
+/**
+ * Note the resolved timeline sounds at a time (-1 for silence)
+ */
+static int resolvedNoteAt(unsigned long time) {
+  for (int i = 0; i < timeline_event_count; i++) {
+    if (timeline[i].timestamp_ms <= time &&
+        time < timeline[i].timestamp_ms + timeline[i].duration_ms) {
+      return timeline[i].note_index;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Check the resolved timeline against the input, one millisecond at a time
+ * @return Number of milliseconds with the wrong note
+ */
+static long checkResolved(const std::vector<TimelineEvent>& input, OverlapStrategy strategy) {
+  unsigned long end = 0;
+  for (size_t i = 0; i < input.size(); i++) {
+    end = std::max(end, input[i].timestamp_ms + input[i].duration_ms);
+  }
+
+  long errors = 0;
+  for (unsigned long t = 0; t < end; t++) {
+    // Sounding notes, lowest first, each with the start of its run: walk
+    // back over touching events of that note
+    ActiveRun runs[RESOLVE_SLOTS];
+    uint8_t count = 0;
+    for (int n = 0; n < NUM_NOTES; n++) {
+      bool sounding = false;
+      for (size_t i = 0; i < input.size() && !sounding; i++) {
+        const TimelineEvent& e = input[i];
+        sounding = e.note_index == n && e.timestamp_ms <= t && t < e.timestamp_ms + e.duration_ms;
+      }
+      if (!sounding) {
+        continue;
+      }
+
+      unsigned long run_start = t;
+      bool extended = true;
+      while (extended) {
+        extended = false;
+        for (size_t i = 0; i < input.size(); i++) {
+          const TimelineEvent& e = input[i];
+          if (e.note_index == n && e.timestamp_ms < run_start &&
+              e.timestamp_ms + e.duration_ms > run_start) {
+            run_start = e.timestamp_ms;
+            extended = true;
+          }
+        }
+      }
+      runs[count].note_index = n;
+      runs[count].start_ms = run_start;
+      runs[count].end_ms = 0;
+      count++;
+    }
+
+    int got = resolvedNoteAt(t);
+    if (count == 0) {
+      errors += got != -1;
+    } else if (strategy == OVERLAP_ALTERNATE) {
+      bool found = false;
+      for (uint8_t r = 0; r < count; r++) {
+        found = found || runs[r].note_index == got;
+      }
+      errors += !found;
+    } else {
+      errors += got != pickOverlapNote(strategy, runs, count, 0);
+    }
+  }
+  return errors;
+}
+
+// ============================================
+// MAIN
+// ============================================
+
+int main(int argc, char** argv) {
+  int max_events = argc > 1 ? atoi(argv[1]) : MAX_TIMELINE_EVENTS / 2;
+  if (max_events <= 0 || max_events > MAX_TIMELINE_EVENTS) {
+    max_events = MAX_TIMELINE_EVENTS / 2;
+  }
+
+  hostReset();
+  hostSetSerialEcho(false);
+  setup();
+
+  const OverlapStrategy strategies[] = {
+    OVERLAP_PRIORITY_HIGH, OVERLAP_PRIORITY_LOW, OVERLAP_ALTERNATE, OVERLAP_DROP
+  };
+  const char* names[] = { "High", "Low", "Alternate", "Drop" };
+
+  printf("%-10s %8s %8s %12s %12s %8s\n", "strategy", "events", "output", "ns/event", "us/resolve", "errors");
+
+  long total_errors = 0;
+  for (int s = 0; s < 4; s++) {
+    for (int events = 32; events <= max_events; events *= 4) {
+      std::vector<TimelineEvent> input = makeInput(events);
+
+      // Repeat small runs so the timer has something to measure
+      int rounds = 1 + 200000 / events;
+      double total_ns = 0;
+      for (int r = 0; r < rounds; r++) {
+        std::copy(input.begin(), input.end(), timeline);
+        timeline_event_count = (int)input.size();
+        double start = nowNs();
+        qsort(timeline, timeline_event_count, sizeof(TimelineEvent), compareTimelineEvents);
+        resolveOverlaps(strategies[s]);
+        total_ns += nowNs() - start;
+      }
+
+      // Brute-force check is O(n^2 * time): only on the smaller sizes
+      long errors = events <= 512 ? checkResolved(input, strategies[s]) : 0;
+      total_errors += errors;
+
+      printf("%-10s %8d %8d %12.1f %12.1f %8s\n", names[s], events, timeline_event_count,
+             total_ns / rounds / events, total_ns / rounds / 1000.0,
+             events <= 512 ? std::to_string(errors).c_str() : "-");
+    }
+  }
+
+  return total_errors == 0 ? 0 : 1;
+}
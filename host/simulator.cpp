@@ -0,0 +1,580 @@
+/**
+ * PianoAir sensor-trace replay simulator
+ *
+ * Replays a hand-position trace through the simulated HC-SR04: every
+ * trigger pulse from the sketch is answered with an echo pulse on
+ * ECHO_PIN, delivered to echo_pin_interrupt() on the virtual clock.
+ * Every tone/noTone and LED transition is logged with its timestamp and
+ * compared against the trace to report hand-to-sound latency, dropped and
+ * duplicated notes, and (in record mode) recorded duration error. Loop
+ * mode records the trace with O1 over a looping backing track in slot 2
+ * and checks where the take placed each note on the loop's clock.
+ *
+ * Trace file: one "<time_ms> <distance_cm>" pair per line, holding until
+ * the next line; a distance <= 0 means no hand. Lines starting with '#'
+ * are comments.
+ *
+ * Usage: pianoair_sim [--trace FILE | --synthetic N] [--mode free|record|loop]
+ *                     [--scale 1-5] [--seed N] [--noise-cm X] [--glitch P]
+ *                     [--step-us N] [--log FILE] [--serial]
+ */
+
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "PianoAir.ino"
+
+// ============================================
+// SIMULATOR CONFIGURATION
+// ============================================
+
+// Delay between the trigger pulse and the start of the echo (us)
+#define SIM_ECHO_DELAY_US 450
+
+// Echo width reported by the HC-SR04 when nothing is in range (us)
+#define SIM_NO_ECHO_WIDTH_US 38000
+
+// Grace period after a segment ends in which its note may still start (ms)
+#define SIM_MATCH_GRACE_MS 200
+
+// Time to keep simulating after the trace ends (ms)
+#define SIM_TAIL_MS 1000
+
+// ============================================
+// SIMULATOR STATE
+// ============================================
+
+// One point of the hand-position trace
+struct TracePoint {
+  unsigned long time_ms;
+  double distance_cm;   // <= 0 for no hand
+};
+
+// Logged hardware transition
+struct LogEntry {
+  uint64_t time_us;
+  char kind;            // 'T' tone, 'N' noTone, 'L' LED
+  int value;            // Frequency or LED level
+  int pin;
+};
+
+// Interval of the trace in which the hand holds one note
+struct TruthSegment {
+  unsigned long start_ms;
+  unsigned long end_ms;
+  int note_index;
+};
+
+static std::vector<TracePoint> trace;
+static std::vector<LogEntry> event_log;
+static size_t trace_pos = 0;
+
+static unsigned int sim_seed = 1;
+static double noise_cm = 0;
+static double glitch_probability = 0;
+
+// ============================================
+// HELPERS
+// ============================================
+
+/**
+ * Deterministic pseudo-random number in [0, 1)
+ */
+static double simRandom() {
+  sim_seed = sim_seed * 1103515245u + 12345u;
+  return ((sim_seed >> 8) & 0xFFFF) / 65536.0;
+}
+
+/**
+ * Get the traced hand distance at a time
+ */
+static double traceDistanceAt(unsigned long time_ms) {
+  while (trace_pos + 1 < trace.size() && trace[trace_pos + 1].time_ms <= time_ms) {
+    trace_pos++;
+  }
+  if (trace.empty() || time_ms < trace[0].time_ms) {
+    return 0;
+  }
+  return trace[trace_pos].distance_cm;
+}
+
+/**
+ * Map a buzzer frequency back to a note index
+ */
+static int noteFromFrequency(unsigned int frequency) {
+  for (int i = 0; i < NUM_NOTES; i++) {
+    if ((unsigned int)getNoteFrequency(i) == frequency) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Get the centre of a distance zone
+ */
+static double zoneCenterCm(int zone) {
+  DistanceRange range = getZoneDistanceRange(zone);
+  return (range.min_cm + range.max_cm) / 2.0;
+}
+
+/**
+ * Get the percentile of a sorted sample (nearest rank)
+ */
+static double percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t rank = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+  return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+// ============================================
+// HARDWARE OBSERVERS
+// ============================================
+
+static bool isLedPin(uint8_t pin) {
+  for (int i = 0; i < NUM_NOTE_LEDS; i++) {
+    if (getLEDPin(i) == pin) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Answer trigger pulses with the traced echo and log LED transitions
+ */
+static void onPinWrite(uint8_t pin, uint8_t level, unsigned long time_us) {
+  (void)time_us;
+
+  if (isLedPin(pin)) {
+    LogEntry entry = { hostMicros(), 'L', level, pin };
+    event_log.push_back(entry);
+    return;
+  }
+
+  if (pin != TRIGGER_PIN || level != LOW) {
+    return;
+  }
+
+  double distance = traceDistanceAt((unsigned long)(hostMicros() / 1000));
+  uint64_t width = SIM_NO_ECHO_WIDTH_US;
+
+  if (glitch_probability > 0 && simRandom() < glitch_probability) {
+    // Spurious echo anywhere in the playable range
+    distance = 2.0 + simRandom() * 78.0;
+  }
+  if (distance > 0) {
+    distance += (simRandom() * 2.0 - 1.0) * noise_cm;
+    width = (uint64_t)(std::max(distance, 0.5) * 58.0);
+  }
+
+  uint64_t echo_start = hostMicros() + SIM_ECHO_DELAY_US;
+  hostScheduleInputPin(echo_start, ECHO_PIN, HIGH);
+  hostScheduleInputPin(echo_start + width, ECHO_PIN, LOW);
+}
+
+static void onTone(uint8_t pin, unsigned int frequency, unsigned long time_us) {
+  (void)time_us;
+  LogEntry entry = { hostMicros(), 'T', (int)frequency, pin };
+  event_log.push_back(entry);
+}
+
+static void onNoTone(uint8_t pin, unsigned long time_us) {
+  (void)time_us;
+  LogEntry entry = { hostMicros(), 'N', 0, pin };
+  event_log.push_back(entry);
+}
+
+// ============================================
+// TRACE INPUT
+// ============================================
+
+static bool loadTrace(const char* path) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
+    return false;
+  }
+
+  char line[128];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    TracePoint point;
+    if (line[0] == '#' || sscanf(line, "%lu %lf", &point.time_ms, &point.distance_cm) != 2) {
+      continue;
+    }
+    trace.push_back(point);
+  }
+
+  fclose(file);
+  return !trace.empty();
+}
+
+/**
+ * Generate a melody trace: hold each note 300-1500 ms, sometimes lift the hand
+ */
+static void generateTrace(int num_notes) {
+  unsigned long time_ms = 500;
+  int previous_zone = -1;
+
+  TracePoint start = { 0, 0 };
+  trace.push_back(start);
+
+  for (int i = 0; i < num_notes; i++) {
+    int zone = (int)(simRandom() * getZoneCount());
+    if (zone == previous_zone) {
+      zone = (zone + 1) % getZoneCount();
+    }
+    previous_zone = zone;
+
+    TracePoint point = { time_ms, zoneCenterCm(zone) };
+    trace.push_back(point);
+    time_ms += 300 + (unsigned long)(simRandom() * 1200);
+
+    if (simRandom() < 0.25) {
+      TracePoint lift = { time_ms, 0 };
+      trace.push_back(lift);
+      time_ms += 100 + (unsigned long)(simRandom() * 400);
+      previous_zone = -1;
+    }
+  }
+
+  TracePoint end = { time_ms, 0 };
+  trace.push_back(end);
+}
+
+/**
+ * Convert the trace into note segments (ground truth)
+ */
+static std::vector<TruthSegment> buildTruthSegments() {
+  std::vector<TruthSegment> segments;
+
+  for (size_t i = 0; i < trace.size(); i++) {
+    unsigned long end_ms = i + 1 < trace.size() ? trace[i + 1].time_ms : trace[i].time_ms;
+    int note = trace[i].distance_cm > 0 ? getZoneNote(getZoneFromDistance(trace[i].distance_cm)) : -1;
+
+    if (!segments.empty() && segments.back().note_index == note &&
+        segments.back().end_ms == trace[i].time_ms) {
+      segments.back().end_ms = end_ms;  // Same note continues
+    } else if (end_ms > trace[i].time_ms) {
+      TruthSegment segment = { trace[i].time_ms, end_ms, note };
+      segments.push_back(segment);
+    }
+  }
+
+  // Keep only segments where a note is held
+  std::vector<TruthSegment> notes;
+  for (size_t i = 0; i < segments.size(); i++) {
+    if (segments[i].note_index != -1) {
+      notes.push_back(segments[i]);
+    }
+  }
+  return notes;
+}
+
+// ============================================
+// REPORT
+// ============================================
+
+static void reportLatency(const std::vector<TruthSegment>& segments) {
+  // Sound onsets: a tone() call that changes what the buzzer plays
+  std::vector<LogEntry> onsets;
+  unsigned int sounding = 0;
+  for (size_t i = 0; i < event_log.size(); i++) {
+    const LogEntry& entry = event_log[i];
+    if (entry.kind == 'T' && (unsigned int)entry.value != sounding) {
+      onsets.push_back(entry);
+      sounding = entry.value;
+    } else if (entry.kind == 'N') {
+      sounding = 0;
+    }
+  }
+
+  std::vector<double> latencies;
+  int dropped = 0;
+  int duplicated = 0;
+  std::vector<bool> matched(onsets.size(), false);
+
+  for (size_t s = 0; s < segments.size(); s++) {
+    const TruthSegment& segment = segments[s];
+    uint64_t window_start = (uint64_t)segment.start_ms * 1000;
+    uint64_t window_end = (uint64_t)(segment.end_ms + SIM_MATCH_GRACE_MS) * 1000;
+    int hits = 0;
+
+    for (size_t o = 0; o < onsets.size(); o++) {
+      if (matched[o] || onsets[o].time_us < window_start || onsets[o].time_us >= window_end) {
+        continue;
+      }
+      if (noteFromFrequency(onsets[o].value) != segment.note_index) {
+        continue;
+      }
+      if (hits == 0) {
+        latencies.push_back((onsets[o].time_us - window_start) / 1000.0);
+      }
+      matched[o] = true;
+      hits++;
+    }
+
+    if (hits == 0) {
+      dropped++;
+    } else {
+      duplicated += hits - 1;
+    }
+  }
+
+  int spurious = 0;
+  for (size_t o = 0; o < onsets.size(); o++) {
+    if (!matched[o]) {
+      spurious++;
+    }
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+
+  printf("Notes in trace:       %d\n", (int)segments.size());
+  printf("Sound onsets:         %d\n", (int)onsets.size());
+  printf("Dropped notes:        %d\n", dropped);
+  printf("Duplicated notes:     %d\n", duplicated);
+  printf("Wrong/spurious notes: %d\n", spurious);
+  printf("Echo ring overflows:  %u\n", (unsigned int)getEchoOverflowCount());
+  printf("Hand-to-sound latency (ms): p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+         percentile(latencies, 50), percentile(latencies, 90),
+         percentile(latencies, 99), percentile(latencies, 100));
+}
+
+/**
+ * Read back the events stored in a recording slot
+ */
+static std::vector<NoteEvent> readRecordedEvents(int slot_num) {
+  std::vector<NoteEvent> events;
+  SlotReader reader;
+  NoteEvent event;
+
+  beginSlotRead(slot_num, &reader);
+  while (readNextEvent(&reader, &event)) {
+    events.push_back(event);
+  }
+  return events;
+}
+
+/**
+ * Check a looper take against the trace: every note must start and end
+ * where the hand did, measured from the start of the pass
+ */
+static void reportLoopTake(const std::vector<TruthSegment>& segments, unsigned long pass_start_ms,
+                           unsigned long loop_ms) {
+  std::vector<NoteEvent> events = readRecordedEvents(0);
+  std::vector<TruthSegment> notes;
+  unsigned long position_ms = 0;
+  int rests = 0;
+
+  for (size_t i = 0; i < events.size(); i++) {
+    unsigned long duration_ms = events[i].duration_units * (unsigned long)DURATION_UNIT_MS;
+    if (events[i].note_index == NOTE_REST) {
+      rests++;
+    } else {
+      TruthSegment note = { pass_start_ms + position_ms, pass_start_ms + position_ms + duration_ms,
+                            events[i].note_index };
+      notes.push_back(note);
+    }
+    position_ms += duration_ms;
+  }
+
+  printf("Take events:          %d notes, %d rests (trace has %d notes)\n",
+         (int)notes.size(), rests, (int)segments.size());
+  printf("Take length:          %lu ms (loop %lu ms)\n", position_ms, loop_ms);
+
+  size_t compared = std::min(notes.size(), segments.size());
+  int note_mismatches = 0;
+  double onset_total = 0, onset_max = 0, end_total = 0, end_max = 0;
+
+  for (size_t i = 0; i < compared; i++) {
+    double onset_error = fabs((double)notes[i].start_ms - (double)segments[i].start_ms);
+    double end_error = fabs((double)notes[i].end_ms - (double)segments[i].end_ms);
+
+    if (notes[i].note_index != segments[i].note_index) {
+      note_mismatches++;
+    }
+    onset_total += onset_error;
+    onset_max = std::max(onset_max, onset_error);
+    end_total += end_error;
+    end_max = std::max(end_max, end_error);
+  }
+
+  printf("Take note mismatches: %d of %d compared\n", note_mismatches, (int)compared);
+  printf("Take onset error (ms):   mean %.1f  max %.1f\n",
+         compared > 0 ? onset_total / compared : 0.0, onset_max);
+  printf("Take release error (ms): mean %.1f  max %.1f\n",
+         compared > 0 ? end_total / compared : 0.0, end_max);
+}
+
+static void reportRecording(const std::vector<TruthSegment>& segments, unsigned long stop_ms) {
+  std::vector<NoteEvent> events = readRecordedEvents(0);
+
+  printf("Recorded events:      %d (trace has %d notes)\n",
+         (int)events.size(), (int)segments.size());
+
+  // A recorded note lasts until the next note starts (rests are absorbed)
+  size_t compared = std::min(events.size(), segments.size());
+  int note_mismatches = 0;
+  double total_error = 0;
+  double max_error = 0;
+
+  for (size_t i = 0; i < compared; i++) {
+    unsigned long next_start = i + 1 < segments.size() ? segments[i + 1].start_ms : stop_ms;
+    double expected_ms = (double)(next_start - segments[i].start_ms);
+    double recorded_ms = events[i].duration_units * (double)DURATION_UNIT_MS;
+    double error = fabs(recorded_ms - expected_ms);
+
+    if (events[i].note_index != segments[i].note_index) {
+      note_mismatches++;
+    }
+    total_error += error;
+    max_error = std::max(max_error, error);
+  }
+
+  printf("Recorded note mismatches: %d of %d compared\n", note_mismatches, (int)compared);
+  printf("Recording duration error (ms): mean %.1f  max %.1f\n",
+         compared > 0 ? total_error / compared : 0.0, max_error);
+}
+
+static bool writeLog(const char* path) {
+  FILE* file = fopen(path, "w");
+  if (file == NULL) {
+    return false;
+  }
+
+  fprintf(file, "time_us,kind,pin,value\n");
+  for (size_t i = 0; i < event_log.size(); i++) {
+    const LogEntry& entry = event_log[i];
+    const char* kind = entry.kind == 'T' ? "tone" : entry.kind == 'N' ? "noTone" : "led";
+    fprintf(file, "%llu,%s,%d,%d\n", (unsigned long long)entry.time_us, kind, entry.pin, entry.value);
+  }
+
+  fclose(file);
+  return true;
+}
+
+// ============================================
+// MAIN
+// ============================================
+
+int main(int argc, char** argv) {
+  const char* trace_path = NULL;
+  const char* log_path = NULL;
+  int synthetic_notes = 40;
+  bool record_mode = false;
+  bool loop_mode = false;
+  int scale = DEFAULT_SCALE;
+  bool serial_echo = false;
+  unsigned long step_us = 100;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--trace" && i + 1 < argc) {
+      trace_path = argv[++i];
+    } else if (arg == "--synthetic" && i + 1 < argc) {
+      synthetic_notes = atoi(argv[++i]);
+    } else if (arg == "--mode" && i + 1 < argc) {
+      std::string mode = argv[++i];
+      record_mode = mode == "record";
+      loop_mode = mode == "loop";
+    } else if (arg == "--scale" && i + 1 < argc) {
+      scale = atoi(argv[++i]) - 1;
+    } else if (arg == "--seed" && i + 1 < argc) {
+      sim_seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+    } else if (arg == "--noise-cm" && i + 1 < argc) {
+      noise_cm = atof(argv[++i]);
+    } else if (arg == "--glitch" && i + 1 < argc) {
+      glitch_probability = atof(argv[++i]);
+    } else if (arg == "--step-us" && i + 1 < argc) {
+      step_us = strtoul(argv[++i], NULL, 10);
+    } else if (arg == "--log" && i + 1 < argc) {
+      log_path = argv[++i];
+    } else if (arg == "--serial") {
+      serial_echo = true;
+    } else {
+      fprintf(stderr, "Usage: %s [--trace FILE | --synthetic N] [--mode free|record|loop] "
+                      "[--scale 1-5] [--seed N] [--noise-cm X] [--glitch P] [--step-us N] "
+                      "[--log FILE] [--serial]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  // Zones the trace and its ground truth are laid out on
+  if (!setScale(scale, DEFAULT_KEY)) {
+    fprintf(stderr, "Unknown scale %d\n", scale + 1);
+    return 2;
+  }
+
+  if (trace_path != NULL) {
+    if (!loadTrace(trace_path)) {
+      fprintf(stderr, "Cannot read trace %s\n", trace_path);
+      return 1;
+    }
+  } else {
+    generateTrace(synthetic_notes);
+  }
+
+  hostReset();
+  hostSetSerialEcho(serial_echo);
+  HostHooks hooks = { onPinWrite, onTone, onNoTone, NULL };
+  hostSetHooks(hooks);
+
+  setup();
+  setScale(scale, DEFAULT_KEY);  // setup() selected the default
+
+  unsigned long trace_end_ms = trace.back().time_ms;
+  if (loop_mode) {
+    // Backing track in slot 2: C5 held in 20 s notes past the end of the
+    // trace, so the take in slot 1 covers all of it
+    uint8_t note_bytes[2] = { (uint8_t)(EVENT_LONG_FORM | NOTE_C5), 200 };
+    beginSlotLoad(1);
+    for (unsigned long t = 0; t <= trace_end_ms; t += 200 * DURATION_UNIT_MS) {
+      loadSlotBytes(note_bytes, sizeof(note_bytes));
+    }
+    endSlotLoad();
+  }
+  hostSerialInject(loop_mode ? "O1\n" : record_mode ? "R1\n" : "0\n");
+
+  unsigned long pass_start_ms = 0;
+  while (millis() < trace_end_ms) {
+    loop();
+    if (loop_mode && pass_start_ms == 0) {
+      pass_start_ms = looper_pass_start;
+    }
+    hostAdvanceMicros(step_us);
+  }
+
+  unsigned long stop_ms = millis();
+  unsigned long loop_ms = getLooperLength();
+  if (record_mode || loop_mode) {
+    hostSerialInject("S\n");
+  }
+  while (millis() < trace_end_ms + SIM_TAIL_MS) {
+    loop();
+    hostAdvanceMicros(step_us);
+  }
+
+  std::vector<TruthSegment> segments = buildTruthSegments();
+
+  printf("\n=== PianoAir simulation (%s, %d zones, %lu ms) ===\n",
+         loop_mode ? "loop" : record_mode ? "record" : "free play", getZoneCount(), trace_end_ms);
+  if (loop_mode) {
+    reportLoopTake(segments, pass_start_ms, loop_ms);  // Synth voices: no tone() to time
+  } else {
+    reportLatency(segments);
+  }
+  if (record_mode) {
+    reportRecording(segments, stop_ms);
+  }
+
+  if (log_path != NULL && !writeLog(log_path)) {
+    fprintf(stderr, "Cannot write log %s\n", log_path);
+    return 1;
+  }
+
+  return 0;
+}